@@ -0,0 +1,946 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/input-event-codes.h>
+#include <poll.h>
+#include <spawn.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include <wayland-client.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "virtual-keyboard-unstable-v1-client-protocol.h"
+#include "xdg-shell-client-protocol.h"
+
+/*
+ * kristal-bench: starts kristal on the headless backend, maps N synthetic
+ * xdg_toplevel clients (one connection each) and drives them through
+ * steady-state commits, fullscreen/maximize toggles, keyboard moves and
+ * resizes, workspace switches and close. Compositor-side timings come from
+ * the KRISTAL_PERF_REPORT file kristal writes on SIGTERM.
+ */
+
+extern char **environ;
+
+namespace {
+
+#ifndef KRISTAL_BENCH_COMPOSITOR
+#define KRISTAL_BENCH_COMPOSITOR "kristal"
+#endif
+
+constexpr int kDefaultWidth = 320;
+constexpr int kDefaultHeight = 240;
+constexpr int kStartupTimeoutMs = 10000;
+constexpr int kMapTimeoutMs = 60000;
+
+struct BenchOptions {
+	std::string compositor = KRISTAL_BENCH_COMPOSITOR;
+	std::vector<int> counts = {10, 100, 1000};
+	int fps = 60;
+	int steady_ms = 2000;
+	int key_actions = 20;
+	int switches = 20;
+	std::string layout = "grid";
+	std::string virtual_clock;
+};
+
+uint64_t now_ns() {
+	timespec now{};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return static_cast<uint64_t>(now.tv_sec) * 1000000000ull +
+		static_cast<uint64_t>(now.tv_nsec);
+}
+
+double ns_to_ms(uint64_t ns) {
+	return static_cast<double>(ns) / 1000000.0;
+}
+
+int create_memfd(const char *name, size_t size) {
+	const int fd = memfd_create(name, MFD_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* ---- Synthetic toplevel clients ----------------------------------------- */
+
+struct BenchWindow {
+	int index;
+	wl_display *display;
+	wl_registry *registry;
+	wl_compositor *compositor;
+	wl_shm *shm;
+	xdg_wm_base *wm_base;
+	wl_surface *surface;
+	xdg_surface *xdg_surface;
+	xdg_toplevel *toplevel;
+	wl_buffer *buffer;
+	wl_callback *frame;
+	int buffer_width;
+	int buffer_height;
+	int pending_width;
+	int pending_height;
+	bool configured;
+	bool mapped;
+	uint64_t first_commit_ns;
+	uint64_t map_latency_ns;
+	uint64_t commits;
+};
+
+void window_commit(BenchWindow *window);
+
+void frame_done(void *data, wl_callback *callback, uint32_t /*time*/) {
+	auto *window = static_cast<BenchWindow *>(data);
+	wl_callback_destroy(callback);
+	window->frame = nullptr;
+	if (!window->mapped) {
+		window->mapped = true;
+		window->map_latency_ns = now_ns() - window->first_commit_ns;
+	}
+}
+
+const wl_callback_listener frame_listener = {frame_done};
+
+bool window_create_buffer(BenchWindow *window, int width, int height) {
+	const int stride = width * 4;
+	const size_t size = static_cast<size_t>(stride) * static_cast<size_t>(height);
+	const int fd = create_memfd("kristal-bench", size);
+	if (fd < 0) {
+		return false;
+	}
+	void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+	/* Distinct flat colour per window so damage is real pixel change. */
+	const uint32_t colour = 0xff000000u | (static_cast<uint32_t>(window->index) * 2654435761u >> 8);
+	auto *pixels = static_cast<uint32_t *>(data);
+	std::fill(pixels, pixels + size / 4, colour);
+	munmap(data, size);
+
+	wl_shm_pool *pool = wl_shm_create_pool(window->shm, fd, static_cast<int32_t>(size));
+	wl_buffer *buffer = wl_shm_pool_create_buffer(
+		pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
+	wl_shm_pool_destroy(pool);
+	close(fd);
+
+	if (window->buffer != nullptr) {
+		wl_buffer_destroy(window->buffer);
+	}
+	window->buffer = buffer;
+	window->buffer_width = width;
+	window->buffer_height = height;
+	return true;
+}
+
+void window_commit(BenchWindow *window) {
+	if (window->buffer == nullptr) {
+		return;
+	}
+	wl_surface_attach(window->surface, window->buffer, 0, 0);
+	wl_surface_damage_buffer(window->surface, 0, 0, window->buffer_width, window->buffer_height);
+	if (window->frame == nullptr) {
+		window->frame = wl_surface_frame(window->surface);
+		wl_callback_add_listener(window->frame, &frame_listener, window);
+	}
+	wl_surface_commit(window->surface);
+	if (window->first_commit_ns == 0) {
+		window->first_commit_ns = now_ns();
+	}
+	window->commits++;
+}
+
+void xdg_surface_configure(void *data, xdg_surface *surface, uint32_t serial) {
+	auto *window = static_cast<BenchWindow *>(data);
+	xdg_surface_ack_configure(surface, serial);
+	window->configured = true;
+
+	const int width = window->pending_width > 0 ? window->pending_width : kDefaultWidth;
+	const int height = window->pending_height > 0 ? window->pending_height : kDefaultHeight;
+	if (window->buffer == nullptr || width != window->buffer_width ||
+		height != window->buffer_height) {
+		window_create_buffer(window, width, height);
+	}
+	window_commit(window);
+}
+
+const xdg_surface_listener xdg_surface_listener_impl = {xdg_surface_configure};
+
+void toplevel_configure(
+	void *data,
+	xdg_toplevel * /*toplevel*/,
+	int32_t width,
+	int32_t height,
+	wl_array * /*states*/) {
+	auto *window = static_cast<BenchWindow *>(data);
+	window->pending_width = width;
+	window->pending_height = height;
+}
+
+void toplevel_close(void * /*data*/, xdg_toplevel * /*toplevel*/) {
+}
+
+void toplevel_configure_bounds(void *, xdg_toplevel *, int32_t, int32_t) {
+}
+
+void toplevel_wm_capabilities(void *, xdg_toplevel *, wl_array *) {
+}
+
+const xdg_toplevel_listener toplevel_listener = {
+	toplevel_configure,
+	toplevel_close,
+	toplevel_configure_bounds,
+	toplevel_wm_capabilities,
+};
+
+void wm_base_ping(void * /*data*/, xdg_wm_base *wm_base, uint32_t serial) {
+	xdg_wm_base_pong(wm_base, serial);
+}
+
+const xdg_wm_base_listener wm_base_listener = {wm_base_ping};
+
+void window_registry_global(
+	void *data,
+	wl_registry *registry,
+	uint32_t name,
+	const char *interface,
+	uint32_t /*version*/) {
+	auto *window = static_cast<BenchWindow *>(data);
+	if (std::strcmp(interface, wl_compositor_interface.name) == 0) {
+		window->compositor = static_cast<wl_compositor *>(
+			wl_registry_bind(registry, name, &wl_compositor_interface, 4));
+	} else if (std::strcmp(interface, wl_shm_interface.name) == 0) {
+		window->shm = static_cast<wl_shm *>(
+			wl_registry_bind(registry, name, &wl_shm_interface, 1));
+	} else if (std::strcmp(interface, xdg_wm_base_interface.name) == 0) {
+		window->wm_base = static_cast<xdg_wm_base *>(
+			wl_registry_bind(registry, name, &xdg_wm_base_interface, 1));
+		xdg_wm_base_add_listener(window->wm_base, &wm_base_listener, window);
+	}
+}
+
+void registry_global_remove(void *, wl_registry *, uint32_t) {
+}
+
+const wl_registry_listener window_registry_listener = {
+	window_registry_global,
+	registry_global_remove,
+};
+
+BenchWindow *window_create(const char *socket, int index) {
+	wl_display *display = wl_display_connect(socket);
+	if (display == nullptr) {
+		return nullptr;
+	}
+	auto *window = new BenchWindow{};
+	window->index = index;
+	window->display = display;
+	window->registry = wl_display_get_registry(display);
+	wl_registry_add_listener(window->registry, &window_registry_listener, window);
+	wl_display_roundtrip(display);
+	if (window->compositor == nullptr || window->shm == nullptr || window->wm_base == nullptr) {
+		std::fprintf(stderr, "kristal-bench: compositor is missing required globals\n");
+		wl_display_disconnect(display);
+		delete window;
+		return nullptr;
+	}
+
+	window->surface = wl_compositor_create_surface(window->compositor);
+	window->xdg_surface = xdg_wm_base_get_xdg_surface(window->wm_base, window->surface);
+	xdg_surface_add_listener(window->xdg_surface, &xdg_surface_listener_impl, window);
+	window->toplevel = xdg_surface_get_toplevel(window->xdg_surface);
+	xdg_toplevel_add_listener(window->toplevel, &toplevel_listener, window);
+	char title[32];
+	std::snprintf(title, sizeof(title), "bench-%d", index);
+	xdg_toplevel_set_title(window->toplevel, title);
+	xdg_toplevel_set_app_id(window->toplevel, "kristal-bench");
+	wl_surface_commit(window->surface);
+	wl_display_flush(display);
+	return window;
+}
+
+void window_destroy(BenchWindow *window) {
+	if (window->frame != nullptr) {
+		wl_callback_destroy(window->frame);
+	}
+	if (window->buffer != nullptr) {
+		wl_buffer_destroy(window->buffer);
+	}
+	xdg_toplevel_destroy(window->toplevel);
+	xdg_surface_destroy(window->xdg_surface);
+	wl_surface_destroy(window->surface);
+	xdg_wm_base_destroy(window->wm_base);
+	wl_shm_destroy(window->shm);
+	wl_compositor_destroy(window->compositor);
+	wl_registry_destroy(window->registry);
+	wl_display_flush(window->display);
+	wl_display_disconnect(window->display);
+	delete window;
+}
+
+/* ---- Keyboard driver ---------------------------------------------------- */
+
+struct BenchDriver {
+	wl_display *display;
+	wl_registry *registry;
+	wl_seat *seat;
+	zwp_virtual_keyboard_manager_v1 *keyboard_manager;
+	zwp_virtual_keyboard_v1 *keyboard;
+	uint32_t alt_mask;
+	uint32_t shift_mask;
+	uint32_t ctrl_mask;
+};
+
+void driver_registry_global(
+	void *data,
+	wl_registry *registry,
+	uint32_t name,
+	const char *interface,
+	uint32_t /*version*/) {
+	auto *driver = static_cast<BenchDriver *>(data);
+	if (std::strcmp(interface, wl_seat_interface.name) == 0 && driver->seat == nullptr) {
+		driver->seat = static_cast<wl_seat *>(
+			wl_registry_bind(registry, name, &wl_seat_interface, 1));
+	} else if (std::strcmp(interface, zwp_virtual_keyboard_manager_v1_interface.name) == 0) {
+		driver->keyboard_manager = static_cast<zwp_virtual_keyboard_manager_v1 *>(
+			wl_registry_bind(registry, name, &zwp_virtual_keyboard_manager_v1_interface, 1));
+	}
+}
+
+const wl_registry_listener driver_registry_listener = {
+	driver_registry_global,
+	registry_global_remove,
+};
+
+bool driver_upload_keymap(BenchDriver *driver) {
+	xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	if (context == nullptr) {
+		return false;
+	}
+	xkb_rule_names names{};
+	names.rules = "evdev";
+	names.model = "pc105";
+	names.layout = "us";
+	xkb_keymap *keymap = xkb_keymap_new_from_names(context, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+	xkb_context_unref(context);
+	if (keymap == nullptr) {
+		return false;
+	}
+	driver->alt_mask = 1u << xkb_keymap_mod_get_index(keymap, XKB_MOD_NAME_ALT);
+	driver->shift_mask = 1u << xkb_keymap_mod_get_index(keymap, XKB_MOD_NAME_SHIFT);
+	driver->ctrl_mask = 1u << xkb_keymap_mod_get_index(keymap, XKB_MOD_NAME_CTRL);
+
+	char *text = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+	xkb_keymap_unref(keymap);
+	if (text == nullptr) {
+		return false;
+	}
+	const size_t size = std::strlen(text) + 1;
+	const int fd = create_memfd("kristal-bench-keymap", size);
+	bool ok = false;
+	if (fd >= 0) {
+		ok = pwrite(fd, text, size, 0) == static_cast<ssize_t>(size);
+		if (ok) {
+			zwp_virtual_keyboard_v1_keymap(
+				driver->keyboard,
+				WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1,
+				fd,
+				static_cast<uint32_t>(size));
+		}
+		close(fd);
+	}
+	std::free(text);
+	return ok;
+}
+
+bool driver_connect(BenchDriver *driver, const char *socket) {
+	*driver = BenchDriver{};
+	driver->display = wl_display_connect(socket);
+	if (driver->display == nullptr) {
+		return false;
+	}
+	driver->registry = wl_display_get_registry(driver->display);
+	wl_registry_add_listener(driver->registry, &driver_registry_listener, driver);
+	wl_display_roundtrip(driver->display);
+	if (driver->seat == nullptr || driver->keyboard_manager == nullptr) {
+		std::fprintf(stderr, "kristal-bench: compositor lacks wl_seat or virtual keyboards\n");
+		return false;
+	}
+	driver->keyboard = zwp_virtual_keyboard_manager_v1_create_virtual_keyboard(
+		driver->keyboard_manager, driver->seat);
+	if (!driver_upload_keymap(driver)) {
+		std::fprintf(stderr, "kristal-bench: failed to build keymap\n");
+		return false;
+	}
+	wl_display_roundtrip(driver->display);
+	return true;
+}
+
+void driver_disconnect(BenchDriver *driver) {
+	if (driver->display == nullptr) {
+		return;
+	}
+	if (driver->keyboard != nullptr) {
+		zwp_virtual_keyboard_v1_destroy(driver->keyboard);
+	}
+	if (driver->keyboard_manager != nullptr) {
+		zwp_virtual_keyboard_manager_v1_destroy(driver->keyboard_manager);
+	}
+	if (driver->seat != nullptr) {
+		wl_seat_destroy(driver->seat);
+	}
+	wl_registry_destroy(driver->registry);
+	wl_display_disconnect(driver->display);
+	driver->display = nullptr;
+}
+
+/* Press and release a key with modifiers held; returns the round trip. */
+uint64_t driver_chord(BenchDriver *driver, uint32_t modifiers, uint32_t key) {
+	const uint64_t start = now_ns();
+	const uint32_t time = static_cast<uint32_t>(start / 1000000ull);
+	zwp_virtual_keyboard_v1_modifiers(driver->keyboard, modifiers, 0, 0, 0);
+	zwp_virtual_keyboard_v1_key(driver->keyboard, time, key, WL_KEYBOARD_KEY_STATE_PRESSED);
+	zwp_virtual_keyboard_v1_key(driver->keyboard, time, key, WL_KEYBOARD_KEY_STATE_RELEASED);
+	zwp_virtual_keyboard_v1_modifiers(driver->keyboard, 0, 0, 0, 0);
+	wl_display_roundtrip(driver->display);
+	return now_ns() - start;
+}
+
+/* ---- Event pumping ------------------------------------------------------ */
+
+struct BenchSession {
+	std::vector<BenchWindow *> windows;
+	std::vector<pollfd> fds;
+	uint64_t next_tick_ns;
+	uint64_t tick_interval_ns;
+	bool ticking;
+};
+
+/*
+ * One poll over every connection. Ticks re-commit each mapped window whose
+ * previous frame callback has fired, like a throttled animating client.
+ */
+void pump(BenchSession *session, int timeout_ms) {
+	auto &windows = session->windows;
+	auto &fds = session->fds;
+	fds.resize(windows.size());
+	for (size_t i = 0; i < windows.size(); ++i) {
+		wl_display *display = windows[i]->display;
+		while (wl_display_prepare_read(display) != 0) {
+			wl_display_dispatch_pending(display);
+		}
+		wl_display_flush(display);
+		fds[i].fd = wl_display_get_fd(display);
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+
+	if (session->ticking) {
+		const uint64_t now = now_ns();
+		const int until_tick = session->next_tick_ns > now
+			? static_cast<int>((session->next_tick_ns - now) / 1000000ull)
+			: 0;
+		timeout_ms = std::min(timeout_ms, until_tick);
+	}
+	poll(fds.data(), fds.size(), timeout_ms);
+
+	for (size_t i = 0; i < windows.size(); ++i) {
+		if ((fds[i].revents & POLLIN) != 0) {
+			wl_display_read_events(windows[i]->display);
+		} else {
+			wl_display_cancel_read(windows[i]->display);
+		}
+		wl_display_dispatch_pending(windows[i]->display);
+	}
+
+	if (session->ticking && now_ns() >= session->next_tick_ns) {
+		for (BenchWindow *window : windows) {
+			if (window->mapped && window->frame == nullptr) {
+				window_commit(window);
+			}
+		}
+		session->next_tick_ns += session->tick_interval_ns;
+	}
+}
+
+void pump_for(BenchSession *session, int duration_ms) {
+	const uint64_t deadline = now_ns() + static_cast<uint64_t>(duration_ms) * 1000000ull;
+	while (now_ns() < deadline) {
+		pump(session, static_cast<int>((deadline - now_ns()) / 1000000ull) + 1);
+	}
+}
+
+bool all_mapped(const BenchSession &session) {
+	return std::all_of(session.windows.begin(), session.windows.end(), [](BenchWindow *window) {
+		return window->mapped;
+	});
+}
+
+/* ---- Compositor process ------------------------------------------------- */
+
+struct PerfEntry {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+};
+
+struct PerfReport {
+	bool valid;
+	PerfEntry frame_cpu;
+	PerfEntry arrange;
+	PerfEntry borders;
+	PerfEntry workspace_switch;
+	PerfEntry map;
+	PerfEntry layout;
+	long peak_rss_kb;
+	uint64_t cpu_user_us;
+	uint64_t cpu_system_us;
+};
+
+PerfReport read_perf_report(const std::string &path) {
+	PerfReport report{};
+	FILE *file = std::fopen(path.c_str(), "r");
+	if (file == nullptr) {
+		return report;
+	}
+	char name[64];
+	unsigned long long a = 0;
+	unsigned long long b = 0;
+	unsigned long long c = 0;
+	char line[256];
+	while (std::fgets(line, sizeof(line), file) != nullptr) {
+		const int fields = std::sscanf(line, "%63s %llu %llu %llu", name, &a, &b, &c);
+		PerfEntry *entry = nullptr;
+		if (std::strcmp(name, "frame_cpu") == 0) {
+			entry = &report.frame_cpu;
+		} else if (std::strcmp(name, "arrange") == 0) {
+			entry = &report.arrange;
+		} else if (std::strcmp(name, "borders") == 0) {
+			entry = &report.borders;
+		} else if (std::strcmp(name, "workspace_switch") == 0) {
+			entry = &report.workspace_switch;
+		} else if (std::strcmp(name, "map") == 0) {
+			entry = &report.map;
+		} else if (std::strcmp(name, "layout") == 0) {
+			entry = &report.layout;
+		}
+		if (entry != nullptr && fields == 4) {
+			*entry = PerfEntry{a, b, c};
+		} else if (fields >= 2 && std::strcmp(name, "peak_rss_kb") == 0) {
+			report.peak_rss_kb = static_cast<long>(a);
+		} else if (fields >= 2 && std::strcmp(name, "cpu_user_us") == 0) {
+			report.cpu_user_us = a;
+		} else if (fields >= 2 && std::strcmp(name, "cpu_system_us") == 0) {
+			report.cpu_system_us = a;
+		}
+	}
+	std::fclose(file);
+	report.valid = true;
+	return report;
+}
+
+void set_env(std::vector<std::string> *env, const char *name, const std::string &value, bool keep) {
+	const std::string prefix = std::string(name) + "=";
+	for (auto &entry : *env) {
+		if (entry.rfind(prefix, 0) == 0) {
+			if (!keep) {
+				entry = prefix + value;
+			}
+			return;
+		}
+	}
+	env->push_back(prefix + value);
+}
+
+pid_t spawn_compositor(
+	const BenchOptions &options,
+	const std::string &socket,
+	const std::string &report_path) {
+	std::vector<std::string> env;
+	for (char **entry = environ; *entry != nullptr; ++entry) {
+		env.emplace_back(*entry);
+	}
+	set_env(&env, "WLR_BACKENDS", "headless", false);
+	set_env(&env, "WLR_HEADLESS_OUTPUTS", "1", false);
+	set_env(&env, "WLR_LIBINPUT_NO_DEVICES", "1", false);
+	/* Software rendering unless the caller asked for a GPU renderer. */
+	set_env(&env, "WLR_RENDERER", "pixman", true);
+	set_env(&env, "KRISTAL_SOCKET", socket, false);
+	set_env(&env, "KRISTAL_PERF_REPORT", report_path, false);
+	set_env(&env, "KRISTAL_CONFIG", "/dev/null", false);
+	set_env(&env, "KRISTAL_WINDOW_LAYOUT", options.layout, false);
+	if (!options.virtual_clock.empty()) {
+		set_env(&env, "KRISTAL_VIRTUAL_CLOCK", options.virtual_clock, false);
+	}
+	set_env(
+		&env,
+		"KRISTAL_BINDINGS",
+		"Alt+1=ws1;Alt+2=ws2;Alt+Tab=focus-next;Alt+Shift+Right=move-right;"
+		"Alt+Shift+Left=move-left;Alt+Ctrl+Right=resize-right;Alt+Ctrl+Left=resize-left",
+		false);
+
+	std::vector<char *> envp;
+	for (auto &entry : env) {
+		envp.push_back(entry.data());
+	}
+	envp.push_back(nullptr);
+
+	char *const argv[] = {const_cast<char *>(options.compositor.c_str()), nullptr};
+	pid_t pid = -1;
+	const int err = posix_spawnp(&pid, argv[0], nullptr, nullptr, argv, envp.data());
+	if (err != 0) {
+		std::fprintf(
+			stderr,
+			"kristal-bench: cannot start %s: %s\n",
+			argv[0],
+			std::strerror(err));
+		return -1;
+	}
+	return pid;
+}
+
+bool wait_for_exit(pid_t pid, int timeout_ms) {
+	const uint64_t deadline = now_ns() + static_cast<uint64_t>(timeout_ms) * 1000000ull;
+	while (now_ns() < deadline) {
+		int status = 0;
+		const pid_t result = waitpid(pid, &status, WNOHANG);
+		if (result == pid || (result < 0 && errno == ECHILD)) {
+			return true;
+		}
+		usleep(10000);
+	}
+	return false;
+}
+
+void stop_compositor(pid_t pid) {
+	kill(pid, SIGTERM);
+	if (!wait_for_exit(pid, 10000)) {
+		std::fprintf(stderr, "kristal-bench: compositor ignored SIGTERM, killing it\n");
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+	}
+}
+
+/* Generous descriptor limit for ourselves and, through inheritance, kristal. */
+void raise_fd_limit() {
+	rlimit limit{};
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+}
+
+/* ---- Scenario ----------------------------------------------------------- */
+
+double percentile_ms(std::vector<uint64_t> values, double percentile) {
+	if (values.empty()) {
+		return 0.0;
+	}
+	std::sort(values.begin(), values.end());
+	const size_t index = std::min(
+		values.size() - 1,
+		static_cast<size_t>(percentile * static_cast<double>(values.size() - 1) + 0.5));
+	return ns_to_ms(values[index]);
+}
+
+double mean_us(const PerfEntry &entry) {
+	return entry.count > 0
+		? static_cast<double>(entry.total_ns) / static_cast<double>(entry.count) / 1000.0
+		: 0.0;
+}
+
+struct BenchResult {
+	int windows;
+	int mapped;
+	double map_p50_ms;
+	double map_p95_ms;
+	double map_max_ms;
+	double switch_rtt_ms;
+	double close_ms;
+	uint64_t client_commits;
+	PerfReport report;
+};
+
+bool run_scenario(const BenchOptions &options, int count, BenchResult *result) {
+	*result = BenchResult{};
+	result->windows = count;
+
+	const std::string socket = "kristal-bench-" + std::to_string(getpid()) + "-" +
+		std::to_string(count);
+	char report_template[] = "/tmp/kristal-bench-report-XXXXXX";
+	const int report_fd = mkstemp(report_template);
+	if (report_fd < 0) {
+		std::fprintf(stderr, "kristal-bench: cannot create report file\n");
+		return false;
+	}
+	close(report_fd);
+	const std::string report_path = report_template;
+
+	const pid_t pid = spawn_compositor(options, socket, report_path);
+	if (pid < 0) {
+		unlink(report_path.c_str());
+		return false;
+	}
+
+	BenchDriver driver{};
+	const uint64_t startup_deadline =
+		now_ns() + static_cast<uint64_t>(kStartupTimeoutMs) * 1000000ull;
+	bool connected = false;
+	while (now_ns() < startup_deadline) {
+		if (waitpid(pid, nullptr, WNOHANG) == pid) {
+			std::fprintf(stderr, "kristal-bench: compositor exited during startup\n");
+			unlink(report_path.c_str());
+			return false;
+		}
+		wl_display *probe = wl_display_connect(socket.c_str());
+		if (probe != nullptr) {
+			wl_display_disconnect(probe);
+			connected = driver_connect(&driver, socket.c_str());
+			break;
+		}
+		usleep(10000);
+	}
+	if (!connected) {
+		std::fprintf(stderr, "kristal-bench: could not connect to %s\n", socket.c_str());
+		driver_disconnect(&driver);
+		stop_compositor(pid);
+		unlink(report_path.c_str());
+		return false;
+	}
+
+	BenchSession session{};
+	session.tick_interval_ns = options.fps > 0 ? 1000000000ull / options.fps : 0;
+
+	/* Map. */
+	for (int i = 0; i < count; ++i) {
+		BenchWindow *window = window_create(socket.c_str(), i);
+		if (window == nullptr) {
+			std::fprintf(stderr, "kristal-bench: client %d failed to connect\n", i);
+			break;
+		}
+		session.windows.push_back(window);
+	}
+	const uint64_t map_deadline = now_ns() + static_cast<uint64_t>(kMapTimeoutMs) * 1000000ull;
+	while (!all_mapped(session) && now_ns() < map_deadline) {
+		pump(&session, 100);
+	}
+	std::vector<uint64_t> map_latencies;
+	for (BenchWindow *window : session.windows) {
+		if (window->mapped) {
+			map_latencies.push_back(window->map_latency_ns);
+		}
+	}
+	result->mapped = static_cast<int>(map_latencies.size());
+	result->map_p50_ms = percentile_ms(map_latencies, 0.50);
+	result->map_p95_ms = percentile_ms(map_latencies, 0.95);
+	result->map_max_ms = percentile_ms(map_latencies, 1.0);
+
+	/* Steady-state commits. */
+	if (session.tick_interval_ns > 0) {
+		session.ticking = true;
+		session.next_tick_ns = now_ns();
+		pump_for(&session, options.steady_ms);
+	}
+
+	/* Client-driven state changes: fullscreen and maximize round trips. */
+	for (BenchWindow *window : session.windows) {
+		xdg_toplevel_set_fullscreen(window->toplevel, nullptr);
+	}
+	pump_for(&session, 250);
+	for (BenchWindow *window : session.windows) {
+		xdg_toplevel_unset_fullscreen(window->toplevel);
+		xdg_toplevel_set_maximized(window->toplevel);
+	}
+	pump_for(&session, 250);
+	for (BenchWindow *window : session.windows) {
+		xdg_toplevel_unset_maximized(window->toplevel);
+	}
+	pump_for(&session, 250);
+
+	/* Compositor-driven moves, resizes and focus changes. */
+	for (int i = 0; i < options.key_actions; ++i) {
+		driver_chord(&driver, driver.alt_mask | driver.shift_mask, i % 2 ? KEY_LEFT : KEY_RIGHT);
+		driver_chord(&driver, driver.alt_mask | driver.ctrl_mask, i % 2 ? KEY_LEFT : KEY_RIGHT);
+		driver_chord(&driver, driver.alt_mask, KEY_TAB);
+		pump(&session, 0);
+	}
+
+	/* Workspace switches away from and back to the populated workspace. */
+	uint64_t switch_total = 0;
+	for (int i = 0; i < options.switches; ++i) {
+		switch_total += driver_chord(&driver, driver.alt_mask, i % 2 ? KEY_1 : KEY_2);
+		pump(&session, 0);
+	}
+	driver_chord(&driver, driver.alt_mask, KEY_1);
+	result->switch_rtt_ms = options.switches > 0
+		? ns_to_ms(switch_total) / options.switches
+		: 0.0;
+	pump_for(&session, 100);
+
+	/* Close everything and wait until the compositor has processed it. */
+	session.ticking = false;
+	for (BenchWindow *window : session.windows) {
+		result->client_commits += window->commits;
+	}
+	const uint64_t close_start = now_ns();
+	for (BenchWindow *window : session.windows) {
+		window_destroy(window);
+	}
+	session.windows.clear();
+	wl_display_roundtrip(driver.display);
+	result->close_ms = ns_to_ms(now_ns() - close_start);
+
+	driver_disconnect(&driver);
+	stop_compositor(pid);
+	result->report = read_perf_report(report_path);
+	unlink(report_path.c_str());
+	return true;
+}
+
+void print_result(const BenchResult &result) {
+	const PerfReport &report = result.report;
+	std::printf("windows: %d (%d mapped)\n", result.windows, result.mapped);
+	std::printf(
+		"  map latency        p50 %.2f ms  p95 %.2f ms  max %.2f ms\n",
+		result.map_p50_ms,
+		result.map_p95_ms,
+		result.map_max_ms);
+	if (!report.valid) {
+		std::printf("  (no compositor perf report)\n");
+		return;
+	}
+	std::printf(
+		"  frame cpu          %.1f us/frame over %llu frames (%llu client commits)\n",
+		mean_us(report.frame_cpu),
+		static_cast<unsigned long long>(report.frame_cpu.count),
+		static_cast<unsigned long long>(result.client_commits));
+	std::printf(
+		"  arrange            mean %.1f us  max %.1f us  n=%llu\n",
+		mean_us(report.arrange),
+		static_cast<double>(report.arrange.max_ns) / 1000.0,
+		static_cast<unsigned long long>(report.arrange.count));
+	std::printf(
+		"    layout math      mean %.1f us  max %.1f us\n",
+		mean_us(report.layout),
+		static_cast<double>(report.layout.max_ns) / 1000.0);
+	std::printf(
+		"  borders            mean %.1f us  max %.1f us  n=%llu\n",
+		mean_us(report.borders),
+		static_cast<double>(report.borders.max_ns) / 1000.0,
+		static_cast<unsigned long long>(report.borders.count));
+	std::printf(
+		"  workspace switch   mean %.1f us  max %.1f us  (round trip %.2f ms)\n",
+		mean_us(report.workspace_switch),
+		static_cast<double>(report.workspace_switch.max_ns) / 1000.0,
+		result.switch_rtt_ms);
+	std::printf(
+		"  map handler        mean %.1f us  max %.1f us\n",
+		mean_us(report.map),
+		static_cast<double>(report.map.max_ns) / 1000.0);
+	std::printf("  close all          %.2f ms\n", result.close_ms);
+	std::printf(
+		"  compositor         peak RSS %.1f MiB  cpu %.1f ms user + %.1f ms system\n",
+		static_cast<double>(report.peak_rss_kb) / 1024.0,
+		static_cast<double>(report.cpu_user_us) / 1000.0,
+		static_cast<double>(report.cpu_system_us) / 1000.0);
+}
+
+std::vector<int> parse_counts(const char *value) {
+	std::vector<int> counts;
+	const char *cursor = value;
+	while (*cursor != '\0') {
+		char *end = nullptr;
+		const long count = std::strtol(cursor, &end, 10);
+		if (end == cursor || count <= 0) {
+			return {};
+		}
+		counts.push_back(static_cast<int>(count));
+		cursor = *end == ',' ? end + 1 : end;
+		if (*end != ',' && *end != '\0') {
+			return {};
+		}
+	}
+	return counts;
+}
+
+void usage(const char *prog) {
+	std::printf(
+		"Usage: %s [-c compositor] [-n 10,100,1000] [-f fps] [-d steady_ms]\n"
+		"          [-k key_actions] [-w workspace_switches] [-l layout]\n"
+		"          [-v max|refresh_hz]\n",
+		prog);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	BenchOptions options;
+	int c;
+	while ((c = getopt(argc, argv, "c:n:f:d:k:w:l:v:h")) != -1) {
+		switch (c) {
+		case 'c':
+			options.compositor = optarg;
+			break;
+		case 'n':
+			options.counts = parse_counts(optarg);
+			if (options.counts.empty()) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'f':
+			options.fps = std::max(0, std::atoi(optarg));
+			break;
+		case 'd':
+			options.steady_ms = std::max(0, std::atoi(optarg));
+			break;
+		case 'k':
+			options.key_actions = std::max(0, std::atoi(optarg));
+			break;
+		case 'w':
+			options.switches = std::max(0, std::atoi(optarg));
+			break;
+		case 'l':
+			options.layout = optarg;
+			break;
+		case 'v':
+			options.virtual_clock = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	raise_fd_limit();
+
+	bool ok = true;
+	for (int count : options.counts) {
+		BenchResult result{};
+		if (!run_scenario(options, count, &result)) {
+			ok = false;
+			continue;
+		}
+		print_result(result);
+		std::fflush(stdout);
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,314 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
+#include "core/internal.h"
+
+namespace {
+
+constexpr long kCgroup2SuperMagic = 0x63677270;
+constexpr int kDefaultCpuWeight = 100;
+
+int parse_weight(const char *name, int fallback) {
+	const char *value = getenv(name);
+	if (value == nullptr || value[0] == '\0') {
+		return fallback;
+	}
+	char *end = nullptr;
+	errno = 0;
+	const long weight = strtol(value, &end, 10);
+	if (errno != 0 || end == value || (end != nullptr && *end != '\0') ||
+		weight < 1 || weight > 10000) {
+		wlr_log(
+			WLR_ERROR,
+			"Ignoring invalid %s='%s'; expected cpu.weight in 1..10000",
+			name,
+			value);
+		return fallback;
+	}
+	return static_cast<int>(weight);
+}
+
+bool write_cgroup_file(const char *dir, const char *name, const char *value) {
+	char path[600];
+	std::snprintf(path, sizeof(path), "%s/%s", dir, name);
+	const int fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	const size_t len = std::strlen(value);
+	const bool ok = write(fd, value, len) == static_cast<ssize_t>(len);
+	const int saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+	return ok;
+}
+
+bool read_cgroup_file(const char *dir, const char *name, char *out, size_t out_len) {
+	char path[600];
+	std::snprintf(path, sizeof(path), "%s/%s", dir, name);
+	FILE *file = std::fopen(path, "r");
+	if (file == nullptr) {
+		return false;
+	}
+	const bool ok = std::fgets(out, static_cast<int>(out_len), file) != nullptr;
+	std::fclose(file);
+	return ok;
+}
+
+bool controller_listed(const char *list, const char *controller) {
+	const size_t len = std::strlen(controller);
+	const char *pos = list;
+	while ((pos = std::strstr(pos, controller)) != nullptr) {
+		const bool starts = pos == list || pos[-1] == ' ';
+		const bool ends = pos[len] == '\0' || pos[len] == ' ' || pos[len] == '\n';
+		if (starts && ends) {
+			return true;
+		}
+		pos += len;
+	}
+	return false;
+}
+
+void set_process_weight(KristalProcess *process, int weight) {
+	if (process->cgroup_path[0] == '\0' || process->cpu_weight == weight) {
+		return;
+	}
+	char value[16];
+	std::snprintf(value, sizeof(value), "%d", weight);
+	if (write_cgroup_file(process->cgroup_path, "cpu.weight", value)) {
+		process->cpu_weight = weight;
+	}
+}
+
+/* cgroup v2 only hands controllers down from a cgroup with no processes of
+ * its own, and a delegated root usually holds the compositor itself. The
+ * compositor then moves into a leaf of its own; anything else living in
+ * the root keeps the controller off, since those processes are not ours
+ * to move. */
+bool enable_cpu_controller(const char *root) {
+	if (write_cgroup_file(root, "cgroup.subtree_control", "+cpu")) {
+		return true;
+	}
+	if (errno != EBUSY) {
+		return false;
+	}
+	char leaf[600];
+	std::snprintf(leaf, sizeof(leaf), "%s/kristal-compositor.scope", root);
+	char pid[16];
+	std::snprintf(pid, sizeof(pid), "%d", static_cast<int>(getpid()));
+	if ((mkdir(leaf, 0755) != 0 && errno != EEXIST) || !write_cgroup_file(leaf, "cgroup.procs", pid)) {
+		wlr_log(WLR_ERROR, "cannot move the compositor out of %s: %s", root, std::strerror(errno));
+		return false;
+	}
+	if (write_cgroup_file(root, "cgroup.subtree_control", "+cpu")) {
+		return true;
+	}
+	wlr_log(
+		WLR_ERROR,
+		"%s still holds processes other than the compositor; point KRISTAL_CGROUP_ROOT at a cgroup of its own",
+		root);
+	return false;
+}
+
+} // namespace
+
+void server_cgroup_init(KristalServer *server) {
+	server->cgroup_enabled = false;
+	server->cgroup_weights_enabled = false;
+	server->cgroup_root[0] = '\0';
+
+	const char *root = getenv("KRISTAL_CGROUP_ROOT");
+	if (root == nullptr || root[0] == '\0') {
+		return;
+	}
+	if (std::strlen(root) >= sizeof(server->cgroup_root) - 64) {
+		wlr_log(WLR_ERROR, "KRISTAL_CGROUP_ROOT is too long; cgroup scopes disabled");
+		return;
+	}
+
+	struct statfs fs{};
+	if (statfs(root, &fs) != 0 || fs.f_type != kCgroup2SuperMagic) {
+		wlr_log(
+			WLR_ERROR,
+			"KRISTAL_CGROUP_ROOT=%s is not a cgroup v2 directory; cgroup scopes disabled",
+			root);
+		return;
+	}
+	if (access(root, W_OK) != 0) {
+		wlr_log(
+			WLR_ERROR,
+			"KRISTAL_CGROUP_ROOT=%s is not writable (is it delegated?); cgroup scopes disabled",
+			root);
+		return;
+	}
+
+	std::snprintf(server->cgroup_root, sizeof(server->cgroup_root), "%s", root);
+	server->cgroup_enabled = true;
+
+	char controllers[256];
+	if (read_cgroup_file(root, "cgroup.controllers", controllers, sizeof(controllers)) &&
+		controller_listed(controllers, "cpu")) {
+		char enabled[256];
+		const bool already = read_cgroup_file(
+				root,
+				"cgroup.subtree_control",
+				enabled,
+				sizeof(enabled)) &&
+			controller_listed(enabled, "cpu");
+		server->cgroup_weights_enabled = already || enable_cpu_controller(root);
+	}
+	if (!server->cgroup_weights_enabled) {
+		wlr_log(
+			WLR_ERROR,
+			"cpu controller unavailable under %s; clients get scopes but no focus weights",
+			root);
+	}
+
+	server->cgroup_focused_weight = parse_weight("KRISTAL_CGROUP_FOCUSED_WEIGHT", 400);
+	server->cgroup_visible_weight = parse_weight("KRISTAL_CGROUP_VISIBLE_WEIGHT", 200);
+	server->cgroup_hidden_weight = parse_weight("KRISTAL_CGROUP_HIDDEN_WEIGHT", 25);
+	wlr_log(WLR_INFO, "Client cgroup root: %s", server->cgroup_root);
+}
+
+/* Scopes are created before the launch is spawned, so the launch shell can
+ * join its scope before it runs anything that might fork. They are named
+ * by launch rather than by pid, which is not known yet. */
+bool server_cgroup_create_scope(KristalServer *server, char *path, size_t path_len) {
+	path[0] = '\0';
+	if (!server->cgroup_enabled) {
+		return false;
+	}
+	static unsigned launch_seq = 0;
+	for (int attempt = 0; attempt < 64; ++attempt) {
+		std::snprintf(
+			path,
+			path_len,
+			"%s/kristal-%d-%u.scope",
+			server->cgroup_root,
+			static_cast<int>(getpid()),
+			++launch_seq);
+		if (mkdir(path, 0755) == 0) {
+			return true;
+		}
+		if (errno != EEXIST) {
+			break;
+		}
+	}
+	wlr_log(WLR_DEBUG, "failed to create %s: %s", path, std::strerror(errno));
+	path[0] = '\0';
+	return false;
+}
+
+void server_cgroup_remove_scope(const char *path) {
+	if (path[0] != '\0') {
+		rmdir(path);
+	}
+}
+
+void server_cgroup_attach(KristalProcess *process, const char *scope) {
+	process->cpu_weight = kDefaultCpuWeight;
+	std::snprintf(process->cgroup_path, sizeof(process->cgroup_path), "%s", scope);
+}
+
+bool server_cgroup_release(KristalProcess *process) {
+	if (process->cgroup_path[0] == '\0') {
+		return true;
+	}
+	/* The scope stays busy while anything the launch forked is still alive. */
+	if (rmdir(process->cgroup_path) != 0 && errno != ENOENT) {
+		return false;
+	}
+	process->cgroup_path[0] = '\0';
+	return true;
+}
+
+KristalProcess *server_cgroup_find_process(KristalServer *server, pid_t pid) {
+	if (!server->cgroup_enabled || pid <= 0) {
+		return nullptr;
+	}
+
+	char path[64];
+	std::snprintf(path, sizeof(path), "/proc/%d/cgroup", static_cast<int>(pid));
+	FILE *file = std::fopen(path, "r");
+	if (file == nullptr) {
+		return nullptr;
+	}
+	char line[512];
+	char member[512] = {};
+	while (std::fgets(line, sizeof(line), file) != nullptr) {
+		if (std::strncmp(line, "0::", 3) == 0) {
+			std::snprintf(member, sizeof(member), "%s", line + 3);
+			member[std::strcspn(member, "\n")] = '\0';
+			break;
+		}
+	}
+	std::fclose(file);
+	if (member[0] == '\0') {
+		return nullptr;
+	}
+
+	/* /proc reports the path relative to the cgroup2 mount. */
+	const size_t member_len = std::strlen(member);
+	KristalProcess *process = nullptr;
+	wl_list_for_each(process, &server->processes, link) {
+		const size_t path_len = std::strlen(process->cgroup_path);
+		if (path_len >= member_len &&
+			std::strcmp(process->cgroup_path + path_len - member_len, member) == 0) {
+			return process;
+		}
+	}
+	return nullptr;
+}
+
+/*
+ * Weights follow focus: the focused client's scope gets the focused weight,
+ * clients with a window on the current workspace get the visible weight and
+ * clients that only have windows on hidden workspaces are deprioritized.
+ */
+void server_cgroup_update_weights(KristalServer *server) {
+	if (server == nullptr || !server->cgroup_enabled) {
+		return;
+	}
+	server->cgroup_weights_dirty = false;
+
+	KristalProcess *process = nullptr;
+	KristalProcess *tmp = nullptr;
+	wl_list_for_each_safe(process, tmp, &server->processes, link) {
+		if (process->exited && server_cgroup_release(process)) {
+			server_launcher_destroy_process(process);
+			continue;
+		}
+		process->pending_weight = 0;
+	}
+	if (!server->cgroup_weights_enabled) {
+		return;
+	}
+
+	KristalView *view = nullptr;
+	wl_list_for_each(view, &server->views, link) {
+		if (!view->mapped || view->process == nullptr) {
+			continue;
+		}
+		int weight = server->cgroup_hidden_weight;
+		if (!server->session_locked && server_view_surface(view) == server->focused_surface) {
+			weight = server->cgroup_focused_weight;
+		} else if (server_view_is_shown(view) && !view->suspended) {
+			weight = server->cgroup_visible_weight;
+		}
+		if (weight > view->process->pending_weight) {
+			view->process->pending_weight = weight;
+		}
+	}
+
+	wl_list_for_each(process, &server->processes, link) {
+		set_process_weight(
+			process,
+			process->pending_weight > 0 ? process->pending_weight : kDefaultCpuWeight);
+	}
+}
@@ -0,0 +1,479 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <wlr/types/wlr_buffer.h>
+
+#include "core/internal.h"
+
+/*
+ * Per-client resource accounting and limits.
+ *
+ * Every wl_surface is followed from creation to destruction, so each client
+ * record knows its surfaces, subsurfaces and popups, the bytes held by its
+ * current buffers, how many commits needed a texture upload and its commit
+ * rate. Records are listed in the SIGUSR1 dump and the metrics export.
+ *
+ * Optional limits (KRISTAL_CLIENT_MAX_SURFACES, KRISTAL_CLIENT_MAX_BUFFER_MB,
+ * KRISTAL_CLIENT_MAX_COMMIT_RATE) are enforced with
+ * KRISTAL_CLIENT_LIMIT_ACTION: "disconnect" (default) posts a protocol error,
+ * "throttle" limits the client's frame callbacks to KRISTAL_CLIENT_THROTTLE_HZ
+ * while it stays over the limit. A surface-count violation always
+ * disconnects, since throttling cannot undo it.
+ */
+
+namespace {
+
+constexpr uint64_t kRateWindowNs = 1000000000ull;
+constexpr long kDefaultThrottleHz = 10;
+
+enum SurfaceKind {
+	SURFACE_KIND_UNKNOWN,
+	SURFACE_KIND_SUBSURFACE,
+	SURFACE_KIND_POPUP,
+	SURFACE_KIND_OTHER,
+};
+
+struct TrackedSurface {
+	List link;
+	KristalClient *client;
+	Surface *surface;
+	enum SurfaceKind kind;
+	uint64_t buffer_bytes;
+	Listener commit;
+	Listener destroy;
+};
+
+struct ClientLimits {
+	uint32_t max_surfaces;
+	uint64_t max_buffer_bytes;
+	double max_commit_rate;
+	bool throttle;
+	uint64_t throttle_interval_ns;
+	uint32_t throttled_clients;
+};
+
+ClientLimits limits{};
+
+/* Outputs only produce frames on damage, so a throttled client whose slot
+ * opens on an idle screen would wait for unrelated damage. This timer asks
+ * for a frame when the earliest pending slot opens. */
+struct ThrottleWake {
+	KristalServer *server;
+	wl_event_source *timer;
+	uint64_t due_ns;
+};
+
+ThrottleWake wake{};
+
+int throttle_wake_tick(void * /*data*/) {
+	wake.due_ns = 0;
+	KristalOutput *output = nullptr;
+	wl_list_for_each(output, &wake.server->outputs, link) {
+		if (output->wlr_output->enabled) {
+			wlr_output_schedule_frame(output->wlr_output);
+		}
+	}
+	return 0;
+}
+
+void arm_throttle_wake(uint64_t due_ns, uint64_t now_ns) {
+	if (wake.timer == nullptr || (wake.due_ns != 0 && wake.due_ns <= due_ns)) {
+		return;
+	}
+	wake.due_ns = due_ns;
+	const uint64_t delay_ms = (due_ns - now_ns + 999999ull) / 1000000ull;
+	wl_event_source_timer_update(wake.timer, static_cast<int>(std::max<uint64_t>(delay_ms, 1)));
+}
+
+bool parse_limit(const char *name, long *out) {
+	const char *value = getenv(name);
+	if (value == nullptr || value[0] == '\0' || strcmp(value, "0") == 0) {
+		return false;
+	}
+	char *end = nullptr;
+	errno = 0;
+	const long parsed = strtol(value, &end, 10);
+	if (errno != 0 || end == value || (end != nullptr && *end != '\0') || parsed <= 0) {
+		wlr_log(WLR_ERROR, "Ignoring invalid %s='%s'; expected a positive integer", name, value);
+		return false;
+	}
+	*out = parsed;
+	return true;
+}
+
+void load_limits() {
+	long value = 0;
+	if (parse_limit("KRISTAL_CLIENT_MAX_SURFACES", &value)) {
+		limits.max_surfaces = static_cast<uint32_t>(value);
+	}
+	if (parse_limit("KRISTAL_CLIENT_MAX_BUFFER_MB", &value)) {
+		limits.max_buffer_bytes = static_cast<uint64_t>(value) * 1024ull * 1024ull;
+	}
+	if (parse_limit("KRISTAL_CLIENT_MAX_COMMIT_RATE", &value)) {
+		limits.max_commit_rate = static_cast<double>(value);
+	}
+	long throttle_hz = kDefaultThrottleHz;
+	parse_limit("KRISTAL_CLIENT_THROTTLE_HZ", &throttle_hz);
+	limits.throttle_interval_ns = 1000000000ull / static_cast<uint64_t>(throttle_hz);
+
+	const char *action = getenv("KRISTAL_CLIENT_LIMIT_ACTION");
+	if (action != nullptr && action[0] != '\0') {
+		if (strcmp(action, "throttle") == 0) {
+			limits.throttle = true;
+		} else if (strcmp(action, "disconnect") != 0) {
+			wlr_log(
+				WLR_ERROR,
+				"Ignoring invalid KRISTAL_CLIENT_LIMIT_ACTION='%s'; expected disconnect or throttle",
+				action);
+		}
+	}
+}
+
+void client_destroy(Listener *listener, void * /*data*/) {
+	KristalClient *client = wl_container_of(listener, client, destroy);
+	/* libwayland tears down a client's resources after its destroy
+	 * signal, so surfaces can outlive the record by a moment. */
+	TrackedSurface *tracked = nullptr;
+	TrackedSurface *tmp = nullptr;
+	wl_list_for_each_safe(tracked, tmp, &client->tracked_surfaces, link) {
+		wl_list_remove(&tracked->link);
+		wl_list_init(&tracked->link);
+		tracked->client = nullptr;
+	}
+	if (client->throttled) {
+		limits.throttled_clients--;
+	}
+	wl_list_remove(&client->destroy.link);
+	wl_list_remove(&client->link);
+	client->server->client_count--;
+	delete client;
+}
+
+KristalClient *client_lookup(wl_client *client) {
+	Listener *listener = wl_client_get_destroy_listener(client, client_destroy);
+	if (listener == nullptr) {
+		return nullptr;
+	}
+	KristalClient *record = wl_container_of(listener, record, destroy);
+	return record;
+}
+
+KristalClient *client_for(KristalServer *server, wl_client *client) {
+	if (KristalClient *record = client_lookup(client)) {
+		return record;
+	}
+	auto *record = new KristalClient{};
+	record->server = server;
+	record->client = client;
+	record->destroy.notify = client_destroy;
+	wl_client_add_destroy_listener(client, &record->destroy);
+	wl_list_init(&record->tracked_surfaces);
+	wl_client_get_credentials(client, &record->pid, nullptr, nullptr);
+	std::snprintf(record->comm, sizeof(record->comm), "?");
+	char path[64];
+	std::snprintf(path, sizeof(path), "/proc/%d/comm", static_cast<int>(record->pid));
+	FILE *file = std::fopen(path, "re");
+	if (file != nullptr) {
+		if (std::fgets(record->comm, sizeof(record->comm), file) != nullptr) {
+			record->comm[std::strcspn(record->comm, "\n")] = '\0';
+		}
+		std::fclose(file);
+	}
+	record->rate_start_ns = kristal_now_ns();
+	wl_list_insert(&server->clients, &record->link);
+	server->client_count++;
+	return record;
+}
+
+/* The record is made when the client connects, so reading its name from
+ * /proc stays off the commit and frame paths. */
+void handle_new_client(Listener *listener, void *data) {
+	KristalServer *server = wl_container_of(listener, server, new_client);
+	client_for(server, static_cast<wl_client *>(data));
+}
+
+void disconnect(KristalClient *client, const char *what) {
+	if (client->disconnecting) {
+		return;
+	}
+	client->disconnecting = true;
+	wlr_log(
+		WLR_ERROR,
+		"Disconnecting client %s[%d]: %s limit exceeded",
+		client->comm,
+		static_cast<int>(client->pid),
+		what);
+	/* Posting the error defers the disconnect until the current request
+	 * has been dispatched, so the surface being committed stays valid. */
+	wl_client_post_implementation_error(client->client, "%s limit exceeded", what);
+}
+
+void set_throttled(KristalClient *client, bool throttled, const char *what) {
+	if (client->throttled == throttled) {
+		return;
+	}
+	client->throttled = throttled;
+	if (throttled) {
+		limits.throttled_clients++;
+		client->throttle_next_ns = 0;
+		wlr_log(
+			WLR_ERROR,
+			"Throttling client %s[%d]: %s limit exceeded",
+			client->comm,
+			static_cast<int>(client->pid),
+			what);
+	} else {
+		limits.throttled_clients--;
+		wlr_log(WLR_INFO, "Client %s[%d] back under its limits", client->comm, static_cast<int>(client->pid));
+	}
+}
+
+void enforce_limits(KristalClient *client) {
+	const char *what = nullptr;
+	if (limits.max_buffer_bytes != 0 && client->buffer_bytes > limits.max_buffer_bytes) {
+		what = "buffer memory";
+	} else if (limits.max_commit_rate > 0.0 && client->commit_rate > limits.max_commit_rate) {
+		what = "commit rate";
+	}
+	if (limits.throttle) {
+		set_throttled(client, what != nullptr, what);
+	} else if (what != nullptr) {
+		disconnect(client, what);
+	}
+}
+
+void update_commit_rate(KristalClient *client, uint64_t now) {
+	const uint64_t elapsed = now - client->rate_start_ns;
+	if (elapsed < kRateWindowNs) {
+		return;
+	}
+	client->commit_rate = static_cast<double>(client->commits - client->rate_commits) * 1e9 /
+		static_cast<double>(elapsed);
+	client->rate_commits = client->commits;
+	client->rate_start_ns = now;
+}
+
+enum SurfaceKind classify(Surface *surface) {
+	if (wlr_subsurface_try_from_wlr_surface(surface) != nullptr) {
+		return SURFACE_KIND_SUBSURFACE;
+	}
+	if (wlr_xdg_popup_try_from_wlr_surface(surface) != nullptr) {
+		return SURFACE_KIND_POPUP;
+	}
+	return SURFACE_KIND_OTHER;
+}
+
+/* The texture wlroots keeps for the surface's current buffer. */
+uint64_t surface_buffer_bytes(Surface *surface) {
+	if (surface->buffer == nullptr) {
+		return 0;
+	}
+	return static_cast<uint64_t>(surface->buffer->base.width) *
+		static_cast<uint64_t>(surface->buffer->base.height) * 4ull;
+}
+
+bool surface_buffer_is_dmabuf(Surface *surface) {
+	wlr_dmabuf_attributes attribs{};
+	return surface->buffer != nullptr && surface->buffer->source != nullptr &&
+		wlr_buffer_get_dmabuf(surface->buffer->source, &attribs);
+}
+
+void tracked_surface_commit(Listener *listener, void * /*data*/) {
+	TrackedSurface *tracked = wl_container_of(listener, tracked, commit);
+	KristalClient *client = tracked->client;
+	Surface *surface = tracked->surface;
+	if (client == nullptr) {
+		return;
+	}
+	const uint64_t damage = kristal_region_area(&surface->buffer_damage);
+	client->commits++;
+	client->damage_pixels += damage;
+
+	if (tracked->kind == SURFACE_KIND_UNKNOWN && surface->role != nullptr) {
+		tracked->kind = classify(surface);
+		if (tracked->kind == SURFACE_KIND_SUBSURFACE) {
+			client->subsurfaces++;
+		} else if (tracked->kind == SURFACE_KIND_POPUP) {
+			client->popups++;
+		}
+	}
+
+	if ((surface->current.committed & WLR_SURFACE_STATE_BUFFER) != 0) {
+		const uint64_t bytes = surface_buffer_bytes(surface);
+		client->buffer_bytes = client->buffer_bytes - tracked->buffer_bytes + bytes;
+		tracked->buffer_bytes = bytes;
+		if (bytes != 0 && !surface_buffer_is_dmabuf(surface)) {
+			client->texture_uploads++;
+			client->upload_pixels += damage;
+		}
+	}
+
+	update_commit_rate(client, kristal_now_ns());
+	enforce_limits(client);
+}
+
+void tracked_surface_destroy(Listener *listener, void * /*data*/) {
+	TrackedSurface *tracked = wl_container_of(listener, tracked, destroy);
+	if (KristalClient *client = tracked->client) {
+		client->surfaces--;
+		if (tracked->kind == SURFACE_KIND_SUBSURFACE) {
+			client->subsurfaces--;
+		} else if (tracked->kind == SURFACE_KIND_POPUP) {
+			client->popups--;
+		}
+		client->buffer_bytes -= tracked->buffer_bytes;
+	}
+	wl_list_remove(&tracked->link);
+	wl_list_remove(&tracked->commit.link);
+	wl_list_remove(&tracked->destroy.link);
+	delete tracked;
+}
+
+void server_new_surface(Listener *listener, void *data) {
+	KristalServer *server = wl_container_of(listener, server, new_surface);
+	auto *surface = static_cast<Surface *>(data);
+	KristalClient *client = client_for(server, wl_resource_get_client(surface->resource));
+
+	auto *tracked = new TrackedSurface{};
+	tracked->client = client;
+	tracked->surface = surface;
+	wl_list_insert(&client->tracked_surfaces, &tracked->link);
+	tracked->commit.notify = KRISTAL_PROFILED(tracked_surface_commit);
+	wl_signal_add(&surface->events.commit, &tracked->commit);
+	tracked->destroy.notify = KRISTAL_PROFILED(tracked_surface_destroy);
+	wl_signal_add(&surface->events.destroy, &tracked->destroy);
+
+	client->surfaces++;
+	if (limits.max_surfaces != 0 && client->surfaces > limits.max_surfaces) {
+		disconnect(client, "surface count");
+	}
+}
+
+void log_client(const KristalClient *client) {
+	wlr_log(
+		WLR_INFO,
+		"Clients:   %s[%d]: %u surfaces (%u sub, %u popup), %.1f MiB buffers, "
+		"%llu commits (%.1f/s), %llu uploads%s",
+		client->comm,
+		static_cast<int>(client->pid),
+		client->surfaces,
+		client->subsurfaces,
+		client->popups,
+		static_cast<double>(client->buffer_bytes) / (1024.0 * 1024.0),
+		static_cast<unsigned long long>(client->commits),
+		client->commit_rate,
+		static_cast<unsigned long long>(client->texture_uploads),
+		client->throttled ? ", throttled" : "");
+}
+
+std::vector<KristalClient *> ranked_clients(KristalServer *server, bool (*before)(const KristalClient *, const KristalClient *)) {
+	std::vector<KristalClient *> ranked;
+	ranked.reserve(server->client_count);
+	KristalClient *client = nullptr;
+	wl_list_for_each(client, &server->clients, link) {
+		ranked.push_back(client);
+	}
+	std::sort(ranked.begin(), ranked.end(), before);
+	return ranked;
+}
+
+} // namespace
+
+void server_clients_init(KristalServer *server) {
+	wl_list_init(&server->clients);
+	server->client_count = 0;
+	load_limits();
+	server->new_client.notify = KRISTAL_PROFILED(handle_new_client);
+	wl_display_add_client_created_listener(server->display, &server->new_client);
+	wake.server = server;
+	if (limits.throttle) {
+		wake.timer = wl_event_loop_add_timer(
+			wl_display_get_event_loop(server->display),
+			throttle_wake_tick,
+			nullptr);
+	}
+	server->new_surface.notify = KRISTAL_PROFILED(server_new_surface);
+	wl_signal_add(&server->compositor->events.new_surface, &server->new_surface);
+}
+
+KristalClient *server_client_from_surface(Surface *surface) {
+	if (surface == nullptr || surface->resource == nullptr) {
+		return nullptr;
+	}
+	return client_lookup(wl_resource_get_client(surface->resource));
+}
+
+void server_client_configured(Surface *surface) {
+	if (KristalClient *client = server_client_from_surface(surface)) {
+		client->configures++;
+	}
+}
+
+double server_client_commit_rate(KristalClient *client) {
+	/* A client that stopped committing never closes its rate window. */
+	const uint64_t now = kristal_now_ns();
+	if (now - client->rate_start_ns >= 2 * kRateWindowNs) {
+		update_commit_rate(client, now);
+	}
+	return client->commit_rate;
+}
+
+void server_clients_finish(KristalServer *server) {
+	wl_list_remove(&server->new_client.link);
+	if (wake.timer != nullptr) {
+		wl_event_source_remove(wake.timer);
+		wake.timer = nullptr;
+	}
+}
+
+bool server_clients_any_throttled(void) {
+	return limits.throttled_clients != 0;
+}
+
+/* Frame callbacks for a throttled client go out at most once per throttle
+ * interval; every surface of the client shares the same slot. */
+bool server_client_frame_due(Surface *surface, uint64_t now_ns) {
+	KristalClient *client = server_client_from_surface(surface);
+	if (client == nullptr || !client->throttled) {
+		return true;
+	}
+	if (client->throttle_sent_ns == now_ns) {
+		return true;
+	}
+	if (now_ns < client->throttle_next_ns) {
+		arm_throttle_wake(client->throttle_next_ns, now_ns);
+		return false;
+	}
+	client->throttle_sent_ns = now_ns;
+	client->throttle_next_ns = now_ns + limits.throttle_interval_ns;
+	return true;
+}
+
+void server_clients_dump(KristalServer *server) {
+	wlr_log(WLR_INFO, "Clients: %zu connected, by buffer memory", server->client_count);
+	const auto ranked = ranked_clients(server, [](const KristalClient *a, const KristalClient *b) {
+		return a->buffer_bytes > b->buffer_bytes;
+	});
+	for (const KristalClient *client : ranked) {
+		log_client(client);
+	}
+}
+
+void server_clients_log_damage_ranking(KristalServer *server, size_t limit) {
+	const auto ranked = ranked_clients(server, [](const KristalClient *a, const KristalClient *b) {
+		return a->damage_pixels > b->damage_pixels;
+	});
+	for (size_t i = 0; i < ranked.size() && i < limit; ++i) {
+		wlr_log(
+			WLR_INFO,
+			"Damage:   client %s[%d]: %llu px over %llu commits",
+			ranked[i]->comm,
+			static_cast<int>(ranked[i]->pid),
+			static_cast<unsigned long long>(ranked[i]->damage_pixels),
+			static_cast<unsigned long long>(ranked[i]->commits));
+	}
+}
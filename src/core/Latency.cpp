@@ -0,0 +1,355 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "core/internal.h"
+
+/*
+ * Input-to-photon latency tracer.
+ *
+ * One sample is in flight at a time: an input event delivered to a client
+ * surface starts it, the next commit of that surface advances it and the next
+ * present of an output showing the surface completes it. Input that arrives
+ * while a sample is in flight is not traced, which keeps the per-event cost to
+ * a flag check and bounds the work to one surface listener.
+ */
+
+namespace {
+
+constexpr int kHistogramBuckets = 24;
+constexpr uint64_t kSampleTimeoutNs = 1000000000ull;
+constexpr size_t kMaxClients = 64;
+
+struct LatencyHistogram {
+	/* Bucket i counts samples in [2^i, 2^(i+1)) microseconds. */
+	uint32_t buckets[kHistogramBuckets];
+	uint32_t count;
+	uint64_t sum_us;
+	uint64_t max_us;
+};
+
+struct ClientLatency {
+	List link;
+	wl_client *client;
+	Listener client_destroy;
+	pid_t pid;
+	char name[32];
+	LatencyHistogram input_to_commit;
+	LatencyHistogram commit_to_present;
+	LatencyHistogram input_to_present;
+};
+
+enum SampleStage {
+	SAMPLE_IDLE,
+	SAMPLE_AWAIT_COMMIT,
+	SAMPLE_AWAIT_PRESENT,
+};
+
+struct LatencyTracer {
+	bool enabled;
+	KristalServer *server;
+	enum SampleStage stage;
+	uint64_t input_ns;
+	uint64_t commit_ns;
+	Surface *surface;
+	ClientLatency *client;
+	Listener surface_commit;
+	Listener surface_destroy;
+	LatencyHistogram input_to_dispatch;
+	uint32_t dropped;
+	List clients;
+	size_t client_count;
+};
+
+LatencyTracer tracer{};
+
+void histogram_add(LatencyHistogram *histogram, uint64_t ns) {
+	const uint64_t us = ns / 1000u;
+	int bucket = 0;
+	while (bucket + 1 < kHistogramBuckets && (us >> (bucket + 1)) != 0) {
+		++bucket;
+	}
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->sum_us += us;
+	if (us > histogram->max_us) {
+		histogram->max_us = us;
+	}
+}
+
+/* Upper bound of the bucket holding the given percentile, in milliseconds. */
+double histogram_percentile_ms(const LatencyHistogram *histogram, double percentile) {
+	if (histogram->count == 0) {
+		return 0.0;
+	}
+	const double target = percentile * static_cast<double>(histogram->count);
+	uint32_t seen = 0;
+	for (int i = 0; i < kHistogramBuckets; ++i) {
+		seen += histogram->buckets[i];
+		if (static_cast<double>(seen) >= target) {
+			return static_cast<double>(1ull << (i + 1)) / 1000.0;
+		}
+	}
+	return static_cast<double>(histogram->max_us) / 1000.0;
+}
+
+void log_histogram(const char *who, const char *stage, const LatencyHistogram *histogram) {
+	if (histogram->count == 0) {
+		return;
+	}
+	wlr_log(
+		WLR_INFO,
+		"latency: %s %s: n=%u mean=%.2fms p50<=%.2fms p90<=%.2fms p99<=%.2fms max=%.2fms",
+		who,
+		stage,
+		histogram->count,
+		static_cast<double>(histogram->sum_us) / histogram->count / 1000.0,
+		histogram_percentile_ms(histogram, 0.50),
+		histogram_percentile_ms(histogram, 0.90),
+		histogram_percentile_ms(histogram, 0.99),
+		static_cast<double>(histogram->max_us) / 1000.0);
+}
+
+void reset_sample() {
+	if (tracer.surface != nullptr) {
+		wl_list_remove(&tracer.surface_commit.link);
+		wl_list_remove(&tracer.surface_destroy.link);
+		tracer.surface = nullptr;
+	}
+	tracer.client = nullptr;
+	tracer.stage = SAMPLE_IDLE;
+	KristalOutput *output = nullptr;
+	wl_list_for_each(output, &tracer.server->outputs, link) {
+		output->latency_armed = false;
+	}
+}
+
+void client_latency_destroy(Listener *listener, void * /*data*/) {
+	ClientLatency *record = wl_container_of(listener, record, client_destroy);
+	/* Keep the histograms for the dump; only forget the client pointer so a
+	 * new client at the same address gets its own record. */
+	wl_list_remove(&record->client_destroy.link);
+	record->client = nullptr;
+	if (tracer.client == record) {
+		reset_sample();
+	}
+}
+
+void evict_oldest_exited_client() {
+	ClientLatency *record = nullptr;
+	wl_list_for_each_reverse(record, &tracer.clients, link) {
+		if (record->client == nullptr) {
+			wl_list_remove(&record->link);
+			delete record;
+			tracer.client_count--;
+			return;
+		}
+	}
+}
+
+ClientLatency *client_latency_for(wl_client *client) {
+	ClientLatency *record = nullptr;
+	wl_list_for_each(record, &tracer.clients, link) {
+		if (record->client == client) {
+			return record;
+		}
+	}
+	if (tracer.client_count >= kMaxClients) {
+		evict_oldest_exited_client();
+		if (tracer.client_count >= kMaxClients) {
+			return nullptr;
+		}
+	}
+
+	record = new ClientLatency{};
+	record->client = client;
+	record->client_destroy.notify = client_latency_destroy;
+	wl_client_add_destroy_listener(client, &record->client_destroy);
+	wl_client_get_credentials(client, &record->pid, nullptr, nullptr);
+	std::snprintf(record->name, sizeof(record->name), "?");
+
+	char path[64];
+	std::snprintf(path, sizeof(path), "/proc/%d/comm", static_cast<int>(record->pid));
+	FILE *file = std::fopen(path, "r");
+	if (file != nullptr) {
+		if (std::fgets(record->name, sizeof(record->name), file) != nullptr) {
+			record->name[std::strcspn(record->name, "\n")] = '\0';
+		}
+		std::fclose(file);
+	}
+	wl_list_insert(&tracer.clients, &record->link);
+	tracer.client_count++;
+	return record;
+}
+
+void traced_surface_destroy(Listener * /*listener*/, void * /*data*/) {
+	tracer.dropped++;
+	reset_sample();
+}
+
+void traced_surface_commit(Listener * /*listener*/, void * /*data*/) {
+	if (tracer.stage != SAMPLE_AWAIT_COMMIT) {
+		return;
+	}
+	auto *surface = tracer.surface;
+	tracer.commit_ns = kristal_now_ns();
+	histogram_add(&tracer.client->input_to_commit, tracer.commit_ns - tracer.input_ns);
+
+	/* Arm every output currently showing the surface; the first later
+	 * present on any of them completes the sample. */
+	bool armed = false;
+	wlr_surface_output *surface_output = nullptr;
+	wl_list_for_each(surface_output, &surface->current_outputs, link) {
+		auto *output = static_cast<KristalOutput *>(surface_output->output->data);
+		if (output == nullptr) {
+			continue;
+		}
+		output->latency_commit_seq = surface_output->output->commit_seq;
+		output->latency_armed = true;
+		armed = true;
+	}
+
+	if (!armed) {
+		tracer.dropped++;
+		reset_sample();
+		return;
+	}
+	wl_list_remove(&tracer.surface_commit.link);
+	wl_list_remove(&tracer.surface_destroy.link);
+	tracer.surface = nullptr;
+	tracer.stage = SAMPLE_AWAIT_PRESENT;
+}
+
+void output_present(Listener *listener, void *data) {
+	KristalOutput *output = wl_container_of(listener, output, latency_present);
+	auto *event = static_cast<OutputEventPresent *>(data);
+	if (!output->latency_armed || tracer.stage != SAMPLE_AWAIT_PRESENT) {
+		return;
+	}
+	/* Presents for frames committed before the client's commit cannot
+	 * contain its new content. */
+	if (event->commit_seq <= output->latency_commit_seq) {
+		return;
+	}
+	if (!event->presented) {
+		output->latency_armed = false;
+		return;
+	}
+
+	uint64_t present_ns = kristal_now_ns();
+	if (event->when != nullptr && (event->when->tv_sec != 0 || event->when->tv_nsec != 0)) {
+		present_ns = static_cast<uint64_t>(event->when->tv_sec) * 1000000000ull +
+			static_cast<uint64_t>(event->when->tv_nsec);
+	}
+	if (present_ns < tracer.commit_ns) {
+		present_ns = tracer.commit_ns;
+	}
+	histogram_add(&tracer.client->commit_to_present, present_ns - tracer.commit_ns);
+	histogram_add(&tracer.client->input_to_present, present_ns - tracer.input_ns);
+	reset_sample();
+}
+
+} // namespace
+
+void server_latency_init(KristalServer *server) {
+	const char *value = getenv("KRISTAL_LATENCY_TRACE");
+	tracer.server = server;
+	tracer.enabled = value != nullptr && value[0] != '\0' && strcmp(value, "0") != 0;
+	tracer.stage = SAMPLE_IDLE;
+	wl_list_init(&tracer.clients);
+	tracer.surface_commit.notify = traced_surface_commit;
+	tracer.surface_destroy.notify = traced_surface_destroy;
+	if (tracer.enabled) {
+		wlr_log(WLR_INFO, "Input latency tracing enabled; send SIGUSR1 to dump histograms");
+	}
+}
+
+void server_latency_finish(KristalServer * /*server*/) {
+	reset_sample();
+	ClientLatency *record = nullptr;
+	ClientLatency *tmp = nullptr;
+	wl_list_for_each_safe(record, tmp, &tracer.clients, link) {
+		if (record->client != nullptr) {
+			wl_list_remove(&record->client_destroy.link);
+		}
+		wl_list_remove(&record->link);
+		delete record;
+	}
+	tracer.client_count = 0;
+}
+
+void server_latency_output_init(KristalOutput *output) {
+	output->latency_armed = false;
+	output->latency_commit_seq = 0;
+	output->latency_present.notify = output_present;
+	wl_list_init(&output->latency_present.link);
+	if (tracer.enabled) {
+		wl_signal_add(&output->wlr_output->events.present, &output->latency_present);
+	}
+}
+
+void server_latency_output_finish(KristalOutput *output) {
+	wl_list_remove(&output->latency_present.link);
+}
+
+void server_latency_input(KristalServer * /*server*/, uint32_t time_msec, Surface *surface) {
+	if (!tracer.enabled || surface == nullptr || surface->resource == nullptr) {
+		return;
+	}
+	const uint64_t now = kristal_now_ns();
+	if (tracer.stage != SAMPLE_IDLE) {
+		if (now - tracer.input_ns < kSampleTimeoutNs) {
+			return;
+		}
+		/* The client never answered (or the output never presented);
+		 * give up on this sample rather than stall the tracer. */
+		tracer.dropped++;
+		reset_sample();
+	}
+
+	auto *client = client_latency_for(wl_resource_get_client(surface->resource));
+	if (client == nullptr) {
+		return;
+	}
+
+	/* libinput stamps events with CLOCK_MONOTONIC milliseconds. Use that as
+	 * the start when it is plausible so queueing before dispatch counts; other
+	 * backends fall back to the dispatch time. */
+	uint64_t input_ns = now;
+	const uint64_t event_ns = static_cast<uint64_t>(time_msec) * 1000000ull;
+	if (event_ns <= now && now - event_ns < kSampleTimeoutNs) {
+		input_ns = event_ns;
+		histogram_add(&tracer.input_to_dispatch, now - event_ns);
+	}
+
+	tracer.stage = SAMPLE_AWAIT_COMMIT;
+	tracer.input_ns = input_ns;
+	tracer.client = client;
+	tracer.surface = surface;
+	wl_signal_add(&surface->events.commit, &tracer.surface_commit);
+	wl_signal_add(&surface->events.destroy, &tracer.surface_destroy);
+}
+
+void server_latency_dump(KristalServer * /*server*/) {
+	if (!tracer.enabled) {
+		wlr_log(WLR_INFO, "latency: tracing disabled (set KRISTAL_LATENCY_TRACE=1)");
+		return;
+	}
+	wlr_log(WLR_INFO, "latency: %u samples dropped", tracer.dropped);
+	log_histogram("compositor", "input->dispatch", &tracer.input_to_dispatch);
+
+	ClientLatency *record = nullptr;
+	wl_list_for_each(record, &tracer.clients, link) {
+		char who[64];
+		std::snprintf(
+			who,
+			sizeof(who),
+			"%s[%d]%s",
+			record->name,
+			static_cast<int>(record->pid),
+			record->client == nullptr ? " (exited)" : "");
+		log_histogram(who, "input->commit", &record->input_to_commit);
+		log_histogram(who, "commit->present", &record->commit_to_present);
+		log_histogram(who, "input->present", &record->input_to_present);
+	}
+}
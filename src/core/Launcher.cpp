@@ -0,0 +1,259 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "core/internal.h"
+
+extern char **environ;
+
+namespace {
+
+constexpr int kMaxAncestorDepth = 8;
+
+double ns_to_ms(uint64_t ns) {
+	return static_cast<double>(ns) / 1000000.0;
+}
+
+pid_t read_parent_pid(pid_t pid) {
+	char path[64];
+	std::snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+	FILE *file = std::fopen(path, "r");
+	if (file == nullptr) {
+		return -1;
+	}
+
+	char line[512];
+	const bool ok = std::fgets(line, sizeof(line), file) != nullptr;
+	std::fclose(file);
+	if (!ok) {
+		return -1;
+	}
+
+	/* The command name may contain spaces and parentheses; the fields after
+	 * the last ')' are "state ppid ...". */
+	const char *end = std::strrchr(line, ')');
+	if (end == nullptr) {
+		return -1;
+	}
+	char state = 0;
+	int ppid = -1;
+	if (std::sscanf(end + 1, " %c %d", &state, &ppid) != 2) {
+		return -1;
+	}
+	return static_cast<pid_t>(ppid);
+}
+
+KristalProcess *find_process(KristalServer *server, pid_t pid) {
+	KristalProcess *process = nullptr;
+	wl_list_for_each(process, &server->processes, link) {
+		if (!process->exited && process->pid == pid) {
+			return process;
+		}
+	}
+	return nullptr;
+}
+
+KristalProcess *find_launch_for_pid(KristalServer *server, pid_t pid) {
+	for (int depth = 0; depth < kMaxAncestorDepth && pid > 1; ++depth) {
+		auto *process = find_process(server, pid);
+		if (process != nullptr) {
+			return process;
+		}
+		pid = read_parent_pid(pid);
+	}
+	return nullptr;
+}
+
+int handle_sigchld(int /*signal_number*/, void *data) {
+	auto *server = static_cast<KristalServer *>(data);
+
+	/* Only reap children we launched ourselves; wlroots waits for the
+	 * Xwayland server on its own. */
+	KristalProcess *process = nullptr;
+	KristalProcess *tmp = nullptr;
+	wl_list_for_each_safe(process, tmp, &server->processes, link) {
+		if (process->exited) {
+			if (server_cgroup_release(process)) {
+				server_launcher_destroy_process(process);
+			}
+			continue;
+		}
+		int status = 0;
+		const pid_t result = waitpid(process->pid, &status, WNOHANG);
+		if (result == 0 || (result < 0 && errno == EINTR)) {
+			continue;
+		}
+		if (result > 0 && WIFEXITED(status)) {
+			wlr_log(
+				WLR_DEBUG,
+				"launch %d (%s) exited with status %d",
+				static_cast<int>(process->pid),
+				process->command,
+				WEXITSTATUS(status));
+		} else if (result > 0 && WIFSIGNALED(status)) {
+			wlr_log(
+				WLR_DEBUG,
+				"launch %d (%s) killed by signal %d",
+				static_cast<int>(process->pid),
+				process->command,
+				WTERMSIG(status));
+		}
+		process->exited = true;
+		if (server_cgroup_release(process)) {
+			server_launcher_destroy_process(process);
+		}
+	}
+	return 0;
+}
+
+} // namespace
+
+void server_launcher_init(KristalServer *server) {
+	wl_list_init(&server->processes);
+	server->sigchld_source = wl_event_loop_add_signal(
+		wl_display_get_event_loop(server->display),
+		SIGCHLD,
+		handle_sigchld,
+		server);
+	if (server->sigchld_source == nullptr) {
+		wlr_log(WLR_ERROR, "failed to watch SIGCHLD; launched clients will not be reaped");
+	}
+}
+
+void server_launcher_finish(KristalServer *server) {
+	if (server->sigchld_source != nullptr) {
+		wl_event_source_remove(server->sigchld_source);
+		server->sigchld_source = nullptr;
+	}
+	KristalProcess *process = nullptr;
+	KristalProcess *tmp = nullptr;
+	wl_list_for_each_safe(process, tmp, &server->processes, link) {
+		server_cgroup_release(process);
+		server_launcher_destroy_process(process);
+	}
+}
+
+void server_launcher_destroy_process(KristalProcess *process) {
+	KristalView *view = nullptr;
+	wl_list_for_each(view, &process->server->views, link) {
+		if (view->process == process) {
+			view->process = nullptr;
+		}
+	}
+	wl_list_remove(&process->link);
+	delete process;
+}
+
+/*
+ * posix_spawn uses CLONE_VFORK on glibc and musl, so launching does not copy
+ * the compositor's page tables the way fork() does.
+ */
+pid_t server_spawn_command(KristalServer *server, const char *command) {
+	if (server == nullptr || command == nullptr || command[0] == '\0') {
+		return -1;
+	}
+	KristalProfileZone zone("server_spawn_command");
+
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+
+	/* wl_event_loop_add_signal blocks the signals it watches; children must
+	 * not inherit that mask. */
+	sigset_t mask;
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	sigset_t defaults;
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGCHLD);
+	sigaddset(&defaults, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	/* With a scope, the shell writes itself into it before running the
+	 * command, so nothing the command forks is left in the compositor's
+	 * cgroup. The eval drops the scope and command from the positional
+	 * parameters the command sees. */
+	char scope[sizeof(KristalProcess::cgroup_path)];
+	const bool scoped = server_cgroup_create_scope(server, scope, sizeof(scope));
+	char *const plain_argv[] = {
+		const_cast<char *>("/bin/sh"),
+		const_cast<char *>("-c"),
+		const_cast<char *>(command),
+		nullptr,
+	};
+	char *const scoped_argv[] = {
+		const_cast<char *>("/bin/sh"),
+		const_cast<char *>("-c"),
+		const_cast<char *>("echo $$ > \"$1/cgroup.procs\"; eval \"shift 2; $2\""),
+		const_cast<char *>("sh"),
+		scope,
+		const_cast<char *>(command),
+		nullptr,
+	};
+
+	pid_t pid = -1;
+	const uint64_t start_ns = kristal_now_ns();
+	const int err = posix_spawn(&pid, "/bin/sh", nullptr, &attr, scoped ? scoped_argv : plain_argv, environ);
+	const uint64_t spawned_ns = kristal_now_ns();
+	posix_spawnattr_destroy(&attr);
+	if (err != 0) {
+		wlr_log(WLR_ERROR, "failed to launch '%s': %s", command, std::strerror(err));
+		server_cgroup_remove_scope(scope);
+		return -1;
+	}
+
+	auto *process = new KristalProcess{};
+	process->server = server;
+	process->pid = pid;
+	process->spawn_start_ns = start_ns;
+	process->spawned_ns = spawned_ns;
+	process->mapped = false;
+	process->exited = false;
+	std::snprintf(process->command, sizeof(process->command), "%s", command);
+	wl_list_insert(&server->processes, &process->link);
+	server_cgroup_attach(process, scope);
+
+	wlr_log(
+		WLR_INFO,
+		"launch %d (%s): spawned in %.3f ms",
+		static_cast<int>(pid),
+		process->command,
+		ns_to_ms(spawned_ns - start_ns));
+	return pid;
+}
+
+void server_launcher_view_mapped(KristalView *view, pid_t pid) {
+	if (view == nullptr || view->server == nullptr || pid <= 0) {
+		return;
+	}
+	auto *process = find_launch_for_pid(view->server, pid);
+	if (process == nullptr) {
+		process = server_cgroup_find_process(view->server, pid);
+	}
+	view->process = process;
+	if (process == nullptr) {
+		return;
+	}
+
+	if (!process->mapped) {
+		process->mapped = true;
+		wlr_log(
+			WLR_INFO,
+			"launch %d (%s): first map after %.1f ms",
+			static_cast<int>(process->pid),
+			process->command,
+			ns_to_ms(kristal_now_ns() - process->spawn_start_ns));
+	}
+	server_cgroup_update_weights(view->server);
+}
+
+void server_launcher_view_unmapped(KristalView *view) {
+	if (view == nullptr || view->process == nullptr) {
+		return;
+	}
+	view->process = nullptr;
+	server_cgroup_update_weights(view->server);
+}
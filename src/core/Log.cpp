@@ -0,0 +1,267 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <signal.h>
+
+#include "core/internal.h"
+
+/*
+ * Log level control and asynchronous logging.
+ *
+ * KRISTAL_LOG_LEVEL (silent|error|info|debug) is read at startup and on
+ * config reload. wlroots filters by level before calling us, so suppressed
+ * messages cost nothing. Messages that pass are formatted straight into a
+ * preallocated multi-producer ring and written by a background thread to
+ * KRISTAL_LOG_FILE or stderr (which the journal captures under systemd).
+ * When the ring is full the message is dropped and counted; the compositor
+ * never blocks on log I/O. KRISTAL_LOG_ASYNC=0 restores synchronous stderr
+ * logging.
+ */
+
+namespace {
+
+constexpr size_t kLogSlots = 1024;
+constexpr size_t kLogSlotText = 480;
+constexpr auto kDrainIdleWait = std::chrono::milliseconds(250);
+
+struct LogSlot {
+	std::atomic<uint64_t> sequence;
+	uint64_t time_ns;
+	enum wlr_log_importance importance;
+	char text[kLogSlotText];
+};
+
+struct AsyncLog {
+	bool running;
+	enum wlr_log_importance level;
+	uint64_t start_ns;
+	FILE *out;
+	bool owns_out;
+	LogSlot slots[kLogSlots];
+	std::atomic<uint64_t> tail;
+	uint64_t head;
+	std::atomic<uint64_t> dropped;
+	uint64_t dropped_reported;
+	std::atomic<bool> drainer_sleeping;
+	std::atomic<bool> stop;
+	std::mutex wake_mutex;
+	std::condition_variable wake;
+	std::thread drainer;
+};
+
+AsyncLog async_log;
+
+const char *const kImportanceNames[] = {"SILENT", "ERROR", "INFO", "DEBUG"};
+
+bool parse_log_level(const char *value, enum wlr_log_importance *out) {
+	if (strcmp(value, "silent") == 0) {
+		*out = WLR_SILENT;
+	} else if (strcmp(value, "error") == 0) {
+		*out = WLR_ERROR;
+	} else if (strcmp(value, "info") == 0) {
+		*out = WLR_INFO;
+	} else if (strcmp(value, "debug") == 0) {
+		*out = WLR_DEBUG;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void write_line(FILE *out, uint64_t time_ns, enum wlr_log_importance importance, const char *text) {
+	const uint64_t elapsed_ms = (time_ns - async_log.start_ns) / 1000000ull;
+	std::fprintf(
+		out,
+		"%02llu:%02llu:%02llu.%03llu [%s] %s\n",
+		static_cast<unsigned long long>(elapsed_ms / 3600000ull),
+		static_cast<unsigned long long>(elapsed_ms / 60000ull % 60ull),
+		static_cast<unsigned long long>(elapsed_ms / 1000ull % 60ull),
+		static_cast<unsigned long long>(elapsed_ms % 1000ull),
+		importance <= WLR_DEBUG ? kImportanceNames[importance] : "?",
+		text);
+}
+
+/* Producer side: any thread. Claims a slot or gives up immediately. */
+void log_callback(enum wlr_log_importance importance, const char *fmt, va_list args) {
+	uint64_t position = async_log.tail.load(std::memory_order_relaxed);
+	LogSlot *slot = nullptr;
+	for (;;) {
+		slot = &async_log.slots[position % kLogSlots];
+		const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+		const int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+		if (diff == 0) {
+			if (async_log.tail.compare_exchange_weak(
+					position,
+					position + 1,
+					std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			async_log.dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		} else {
+			position = async_log.tail.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->time_ns = kristal_now_ns();
+	slot->importance = importance;
+	std::vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+	slot->sequence.store(position + 1, std::memory_order_release);
+
+	if (async_log.drainer_sleeping.exchange(false, std::memory_order_acq_rel)) {
+		async_log.wake.notify_one();
+	}
+}
+
+/* Consumer side: the drainer thread only. Returns the number written. */
+size_t drain_ring(FILE *out) {
+	size_t written = 0;
+	for (;;) {
+		LogSlot *slot = &async_log.slots[async_log.head % kLogSlots];
+		if (slot->sequence.load(std::memory_order_acquire) != async_log.head + 1) {
+			break;
+		}
+		write_line(out, slot->time_ns, slot->importance, slot->text);
+		slot->sequence.store(async_log.head + kLogSlots, std::memory_order_release);
+		async_log.head++;
+		written++;
+	}
+	const uint64_t dropped = async_log.dropped.load(std::memory_order_relaxed);
+	if (dropped != async_log.dropped_reported) {
+		char note[96];
+		std::snprintf(
+			note,
+			sizeof(note),
+			"log ring full: %llu messages dropped",
+			static_cast<unsigned long long>(dropped - async_log.dropped_reported));
+		write_line(out, kristal_now_ns(), WLR_ERROR, note);
+		async_log.dropped_reported = dropped;
+		written++;
+	}
+	return written;
+}
+
+void drainer_main() {
+	while (!async_log.stop.load(std::memory_order_acquire)) {
+		if (drain_ring(async_log.out) > 0) {
+			std::fflush(async_log.out);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(async_log.wake_mutex);
+		async_log.drainer_sleeping.store(true, std::memory_order_release);
+		/* Bounded wait: a producer that raced with the flag above is picked
+		 * up on the next pass instead of being lost. */
+		async_log.wake.wait_for(lock, kDrainIdleWait);
+		async_log.drainer_sleeping.store(false, std::memory_order_release);
+	}
+	drain_ring(async_log.out);
+	std::fflush(async_log.out);
+}
+
+bool async_requested() {
+	const char *value = getenv("KRISTAL_LOG_ASYNC");
+	return value == nullptr || value[0] == '\0' || strcmp(value, "0") != 0;
+}
+
+FILE *open_log_output(bool *owns) {
+	*owns = false;
+	const char *path = getenv("KRISTAL_LOG_FILE");
+	if (path == nullptr || path[0] == '\0') {
+		return stderr;
+	}
+	FILE *file = std::fopen(path, "ae");
+	if (file == nullptr) {
+		std::fprintf(stderr, "kristal: cannot open KRISTAL_LOG_FILE=%s: %s\n", path, strerror(errno));
+		return stderr;
+	}
+	*owns = true;
+	return file;
+}
+
+} // namespace
+
+void kristal_log_init(void) {
+	async_log.level = WLR_INFO;
+	async_log.start_ns = kristal_now_ns();
+	const char *value = getenv("KRISTAL_LOG_LEVEL");
+	const bool valid = value == nullptr || value[0] == '\0' || parse_log_level(value, &async_log.level);
+
+	if (async_requested()) {
+		for (size_t i = 0; i < kLogSlots; ++i) {
+			async_log.slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		async_log.out = open_log_output(&async_log.owns_out);
+		async_log.stop.store(false, std::memory_order_relaxed);
+		/* The drainer inherits a fully blocked mask, so process-wide
+		 * signals stay with the main thread's event-loop handlers
+		 * instead of taking their default action here. */
+		sigset_t all;
+		sigset_t previous;
+		sigfillset(&all);
+		pthread_sigmask(SIG_BLOCK, &all, &previous);
+		async_log.drainer = std::thread(drainer_main);
+		pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+		async_log.running = true;
+		wlr_log_init(async_log.level, log_callback);
+	} else {
+		wlr_log_init(async_log.level, nullptr);
+	}
+	if (!valid) {
+		wlr_log(
+			WLR_ERROR,
+			"Ignoring invalid KRISTAL_LOG_LEVEL='%s'; expected silent, error, info or debug",
+			value);
+	}
+}
+
+void kristal_log_reload(void) {
+	const char *value = getenv("KRISTAL_LOG_LEVEL");
+	enum wlr_log_importance level = WLR_INFO;
+	if (value != nullptr && value[0] != '\0' && !parse_log_level(value, &level)) {
+		wlr_log(
+			WLR_ERROR,
+			"Ignoring invalid KRISTAL_LOG_LEVEL='%s'; expected silent, error, info or debug",
+			value);
+		return;
+	}
+	if (level == async_log.level) {
+		return;
+	}
+	async_log.level = level;
+	wlr_log_init(level, async_log.running ? log_callback : nullptr);
+	wlr_log(WLR_INFO, "Log level set to %s", kImportanceNames[level]);
+}
+
+void kristal_log_dump(void) {
+	wlr_log(
+		WLR_INFO,
+		"Log: level %s, %s, %llu messages dropped",
+		kImportanceNames[async_log.level],
+		async_log.running ? "async" : "sync",
+		static_cast<unsigned long long>(async_log.dropped.load(std::memory_order_relaxed)));
+}
+
+void kristal_log_finish(void) {
+	if (!async_log.running) {
+		return;
+	}
+	/* Back to synchronous logging before the ring goes away. */
+	wlr_log_init(async_log.level, nullptr);
+	async_log.stop.store(true, std::memory_order_release);
+	async_log.wake.notify_one();
+	async_log.drainer.join();
+	async_log.running = false;
+	if (async_log.owns_out) {
+		std::fclose(async_log.out);
+		async_log.owns_out = false;
+	}
+	async_log.out = stderr;
+}
@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "core/internal.h"
+
+/*
+ * Compositor health metrics in OpenMetrics text format.
+ *
+ * KRISTAL_METRICS_SOCKET serves a snapshot to every connection on a Unix
+ * socket (e.g. `socat - UNIX-CONNECT:path`); KRISTAL_METRICS_FILE rewrites a
+ * file atomically every KRISTAL_METRICS_INTERVAL_MS (default 15000), which
+ * suits node_exporter's textfile collector. Hot paths only bump counters;
+ * gauges that need a walk (views, scene nodes, RSS) are computed when a
+ * snapshot is rendered. Rendering never changes state, so any number of
+ * readers can share the exporters; rates are left to the scraper.
+ */
+
+namespace {
+
+constexpr int kDefaultIntervalMs = 15000;
+
+struct Metrics {
+	bool enabled;
+	KristalServer *server;
+	const char *socket_path;
+	int listen_fd;
+	wl_event_source *listen_source;
+	const char *file_path;
+	int interval_ms;
+	wl_event_source *file_timer;
+	uint64_t input_events;
+	uint64_t keymap_compiles;
+	std::string buffer;
+};
+
+Metrics metrics{};
+
+void append(std::string *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void append(std::string *out, const char *fmt, ...) {
+	char line[512];
+	va_list args;
+	va_start(args, fmt);
+	const int length = std::vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+	if (length > 0) {
+		out->append(line, std::min(static_cast<size_t>(length), sizeof(line) - 1));
+	}
+}
+
+/* OpenMetrics label values escape backslash, quote and newline. */
+std::string label_value(const char *value) {
+	std::string escaped;
+	for (const char *c = value; *c != '\0'; ++c) {
+		if (*c == '\\' || *c == '"') {
+			escaped += '\\';
+			escaped += *c;
+		} else if (*c == '\n') {
+			escaped += "\\n";
+		} else {
+			escaped += *c;
+		}
+	}
+	return escaped;
+}
+
+size_t count_scene_nodes(SceneNode *node) {
+	size_t count = 1;
+	if (node->type == WLR_SCENE_NODE_TREE) {
+		auto *tree = wlr_scene_tree_from_node(node);
+		SceneNode *child = nullptr;
+		wl_list_for_each(child, &tree->children, link) {
+			count += count_scene_nodes(child);
+		}
+	}
+	return count;
+}
+
+uint64_t resident_bytes() {
+	FILE *file = std::fopen("/proc/self/statm", "re");
+	if (file == nullptr) {
+		return 0;
+	}
+	unsigned long long size = 0;
+	unsigned long long resident = 0;
+	const int fields = std::fscanf(file, "%llu %llu", &size, &resident);
+	std::fclose(file);
+	if (fields != 2) {
+		return 0;
+	}
+	return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+const std::string &render() {
+	KristalServer *server = metrics.server;
+	std::string &out = metrics.buffer;
+	out.clear();
+
+	KristalOutput *output = nullptr;
+	out += "# TYPE kristal_output_frames counter\n"
+		"# HELP kristal_output_frames Frames committed per output.\n";
+	wl_list_for_each(output, &server->outputs, link) {
+		append(&out, "kristal_output_frames_total{output=\"%s\"} %llu\n",
+			label_value(output->wlr_output->name).c_str(),
+			static_cast<unsigned long long>(output->metrics_frames));
+	}
+	out += "# TYPE kristal_output_missed_frames counter\n"
+		"# HELP kristal_output_missed_frames Frames that failed to commit or reached the screen after the vblank they were drawn for.\n";
+	wl_list_for_each(output, &server->outputs, link) {
+		append(&out, "kristal_output_missed_frames_total{output=\"%s\"} %llu\n",
+			label_value(output->wlr_output->name).c_str(),
+			static_cast<unsigned long long>(output->metrics_missed));
+	}
+	out += "# TYPE kristal_output_damage_pixels counter\n";
+	wl_list_for_each(output, &server->outputs, link) {
+		append(&out, "kristal_output_damage_pixels_total{output=\"%s\"} %llu\n",
+			label_value(output->wlr_output->name).c_str(),
+			static_cast<unsigned long long>(output->metrics_damage_pixels));
+	}
+
+	KristalClient *client = nullptr;
+	const struct {
+		const char *family;
+		const char *type;
+		const char *sample;
+		uint64_t KristalClient::*field;
+	} client_series[] = {
+		{"kristal_client_commits", "counter", "kristal_client_commits_total", &KristalClient::commits},
+		{"kristal_client_configures", "counter", "kristal_client_configures_total", &KristalClient::configures},
+		{"kristal_client_damage_pixels", "counter", "kristal_client_damage_pixels_total",
+			&KristalClient::damage_pixels},
+		{"kristal_client_texture_uploads", "counter", "kristal_client_texture_uploads_total",
+			&KristalClient::texture_uploads},
+		{"kristal_client_buffer_bytes", "gauge", "kristal_client_buffer_bytes", &KristalClient::buffer_bytes},
+	};
+	for (const auto &series : client_series) {
+		append(&out, "# TYPE %s %s\n", series.family, series.type);
+		wl_list_for_each(client, &server->clients, link) {
+			append(&out, "%s{pid=\"%d\",comm=\"%s\"} %llu\n",
+				series.sample,
+				static_cast<int>(client->pid),
+				label_value(client->comm).c_str(),
+				static_cast<unsigned long long>(client->*series.field));
+		}
+	}
+	out += "# TYPE kristal_client_surfaces gauge\n";
+	wl_list_for_each(client, &server->clients, link) {
+		const std::string comm = label_value(client->comm);
+		append(&out, "kristal_client_surfaces{pid=\"%d\",comm=\"%s\",kind=\"all\"} %u\n",
+			static_cast<int>(client->pid), comm.c_str(), client->surfaces);
+		append(&out, "kristal_client_surfaces{pid=\"%d\",comm=\"%s\",kind=\"subsurface\"} %u\n",
+			static_cast<int>(client->pid), comm.c_str(), client->subsurfaces);
+		append(&out, "kristal_client_surfaces{pid=\"%d\",comm=\"%s\",kind=\"popup\"} %u\n",
+			static_cast<int>(client->pid), comm.c_str(), client->popups);
+	}
+	out += "# TYPE kristal_client_commits_per_second gauge\n";
+	wl_list_for_each(client, &server->clients, link) {
+		append(&out, "kristal_client_commits_per_second{pid=\"%d\",comm=\"%s\"} %.3f\n",
+			static_cast<int>(client->pid),
+			label_value(client->comm).c_str(),
+			server_client_commit_rate(client));
+	}
+
+	out += "# TYPE kristal_frame_callbacks_sent counter\n"
+		"# HELP kristal_frame_callbacks_sent Frame callbacks delivered to views, by policy class.\n";
+	for (int i = 0; i < KRISTAL_FRAME_CLASS_COUNT; ++i) {
+		uint64_t sent = 0;
+		uint64_t suppressed = 0;
+		server_frame_policy_counts(static_cast<enum KristalFrameClass>(i), &sent, &suppressed);
+		append(&out, "kristal_frame_callbacks_sent_total{class=\"%s\"} %llu\n",
+			server_frame_class_name(static_cast<enum KristalFrameClass>(i)),
+			static_cast<unsigned long long>(sent));
+	}
+	out += "# TYPE kristal_frame_callbacks_suppressed counter\n"
+		"# HELP kristal_frame_callbacks_suppressed Frame callbacks held back by the frame policy, by class.\n";
+	for (int i = 0; i < KRISTAL_FRAME_CLASS_COUNT; ++i) {
+		uint64_t sent = 0;
+		uint64_t suppressed = 0;
+		server_frame_policy_counts(static_cast<enum KristalFrameClass>(i), &sent, &suppressed);
+		append(&out, "kristal_frame_callbacks_suppressed_total{class=\"%s\"} %llu\n",
+			server_frame_class_name(static_cast<enum KristalFrameClass>(i)),
+			static_cast<unsigned long long>(suppressed));
+	}
+
+	int views[10] = {};
+	KristalView *view = nullptr;
+	wl_list_for_each(view, &server->views, link) {
+		if (view->workspace >= 0 && view->workspace < 10) {
+			views[view->workspace]++;
+		}
+	}
+	out += "# TYPE kristal_workspace_views gauge\n";
+	for (int workspace = 1; workspace <= server->workspace_count && workspace < 10; ++workspace) {
+		append(&out, "kristal_workspace_views{workspace=\"%d\"} %d\n", workspace, views[workspace]);
+	}
+
+	append(&out, "# TYPE kristal_scene_nodes gauge\nkristal_scene_nodes %zu\n",
+		count_scene_nodes(&server->scene->tree.node));
+
+	append(&out, "# TYPE kristal_input_events counter\nkristal_input_events_total %llu\n",
+		static_cast<unsigned long long>(metrics.input_events));
+	append(&out, "# TYPE kristal_keymap_compiles counter\nkristal_keymap_compiles_total %llu\n",
+		static_cast<unsigned long long>(metrics.keymap_compiles));
+	append(&out, "# TYPE kristal_resident_memory_bytes gauge\n"
+		"kristal_resident_memory_bytes %llu\n",
+		static_cast<unsigned long long>(resident_bytes()));
+	out += "# EOF\n";
+	return out;
+}
+
+int handle_connection(int fd, uint32_t /*mask*/, void * /*data*/) {
+	const int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (client < 0) {
+		return 0;
+	}
+	const std::string &snapshot = render();
+	/* One non-blocking send: a reader that cannot take a snapshot in one
+	 * go gets a truncated one rather than stalling the event loop. */
+	if (send(client, snapshot.data(), snapshot.size(), MSG_NOSIGNAL) !=
+		static_cast<ssize_t>(snapshot.size())) {
+		wlr_log(WLR_DEBUG, "metrics: short write to socket client");
+	}
+	close(client);
+	return 0;
+}
+
+int write_metrics_file(void * /*data*/) {
+	const std::string &snapshot = render();
+	const std::string tmp = std::string(metrics.file_path) + ".tmp";
+	FILE *file = std::fopen(tmp.c_str(), "we");
+	if (file == nullptr) {
+		wlr_log(WLR_ERROR, "cannot write metrics %s: %s", tmp.c_str(), std::strerror(errno));
+	} else {
+		std::fwrite(snapshot.data(), 1, snapshot.size(), file);
+		if (std::fclose(file) == 0) {
+			std::rename(tmp.c_str(), metrics.file_path);
+		}
+	}
+	wl_event_source_timer_update(metrics.file_timer, metrics.interval_ms);
+	return 0;
+}
+
+bool open_socket(const char *path) {
+	sockaddr_un addr{};
+	if (std::strlen(path) >= sizeof(addr.sun_path)) {
+		wlr_log(WLR_ERROR, "Ignoring KRISTAL_METRICS_SOCKET='%s'; path too long", path);
+		return false;
+	}
+	const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd < 0) {
+		wlr_log(WLR_ERROR, "metrics socket: %s", std::strerror(errno));
+		return false;
+	}
+	addr.sun_family = AF_UNIX;
+	std::strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	unlink(path);
+	if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+		wlr_log(WLR_ERROR, "metrics socket %s: %s", path, std::strerror(errno));
+		close(fd);
+		return false;
+	}
+	chmod(path, 0600);
+	metrics.listen_fd = fd;
+	metrics.listen_source = wl_event_loop_add_fd(
+		wl_display_get_event_loop(metrics.server->display),
+		fd,
+		WL_EVENT_READABLE,
+		handle_connection,
+		nullptr);
+	return true;
+}
+
+int parse_interval_ms() {
+	const char *value = getenv("KRISTAL_METRICS_INTERVAL_MS");
+	if (value == nullptr || value[0] == '\0') {
+		return kDefaultIntervalMs;
+	}
+	char *end = nullptr;
+	errno = 0;
+	const long interval = strtol(value, &end, 10);
+	if (errno != 0 || end == value || (end != nullptr && *end != '\0') || interval <= 0 || interval > 3600000) {
+		wlr_log(
+			WLR_ERROR,
+			"Ignoring invalid KRISTAL_METRICS_INTERVAL_MS='%s'; expected a positive number of milliseconds",
+			value);
+		return kDefaultIntervalMs;
+	}
+	return static_cast<int>(interval);
+}
+
+} // namespace
+
+uint64_t kristal_region_area(const pixman_region32_t *region) {
+	int count = 0;
+	const pixman_box32_t *rects = pixman_region32_rectangles(
+		const_cast<pixman_region32_t *>(region), &count);
+	uint64_t area = 0;
+	for (int i = 0; i < count; ++i) {
+		area += static_cast<uint64_t>(rects[i].x2 - rects[i].x1) *
+			static_cast<uint64_t>(rects[i].y2 - rects[i].y1);
+	}
+	return area;
+}
+
+void server_metrics_init(KristalServer *server) {
+	metrics.server = server;
+	metrics.listen_fd = -1;
+
+	const char *socket_path = getenv("KRISTAL_METRICS_SOCKET");
+	if (socket_path != nullptr && socket_path[0] != '\0' && open_socket(socket_path)) {
+		metrics.socket_path = socket_path;
+		metrics.enabled = true;
+		wlr_log(WLR_INFO, "Serving metrics on %s", socket_path);
+	}
+
+	const char *file_path = getenv("KRISTAL_METRICS_FILE");
+	if (file_path != nullptr && file_path[0] != '\0') {
+		metrics.interval_ms = parse_interval_ms();
+		metrics.file_path = file_path;
+		metrics.file_timer = wl_event_loop_add_timer(
+			wl_display_get_event_loop(server->display),
+			write_metrics_file,
+			nullptr);
+		wl_event_source_timer_update(metrics.file_timer, metrics.interval_ms);
+		metrics.enabled = true;
+		wlr_log(WLR_INFO, "Writing metrics to %s every %d ms", file_path, metrics.interval_ms);
+	}
+}
+
+void server_metrics_finish(KristalServer * /*server*/) {
+	if (metrics.listen_source != nullptr) {
+		wl_event_source_remove(metrics.listen_source);
+		metrics.listen_source = nullptr;
+	}
+	if (metrics.listen_fd >= 0) {
+		close(metrics.listen_fd);
+		metrics.listen_fd = -1;
+		unlink(metrics.socket_path);
+	}
+	if (metrics.file_timer != nullptr) {
+		wl_event_source_remove(metrics.file_timer);
+		metrics.file_timer = nullptr;
+	}
+	metrics.enabled = false;
+}
+
+void server_metrics_dump(KristalServer *server) {
+	if (!metrics.enabled) {
+		return;
+	}
+	const size_t scene_nodes = count_scene_nodes(&server->scene->tree.node);
+	wlr_log(
+		WLR_INFO,
+		"Metrics: %zu clients tracked, %zu scene nodes, %llu input events, %llu keymap compiles",
+		server->client_count,
+		scene_nodes,
+		static_cast<unsigned long long>(metrics.input_events),
+		static_cast<unsigned long long>(metrics.keymap_compiles));
+}
+
+void kristal_metrics_input_event(void) {
+	metrics.input_events++;
+}
+
+uint64_t kristal_metrics_input_count(void) {
+	return metrics.input_events;
+}
+
+void kristal_metrics_keymap_compile(void) {
+	metrics.keymap_compiles++;
+}
@@ -0,0 +1,110 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sys/resource.h>
+
+#include "core/internal.h"
+
+/*
+ * Aggregate timings for the hot compositor paths, written to
+ * KRISTAL_PERF_REPORT on shutdown. kristal-bench reads the report; the
+ * format is one "name count total_ns max_ns" line per stat followed by
+ * process-wide "key value" lines.
+ */
+
+namespace {
+
+struct PerfStat {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+};
+
+struct PerfState {
+	bool enabled;
+	const char *path;
+	PerfStat stats[KRISTAL_PERF_STAT_COUNT];
+};
+
+PerfState perf{};
+
+const char *const kPerfStatNames[KRISTAL_PERF_STAT_COUNT] = {
+	"frame_cpu",
+	"arrange",
+	"borders",
+	"workspace_switch",
+	"map",
+	"layout",
+};
+
+uint64_t thread_cpu_ns() {
+	timespec now{};
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return static_cast<uint64_t>(now.tv_sec) * 1000000000ull +
+		static_cast<uint64_t>(now.tv_nsec);
+}
+
+/* Frames are charged in CPU time so an idle vsync wait does not count. */
+uint64_t perf_clock(enum KristalPerfStat stat) {
+	return stat == KRISTAL_PERF_FRAME ? thread_cpu_ns() : kristal_now_ns();
+}
+
+uint64_t timeval_us(const timeval &value) {
+	return static_cast<uint64_t>(value.tv_sec) * 1000000ull +
+		static_cast<uint64_t>(value.tv_usec);
+}
+
+} // namespace
+
+void server_perf_init(KristalServer * /*server*/) {
+	const char *path = getenv("KRISTAL_PERF_REPORT");
+	perf.enabled = path != nullptr && path[0] != '\0';
+	perf.path = path;
+}
+
+void server_perf_finish(KristalServer * /*server*/) {
+	if (!perf.enabled) {
+		return;
+	}
+	FILE *file = std::fopen(perf.path, "we");
+	if (file == nullptr) {
+		wlr_log(WLR_ERROR, "cannot write perf report %s: %s", perf.path, std::strerror(errno));
+		return;
+	}
+	for (int i = 0; i < KRISTAL_PERF_STAT_COUNT; ++i) {
+		const PerfStat &stat = perf.stats[i];
+		std::fprintf(
+			file,
+			"%s %llu %llu %llu\n",
+			kPerfStatNames[i],
+			static_cast<unsigned long long>(stat.count),
+			static_cast<unsigned long long>(stat.total_ns),
+			static_cast<unsigned long long>(stat.max_ns));
+	}
+
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	std::fprintf(file, "peak_rss_kb %ld\n", usage.ru_maxrss);
+	std::fprintf(file, "cpu_user_us %llu\n", static_cast<unsigned long long>(timeval_us(usage.ru_utime)));
+	std::fprintf(file, "cpu_system_us %llu\n", static_cast<unsigned long long>(timeval_us(usage.ru_stime)));
+	std::fclose(file);
+}
+
+uint64_t kristal_perf_begin(enum KristalPerfStat stat) {
+	return perf.enabled ? perf_clock(stat) : 0;
+}
+
+void kristal_perf_end(enum KristalPerfStat stat, uint64_t start) {
+	if (start == 0) {
+		return;
+	}
+	const uint64_t elapsed = perf_clock(stat) - start;
+	PerfStat &entry = perf.stats[stat];
+	entry.count++;
+	entry.total_ns += elapsed;
+	if (elapsed > entry.max_ns) {
+		entry.max_ns = elapsed;
+	}
+}
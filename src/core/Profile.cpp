@@ -0,0 +1,153 @@
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include "core/internal.h"
+
+/*
+ * Handler-level profiling zones.
+ *
+ * Listener callbacks registered through KRISTAL_PROFILED() open a zone named
+ * after the handler. While a capture is running each zone is appended to a
+ * per-thread single-producer ring (no locks on the hot path; old entries are
+ * overwritten). SIGUSR2 starts and stops a capture; stopping writes the
+ * window as Chrome trace-event JSON, which Perfetto and chrome://tracing load.
+ */
+
+std::atomic<unsigned> kristal_profile_flags{0};
+
+namespace {
+
+constexpr size_t kRingEvents = 1u << 16;
+
+struct ProfileEvent {
+	const char *name;
+	uint64_t start_ns;
+	uint64_t end_ns;
+};
+
+struct ThreadRing {
+	pid_t tid;
+	std::atomic<uint64_t> head;
+	ProfileEvent events[kRingEvents];
+};
+
+struct Profiler {
+	std::mutex rings_mutex;
+	std::vector<std::unique_ptr<ThreadRing>> rings;
+	std::string path;
+	uint64_t capture_start_ns;
+};
+
+Profiler profiler;
+thread_local ThreadRing *thread_ring = nullptr;
+
+ThreadRing *ring_for_this_thread() {
+	if (thread_ring != nullptr) {
+		return thread_ring;
+	}
+	auto ring = std::make_unique<ThreadRing>();
+	ring->tid = static_cast<pid_t>(syscall(SYS_gettid));
+	ring->head.store(0, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(profiler.rings_mutex);
+	thread_ring = ring.get();
+	profiler.rings.push_back(std::move(ring));
+	return thread_ring;
+}
+
+std::string default_trace_path() {
+	const char *value = getenv("KRISTAL_PROFILE_PATH");
+	if (value != nullptr && value[0] != '\0') {
+		return value;
+	}
+	return "/tmp/kristal-trace-" + std::to_string(getpid()) + ".json";
+}
+
+void write_trace() {
+	FILE *file = std::fopen(profiler.path.c_str(), "we");
+	if (file == nullptr) {
+		wlr_log(WLR_ERROR, "cannot write profile %s: %s", profiler.path.c_str(), std::strerror(errno));
+		return;
+	}
+	const int pid = getpid();
+	size_t written = 0;
+	std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	std::lock_guard<std::mutex> lock(profiler.rings_mutex);
+	for (const auto &ring : profiler.rings) {
+		const uint64_t head = ring->head.load(std::memory_order_acquire);
+		const uint64_t first = head > kRingEvents ? head - kRingEvents : 0;
+		for (uint64_t i = first; i < head; ++i) {
+			const ProfileEvent &event = ring->events[i % kRingEvents];
+			if (event.start_ns < profiler.capture_start_ns) {
+				continue;
+			}
+			std::fprintf(
+				file,
+				"%s{\"name\":\"%s\",\"cat\":\"listener\",\"ph\":\"X\","
+				"\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+				written == 0 ? "" : ",\n",
+				event.name,
+				static_cast<double>(event.start_ns) / 1000.0,
+				static_cast<double>(event.end_ns - event.start_ns) / 1000.0,
+				pid,
+				static_cast<int>(ring->tid));
+			written++;
+		}
+	}
+	std::fprintf(file, "\n]}\n");
+	std::fclose(file);
+	wlr_log(WLR_INFO, "Profile: wrote %zu zones to %s", written, profiler.path.c_str());
+}
+
+void start_capture() {
+	profiler.capture_start_ns = kristal_now_ns();
+	kristal_profile_flags.fetch_or(KRISTAL_PROFILE_CAPTURE, std::memory_order_relaxed);
+	wlr_log(WLR_INFO, "Profile: capture started (SIGUSR2 again to stop)");
+}
+
+void stop_capture() {
+	kristal_profile_flags.fetch_and(~static_cast<unsigned>(KRISTAL_PROFILE_CAPTURE), std::memory_order_relaxed);
+	write_trace();
+}
+
+} // namespace
+
+void kristal_profile_record(const char *name, uint64_t start_ns) {
+	ThreadRing *ring = ring_for_this_thread();
+	const uint64_t head = ring->head.load(std::memory_order_relaxed);
+	ProfileEvent &event = ring->events[head % kRingEvents];
+	event.name = name;
+	event.start_ns = start_ns;
+	event.end_ns = kristal_now_ns();
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+void server_profile_init(KristalServer * /*server*/) {
+	profiler.path = default_trace_path();
+	const char *value = getenv("KRISTAL_PROFILE");
+	if (value != nullptr && value[0] != '\0' && strcmp(value, "0") != 0) {
+		start_capture();
+	}
+}
+
+void server_profile_finish(KristalServer * /*server*/) {
+	if ((kristal_profile_flags.load(std::memory_order_relaxed) & KRISTAL_PROFILE_CAPTURE) != 0) {
+		stop_capture();
+	}
+}
+
+void server_profile_toggle(KristalServer * /*server*/) {
+	if ((kristal_profile_flags.load(std::memory_order_relaxed) & KRISTAL_PROFILE_CAPTURE) != 0) {
+		stop_capture();
+	} else {
+		start_capture();
+	}
+}
@@ -0,0 +1,150 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "core/internal.h"
+
+namespace {
+
+int parse_rt_policy() {
+	const char *value = getenv("KRISTAL_RT_POLICY");
+	if (value == nullptr || value[0] == '\0' || strcmp(value, "rr") == 0) {
+		return SCHED_RR;
+	}
+	if (strcmp(value, "fifo") == 0) {
+		return SCHED_FIFO;
+	}
+	wlr_log(WLR_ERROR, "Ignoring invalid KRISTAL_RT_POLICY='%s'; expected rr or fifo", value);
+	return SCHED_RR;
+}
+
+/* Returns 0 when real-time scheduling was not requested. */
+int parse_rt_priority(int policy) {
+	const char *value = getenv("KRISTAL_RT_PRIORITY");
+	if (value == nullptr || value[0] == '\0') {
+		return 0;
+	}
+	const int min = sched_get_priority_min(policy);
+	const int max = sched_get_priority_max(policy);
+	char *end = nullptr;
+	errno = 0;
+	const long priority = strtol(value, &end, 10);
+	if (errno != 0 || end == value || (end != nullptr && *end != '\0') ||
+		priority < min || priority > max) {
+		wlr_log(
+			WLR_ERROR,
+			"Ignoring invalid KRISTAL_RT_PRIORITY='%s'; expected %d..%d",
+			value,
+			min,
+			max);
+		return 0;
+	}
+	return static_cast<int>(priority);
+}
+
+bool set_scheduler(int policy, int priority) {
+	struct sched_param param{};
+	param.sched_priority = priority;
+	/* SCHED_RESET_ON_FORK drops every child back to SCHED_OTHER: launched
+	 * clients, Xwayland and any helper threads wlroots starts. */
+	return sched_setscheduler(0, policy | SCHED_RESET_ON_FORK, &param) == 0;
+}
+
+void apply_realtime_scheduling() {
+	const int policy = parse_rt_policy();
+	int priority = parse_rt_priority(policy);
+	if (priority == 0) {
+		return;
+	}
+	const char *policy_name = policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR";
+
+	if (set_scheduler(policy, priority)) {
+		wlr_log(WLR_INFO, "Compositor thread running %s at priority %d", policy_name, priority);
+		return;
+	}
+	const int err = errno;
+
+	/* Without CAP_SYS_NICE the kernel still allows priorities up to
+	 * RLIMIT_RTPRIO, so retry at that ceiling before giving up. */
+	struct rlimit limit{};
+	if (err == EPERM && getrlimit(RLIMIT_RTPRIO, &limit) == 0 &&
+		limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur > 0 &&
+		static_cast<rlim_t>(priority) > limit.rlim_cur) {
+		priority = static_cast<int>(limit.rlim_cur);
+		if (set_scheduler(policy, priority)) {
+			wlr_log(
+				WLR_INFO,
+				"Compositor thread running %s at priority %d (clamped to RLIMIT_RTPRIO)",
+				policy_name,
+				priority);
+			return;
+		}
+	}
+
+	if (err == EPERM) {
+		wlr_log(
+			WLR_ERROR,
+			"Cannot switch to %s: missing CAP_SYS_NICE and RLIMIT_RTPRIO is too low; "
+			"continuing with SCHED_OTHER",
+			policy_name);
+	} else {
+		wlr_log(
+			WLR_ERROR,
+			"Cannot switch to %s: %s; continuing with SCHED_OTHER",
+			policy_name,
+			strerror(err));
+	}
+}
+
+void apply_memory_lock() {
+	const char *value = getenv("KRISTAL_MLOCK");
+	if (value == nullptr || value[0] == '\0' || strcmp(value, "0") == 0) {
+		return;
+	}
+
+	int flags = 0;
+	if (strcmp(value, "1") == 0 || strcmp(value, "current") == 0) {
+		flags = MCL_CURRENT;
+	} else if (strcmp(value, "all") == 0) {
+		/* MCL_ONFAULT keeps large GPU and shm mappings from being
+		 * populated up front; pages stay resident once touched. */
+		flags = MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT;
+	} else {
+		wlr_log(
+			WLR_ERROR,
+			"Ignoring invalid KRISTAL_MLOCK='%s'; expected 0, 1, current or all",
+			value);
+		return;
+	}
+
+	if (mlockall(flags) == 0) {
+		wlr_log(WLR_INFO, "Compositor memory locked (KRISTAL_MLOCK=%s)", value);
+		return;
+	}
+	const int err = errno;
+	struct rlimit limit{};
+	if ((err == ENOMEM || err == EPERM) && getrlimit(RLIMIT_MEMLOCK, &limit) == 0 &&
+		limit.rlim_cur != RLIM_INFINITY) {
+		wlr_log(
+			WLR_ERROR,
+			"Cannot lock compositor memory: %s (RLIMIT_MEMLOCK is %llu KiB); continuing unlocked",
+			strerror(err),
+			static_cast<unsigned long long>(limit.rlim_cur / 1024));
+		return;
+	}
+	wlr_log(WLR_ERROR, "Cannot lock compositor memory: %s; continuing unlocked", strerror(err));
+}
+
+} // namespace
+
+/*
+ * Called right before the event loop starts so that backend and renderer
+ * setup still happen at normal priority.
+ */
+void kristal_realtime_init(void) {
+	apply_memory_lock();
+	apply_realtime_scheduling();
+}
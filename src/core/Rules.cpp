@@ -79,6 +79,8 @@ void server_apply_window_rules(KristalView *view, const char *title, const char
 		int rule_workspace = 0;
 		bool rule_floating = false;
 		bool floating_set = false;
+		bool rule_frame_exempt = false;
+		bool frame_exempt_set = false;
 
 		std::stringstream rule_stream(rule_entry);
 		std::string token;
@@ -103,6 +105,12 @@ void server_apply_window_rules(KristalView *view, const char *title, const char
 					floating_set = true;
 					rule_floating = bool_value;
 				}
+			} else if (key == "frame_exempt") {
+				bool bool_value = false;
+				if (parse_bool(value, &bool_value)) {
+					frame_exempt_set = true;
+					rule_frame_exempt = bool_value;
+				}
 			}
 		}
 
@@ -122,6 +130,9 @@ void server_apply_window_rules(KristalView *view, const char *title, const char
 		if (floating_set) {
 			view->force_floating = rule_floating;
 		}
+		if (frame_exempt_set) {
+			view->frame_exempt = rule_frame_exempt;
+		}
 		return;
 	}
 }
@@ -6,9 +6,11 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <ctime>
 #include <signal.h>
 
 #include <wayland-client-protocol.h>
+#include <wlr/types/wlr_layer_shell_v1.h>
 
 namespace {
 
@@ -203,6 +205,24 @@ int parse_border_width() {
 	return static_cast<int>(width);
 }
 
+int parse_idle_notify_interval() {
+	const char *value = getenv("KRISTAL_IDLE_NOTIFY_INTERVAL");
+	if (value == nullptr || value[0] == '\0') {
+		return 250;
+	}
+	char *end = nullptr;
+	errno = 0;
+	const long interval = strtol(value, &end, 10);
+	if (errno != 0 || end == value || (end != nullptr && *end != '\0') || interval < 0) {
+		wlr_log(
+			WLR_ERROR,
+			"Ignoring invalid KRISTAL_IDLE_NOTIFY_INTERVAL='%s'; expected milliseconds >= 0",
+			value);
+		return 250;
+	}
+	return static_cast<int>(interval);
+}
+
 bool parse_color_hex(const char *value, float out[4]) {
 	if (value == nullptr) {
 		return false;
@@ -342,6 +362,8 @@ void reload_runtime_settings(KristalServer *server) {
 		server->workspace_layouts[i] = server->window_layout_mode;
 	}
 	server->border_width = parse_border_width();
+	server->idle_activity_interval_ms = parse_idle_notify_interval();
+	kristal_log_reload();
 	parse_border_color("KRISTAL_BORDER_FOCUSED", default_focused, server->border_color_focused);
 	parse_border_color(
 		"KRISTAL_BORDER_UNFOCUSED",
@@ -368,8 +390,44 @@ int handle_sighup(int /*signal_number*/, void *data) {
 	return 0;
 }
 
+int handle_terminate(int signal_number, void *data) {
+	auto *server = static_cast<KristalServer *>(data);
+	wlr_log(WLR_INFO, "Received signal %d, shutting down", signal_number);
+	wl_display_terminate(server->display);
+	return 0;
+}
+
+int handle_sigusr1(int /*signal_number*/, void *data) {
+	server_dump_diagnostics(static_cast<KristalServer *>(data));
+	return 0;
+}
+
+int handle_sigusr2(int /*signal_number*/, void *data) {
+	server_profile_toggle(static_cast<KristalServer *>(data));
+	return 0;
+}
+
 } // namespace
 
+uint64_t kristal_now_ns() {
+	timespec now{};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return static_cast<uint64_t>(now.tv_sec) * 1000000000ull +
+		static_cast<uint64_t>(now.tv_nsec);
+}
+
+void server_dump_diagnostics(KristalServer *server) {
+	wlr_log(WLR_INFO, "diagnostics dump requested");
+	server_startup_dump(server);
+	server_watchdog_dump(server);
+	server_metrics_dump(server);
+	server_clients_dump(server);
+	server_damage_debug_dump(server);
+	server_frame_policy_dump(server);
+	kristal_log_dump();
+	server_latency_dump(server);
+}
+
 KristalCompositor::KristalCompositor() = default;
 
 void KristalCompositor::Create() {
@@ -385,25 +443,35 @@ int KristalCompositor::Run(const std::string &startup_cmd) {
         return 1;
     }
 
-	wlr_log_init(WLR_DEBUG, nullptr);
+	kristal_startup_begin();
+	kristal_log_init();
 
 	const std::string config_path = resolve_config_path();
 	if (load_config_file(config_path)) {
 		wlr_log(WLR_INFO, "Loaded config: %s", config_path.c_str());
 	}
+	kristal_log_reload();
+	kristal_startup_mark("config");
 
+	kristal_input_replay_configure_backend();
     CreateDisplay();
+	kristal_startup_mark("display");
     CreateBackend();
+	kristal_startup_mark("backend");
     CreateRenderer();
 
     wlr_renderer_init_wl_display(components->renderer, components->display);
+	kristal_startup_mark("renderer");
 
     CreateAllocator();
+	kristal_startup_mark("allocator");
 
     components->compositor = wlr_compositor_create(
 		components->display, 5, components->renderer);
 	wlr_subcompositor_create(components->display);
+	server_clients_init(reinterpret_cast<KristalServer *>(components.get()));
 	wlr_data_device_manager_create(components->display);
+	kristal_startup_mark("compositor");
 
     CreateOutputLayer();
 	components->output_scale = parse_output_scale();
@@ -448,10 +516,11 @@ int KristalCompositor::Run(const std::string &startup_cmd) {
 		wlr_xdg_output_manager_v1_create(components->display, components->output_layout);
 	components->fractional_scale_mgr =
 		wlr_fractional_scale_manager_v1_create(components->display, 1);
+	kristal_startup_mark("output-layout");
 
     wl_list_init(&components->outputs);
 
-    components->new_output.notify = server_new_output;
+    components->new_output.notify = KRISTAL_PROFILED(server_new_output);
 
     wl_signal_add(&components->backend->events.new_output, &components->new_output);
 
@@ -459,36 +528,58 @@ int KristalCompositor::Run(const std::string &startup_cmd) {
     components->scene = wlr_scene_create();
 	components->scene_layout = wlr_scene_attach_output_layout(
 		components->scene, components->output_layout);
-
-	/* Set up xdg-shell version 3. The xdg-shell is a Wayland protocol which is
-	 * used for application windows. For more detail on shells, refer to
+	/* One tree per layer-shell layer: background and bottom sit below the
+	 * views, top and overlay above them. All five are switched off as a
+	 * whole while the session is locked. */
+	components->layer_trees[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND] =
+		wlr_scene_tree_create(&components->scene->tree);
+	components->layer_trees[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM] =
+		wlr_scene_tree_create(&components->scene->tree);
+	components->view_tree = wlr_scene_tree_create(&components->scene->tree);
+	components->layer_trees[ZWLR_LAYER_SHELL_V1_LAYER_TOP] =
+		wlr_scene_tree_create(&components->scene->tree);
+	components->layer_trees[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY] =
+		wlr_scene_tree_create(&components->scene->tree);
+	/* Minimized and stashed scratchpad views are parked here, disabled,
+	 * with their surfaces and buffers intact. */
+	components->retained_tree = wlr_scene_tree_create(&components->scene->tree);
+	wlr_scene_node_set_enabled(&components->retained_tree->node, false);
+	server_hud_init(reinterpret_cast<KristalServer *>(components.get()));
+
+	/* Set up xdg-shell version 6, the first with the suspended toplevel
+	 * state. The xdg-shell is a Wayland protocol which is used for
+	 * application windows. For more detail on shells, refer to
 	 * https://drewdevault.com/2018/07/29/Wayland-shells.html.
 	 */
 	wl_list_init(&components->views);
-	components->xdg_shell = wlr_xdg_shell_create(components->display, 3);
-	components->new_xdg_toplevel.notify = server_new_xdg_toplevel;
+	components->xdg_shell = wlr_xdg_shell_create(components->display, 6);
+	components->new_xdg_toplevel.notify = KRISTAL_PROFILED(server_new_xdg_toplevel);
 	wl_signal_add(&components->xdg_shell->events.new_toplevel,
 		&components->new_xdg_toplevel);
-	components->new_xdg_popup.notify = server_new_xdg_popup;
+	components->new_xdg_popup.notify = KRISTAL_PROFILED(server_new_xdg_popup);
 	wl_signal_add(&components->xdg_shell->events.new_popup,
 		&components->new_xdg_popup);
+	kristal_startup_mark("xdg-shell");
 #ifdef KRISTAL_HAVE_LAYER_SHELL
 	components->layer_shell = wlr_layer_shell_v1_create(components->display, 4);
-	components->new_layer_surface.notify = server_new_layer_surface;
+	components->new_layer_surface.notify = KRISTAL_PROFILED(server_new_layer_surface);
 	wl_signal_add(&components->layer_shell->events.new_surface,
 		&components->new_layer_surface);
 	wl_list_init(&components->layer_surfaces);
 #else
 	components->layer_shell = nullptr;
 #endif
+	kristal_startup_mark("layer-shell");
 	components->decoration_mgr = wlr_xdg_decoration_manager_v1_create(components->display);
-	components->new_toplevel_decoration.notify = server_new_toplevel_decoration;
+	components->new_toplevel_decoration.notify = KRISTAL_PROFILED(server_new_toplevel_decoration);
 	wl_signal_add(&components->decoration_mgr->events.new_toplevel_decoration,
 		&components->new_toplevel_decoration);
+	kristal_startup_mark("xdg-decoration");
 	components->activation_mgr = wlr_xdg_activation_v1_create(components->display);
-	components->request_activate.notify = server_request_activate;
+	components->request_activate.notify = KRISTAL_PROFILED(server_request_activate);
 	wl_signal_add(&components->activation_mgr->events.request_activate,
 		&components->request_activate);
+	kristal_startup_mark("xdg-activation");
 
 	/*
 	 * Creates a cursor, which is a wlroots utility for tracking the cursor
@@ -502,6 +593,11 @@ int KristalCompositor::Run(const std::string &startup_cmd) {
 	 * images are available at all scale factors on the screen (necessary for
 	 * HiDPI support). */
 	components->cursor_mgr = wlr_xcursor_manager_create(nullptr, 24);
+	components->cursor_image_source = CURSOR_IMAGE_NONE;
+	components->cursor_image_name[0] = '\0';
+	components->cursor_image_surface = nullptr;
+	wl_list_init(&components->cursor_image_surface_destroy.link);
+	kristal_startup_mark("cursor");
 
 	/*
 	 * wlr_cursor *only* displays an image on screen. It does not move around
@@ -514,52 +610,52 @@ int KristalCompositor::Run(const std::string &startup_cmd) {
 	 * And more comments are sprinkled throughout the notify functions above.
 	 */
 	components->cursor_mode = CURSOR_PASSTHROUGH;
-	components->cursor_motion.notify = server_cursor_motion;
+	components->cursor_motion.notify = KRISTAL_PROFILED(server_cursor_motion);
 	wl_signal_add(&components->cursor->events.motion, &components->cursor_motion);
-	components->cursor_motion_absolute.notify = server_cursor_motion_absolute;
+	components->cursor_motion_absolute.notify = KRISTAL_PROFILED(server_cursor_motion_absolute);
 	wl_signal_add(&components->cursor->events.motion_absolute,
 			&components->cursor_motion_absolute);
-	components->cursor_button.notify = server_cursor_button;
+	components->cursor_button.notify = KRISTAL_PROFILED(server_cursor_button);
 	wl_signal_add(&components->cursor->events.button, &components->cursor_button);
-	components->cursor_axis.notify = server_cursor_axis;
+	components->cursor_axis.notify = KRISTAL_PROFILED(server_cursor_axis);
 	wl_signal_add(&components->cursor->events.axis, &components->cursor_axis);
-	components->cursor_frame.notify = server_cursor_frame;
+	components->cursor_frame.notify = KRISTAL_PROFILED(server_cursor_frame);
 	wl_signal_add(&components->cursor->events.frame, &components->cursor_frame);
-	components->cursor_swipe_begin.notify = server_cursor_swipe_begin;
+	components->cursor_swipe_begin.notify = KRISTAL_PROFILED(server_cursor_swipe_begin);
 	wl_signal_add(&components->cursor->events.swipe_begin, &components->cursor_swipe_begin);
-	components->cursor_swipe_update.notify = server_cursor_swipe_update;
+	components->cursor_swipe_update.notify = KRISTAL_PROFILED(server_cursor_swipe_update);
 	wl_signal_add(&components->cursor->events.swipe_update, &components->cursor_swipe_update);
-	components->cursor_swipe_end.notify = server_cursor_swipe_end;
+	components->cursor_swipe_end.notify = KRISTAL_PROFILED(server_cursor_swipe_end);
 	wl_signal_add(&components->cursor->events.swipe_end, &components->cursor_swipe_end);
-	components->cursor_pinch_begin.notify = server_cursor_pinch_begin;
+	components->cursor_pinch_begin.notify = KRISTAL_PROFILED(server_cursor_pinch_begin);
 	wl_signal_add(&components->cursor->events.pinch_begin, &components->cursor_pinch_begin);
-	components->cursor_pinch_update.notify = server_cursor_pinch_update;
+	components->cursor_pinch_update.notify = KRISTAL_PROFILED(server_cursor_pinch_update);
 	wl_signal_add(&components->cursor->events.pinch_update, &components->cursor_pinch_update);
-	components->cursor_pinch_end.notify = server_cursor_pinch_end;
+	components->cursor_pinch_end.notify = KRISTAL_PROFILED(server_cursor_pinch_end);
 	wl_signal_add(&components->cursor->events.pinch_end, &components->cursor_pinch_end);
-	components->cursor_hold_begin.notify = server_cursor_hold_begin;
+	components->cursor_hold_begin.notify = KRISTAL_PROFILED(server_cursor_hold_begin);
 	wl_signal_add(&components->cursor->events.hold_begin, &components->cursor_hold_begin);
-	components->cursor_hold_end.notify = server_cursor_hold_end;
+	components->cursor_hold_end.notify = KRISTAL_PROFILED(server_cursor_hold_end);
 	wl_signal_add(&components->cursor->events.hold_end, &components->cursor_hold_end);
-	components->cursor_touch_down.notify = server_cursor_touch_down;
+	components->cursor_touch_down.notify = KRISTAL_PROFILED(server_cursor_touch_down);
 	wl_signal_add(&components->cursor->events.touch_down, &components->cursor_touch_down);
-	components->cursor_touch_up.notify = server_cursor_touch_up;
+	components->cursor_touch_up.notify = KRISTAL_PROFILED(server_cursor_touch_up);
 	wl_signal_add(&components->cursor->events.touch_up, &components->cursor_touch_up);
-	components->cursor_touch_motion.notify = server_cursor_touch_motion;
+	components->cursor_touch_motion.notify = KRISTAL_PROFILED(server_cursor_touch_motion);
 	wl_signal_add(&components->cursor->events.touch_motion, &components->cursor_touch_motion);
-	components->cursor_touch_cancel.notify = server_cursor_touch_cancel;
+	components->cursor_touch_cancel.notify = KRISTAL_PROFILED(server_cursor_touch_cancel);
 	wl_signal_add(&components->cursor->events.touch_cancel, &components->cursor_touch_cancel);
-	components->cursor_touch_frame.notify = server_cursor_touch_frame;
+	components->cursor_touch_frame.notify = KRISTAL_PROFILED(server_cursor_touch_frame);
 	wl_signal_add(&components->cursor->events.touch_frame, &components->cursor_touch_frame);
-	components->cursor_tablet_axis.notify = server_cursor_tablet_axis;
+	components->cursor_tablet_axis.notify = KRISTAL_PROFILED(server_cursor_tablet_axis);
 	wl_signal_add(&components->cursor->events.tablet_tool_axis, &components->cursor_tablet_axis);
-	components->cursor_tablet_proximity.notify = server_cursor_tablet_proximity;
+	components->cursor_tablet_proximity.notify = KRISTAL_PROFILED(server_cursor_tablet_proximity);
 	wl_signal_add(
 		&components->cursor->events.tablet_tool_proximity,
 		&components->cursor_tablet_proximity);
-	components->cursor_tablet_tip.notify = server_cursor_tablet_tip;
+	components->cursor_tablet_tip.notify = KRISTAL_PROFILED(server_cursor_tablet_tip);
 	wl_signal_add(&components->cursor->events.tablet_tool_tip, &components->cursor_tablet_tip);
-	components->cursor_tablet_button.notify = server_cursor_tablet_button;
+	components->cursor_tablet_button.notify = KRISTAL_PROFILED(server_cursor_tablet_button);
 	wl_signal_add(
 		&components->cursor->events.tablet_tool_button,
 		&components->cursor_tablet_button);
@@ -574,81 +670,145 @@ int KristalCompositor::Run(const std::string &startup_cmd) {
 	wl_list_init(&components->tablets);
 	wl_list_init(&components->tablet_tools);
 	wl_list_init(&components->switches);
-	components->new_input.notify = server_new_input;
+	components->new_input.notify = KRISTAL_PROFILED(server_new_input);
 	wl_signal_add(&components->backend->events.new_input, &components->new_input);
 	components->seat = wlr_seat_create(components->display, "seat0");
-	components->request_cursor.notify = seat_request_cursor;
+	components->request_cursor.notify = KRISTAL_PROFILED(seat_request_cursor);
 	wl_signal_add(&components->seat->events.request_set_cursor,
 			&components->request_cursor);
-	components->request_set_selection.notify = seat_request_set_selection;
+	components->request_set_selection.notify = KRISTAL_PROFILED(seat_request_set_selection);
 	wl_signal_add(&components->seat->events.request_set_selection,
 			&components->request_set_selection);
+	kristal_startup_mark("seat");
 	components->primary_selection_mgr =
 		wlr_primary_selection_v1_device_manager_create(components->display);
+	kristal_startup_mark("primary-selection");
 	components->data_control_mgr =
 		wlr_data_control_manager_v1_create(components->display);
+	kristal_startup_mark("data-control");
 	components->session_lock_mgr =
 		wlr_session_lock_manager_v1_create(components->display);
 	components->session_lock = nullptr;
 	components->session_locked = false;
 	components->lock_scene = nullptr;
 	wl_list_init(&components->lock_surfaces);
-	components->new_session_lock.notify = server_new_session_lock;
+	components->new_session_lock.notify = KRISTAL_PROFILED(server_new_session_lock);
 	wl_signal_add(
 		&components->session_lock_mgr->events.new_lock,
 		&components->new_session_lock);
+	kristal_startup_mark("session-lock");
 	components->screencopy_mgr = wlr_screencopy_manager_v1_create(components->display);
+	kristal_startup_mark("screencopy");
 	components->virtual_keyboard_mgr =
 		wlr_virtual_keyboard_manager_v1_create(components->display);
+	components->new_virtual_keyboard.notify = KRISTAL_PROFILED(server_new_virtual_keyboard);
+	wl_signal_add(
+		&components->virtual_keyboard_mgr->events.new_virtual_keyboard,
+		&components->new_virtual_keyboard);
+	kristal_startup_mark("virtual-keyboard");
+	components->virtual_pointer_mgr =
+		wlr_virtual_pointer_manager_v1_create(components->display);
+	components->new_virtual_pointer.notify = KRISTAL_PROFILED(server_new_virtual_pointer);
+	wl_signal_add(
+		&components->virtual_pointer_mgr->events.new_virtual_pointer,
+		&components->new_virtual_pointer);
+	kristal_startup_mark("virtual-pointer");
 	components->text_input_mgr =
 		wlr_text_input_manager_v3_create(components->display);
-	components->input_method_mgr =
-		wlr_input_method_manager_v2_create(components->display);
-	components->input_method = nullptr;
 	components->active_text_input = nullptr;
-	components->foreign_toplevel_mgr =
-		wlr_foreign_toplevel_manager_v1_create(components->display);
-	components->new_text_input.notify = server_new_text_input;
+	components->new_text_input.notify = KRISTAL_PROFILED(server_new_text_input);
 	wl_signal_add(&components->text_input_mgr->events.text_input,
 		&components->new_text_input);
-	components->new_input_method.notify = server_new_input_method;
+	kristal_startup_mark("text-input");
+	components->input_method_mgr =
+		wlr_input_method_manager_v2_create(components->display);
+	components->input_method = nullptr;
+	components->new_input_method.notify = KRISTAL_PROFILED(server_new_input_method);
 	wl_signal_add(&components->input_method_mgr->events.input_method,
 		&components->new_input_method);
+	kristal_startup_mark("input-method");
+	components->foreign_toplevel_mgr =
+		wlr_foreign_toplevel_manager_v1_create(components->display);
+	kristal_startup_mark("foreign-toplevel");
 	components->pointer_constraints = wlr_pointer_constraints_v1_create(components->display);
-	components->new_pointer_constraint.notify = server_new_pointer_constraint;
+	components->new_pointer_constraint.notify = KRISTAL_PROFILED(server_new_pointer_constraint);
 	wl_signal_add(
 		&components->pointer_constraints->events.new_constraint,
 		&components->new_pointer_constraint);
+	kristal_startup_mark("pointer-constraints");
 	components->relative_pointer_mgr =
 		wlr_relative_pointer_manager_v1_create(components->display);
+	kristal_startup_mark("relative-pointer");
 	components->pointer_gestures = wlr_pointer_gestures_v1_create(components->display);
+	kristal_startup_mark("pointer-gestures");
 	components->idle_notifier = wlr_idle_notifier_v1_create(components->display);
+	components->idle_activity_interval_ms = parse_idle_notify_interval();
+	server_init_idle_activity(reinterpret_cast<KristalServer *>(components.get()));
+	kristal_startup_mark("idle-notify");
 	components->idle_inhibit_mgr = wlr_idle_inhibit_v1_create(components->display);
-	components->new_idle_inhibitor.notify = server_new_idle_inhibitor;
+	components->new_idle_inhibitor.notify = KRISTAL_PROFILED(server_new_idle_inhibitor);
 	wl_signal_add(
 		&components->idle_inhibit_mgr->events.new_inhibitor,
 		&components->new_idle_inhibitor);
+	kristal_startup_mark("idle-inhibit");
 	components->tablet_manager = wlr_tablet_v2_create(components->display);
+	kristal_startup_mark("tablet");
 	components->output_manager = wlr_output_manager_v1_create(components->display);
-	components->output_manager_apply.notify = server_output_manager_apply;
+	components->output_manager_apply.notify = KRISTAL_PROFILED(server_output_manager_apply);
 	wl_signal_add(&components->output_manager->events.apply,
 		&components->output_manager_apply);
-	components->output_manager_test.notify = server_output_manager_test;
+	components->output_manager_test.notify = KRISTAL_PROFILED(server_output_manager_test);
 	wl_signal_add(&components->output_manager->events.test,
 		&components->output_manager_test);
+	kristal_startup_mark("output-management");
 	components->output_power_mgr =
 		wlr_output_power_manager_v1_create(components->display);
-	components->output_power_set_mode.notify = server_output_power_set_mode;
+	components->output_power_set_mode.notify = KRISTAL_PROFILED(server_output_power_set_mode);
 	wl_signal_add(&components->output_power_mgr->events.set_mode,
 		&components->output_power_set_mode);
+	kristal_startup_mark("output-power");
 	components->gamma_control_mgr =
 		wlr_gamma_control_manager_v1_create(components->display);
+	kristal_startup_mark("gamma-control");
 
 	wl_event_loop_add_signal(
 		wl_display_get_event_loop(components->display),
 		SIGHUP,
 		handle_sighup,
 		components.get());
+	server_launcher_init(reinterpret_cast<KristalServer *>(components.get()));
+	server_cgroup_init(reinterpret_cast<KristalServer *>(components.get()));
+	wl_event_loop_add_signal(
+		wl_display_get_event_loop(components->display),
+		SIGUSR1,
+		handle_sigusr1,
+		components.get());
+	server_latency_init(reinterpret_cast<KristalServer *>(components.get()));
+	server_perf_init(reinterpret_cast<KristalServer *>(components.get()));
+	server_frame_clock_init(reinterpret_cast<KristalServer *>(components.get()));
+	server_profile_init(reinterpret_cast<KristalServer *>(components.get()));
+	server_watchdog_init(reinterpret_cast<KristalServer *>(components.get()));
+	server_metrics_init(reinterpret_cast<KristalServer *>(components.get()));
+	server_damage_debug_init(reinterpret_cast<KristalServer *>(components.get()));
+	server_frame_policy_init(reinterpret_cast<KristalServer *>(components.get()));
+	server_power_init(reinterpret_cast<KristalServer *>(components.get()));
+	wl_event_loop_add_signal(
+		wl_display_get_event_loop(components->display),
+		SIGUSR2,
+		handle_sigusr2,
+		components.get());
+	wl_event_loop_add_signal(
+		wl_display_get_event_loop(components->display),
+		SIGTERM,
+		handle_terminate,
+		components.get());
+	wl_event_loop_add_signal(
+		wl_display_get_event_loop(components->display),
+		SIGINT,
+		handle_terminate,
+		components.get());
+	server_input_record_init(reinterpret_cast<KristalServer *>(components.get()));
+	kristal_startup_mark("subsystems");
 	components->active_constraint = nullptr;
 	components->focused_surface = nullptr;
 	components->grabbed_xwayland = nullptr;
@@ -662,62 +822,102 @@ int KristalCompositor::Run(const std::string &startup_cmd) {
 	components->xwayland = wlr_xwayland_create(
 		components->display, components->compositor, true);
 	if (components->xwayland != nullptr) {
-		components->xwayland_ready.notify = server_xwayland_ready;
+		components->xwayland_ready.notify = KRISTAL_PROFILED(server_xwayland_ready);
 		wl_signal_add(&components->xwayland->events.ready, &components->xwayland_ready);
-		components->xwayland_new_surface.notify = server_new_xwayland_surface;
+		components->xwayland_new_surface.notify = KRISTAL_PROFILED(server_new_xwayland_surface);
 		wl_signal_add(
 			&components->xwayland->events.new_surface,
 			&components->xwayland_new_surface);
 		wlr_xwayland_set_seat(components->xwayland, components->seat);
 	}
 #endif
-
-	/* Add a Unix socket to the Wayland display. */
-	const char *socket = wl_display_add_socket_auto(components->display);
+	kristal_startup_mark("xwayland");
+
+	/* Add a Unix socket to the Wayland display. KRISTAL_SOCKET pins the name,
+	 * which lets harnesses connect without parsing the log. */
+	const char *socket = getenv("KRISTAL_SOCKET");
+	if (socket != nullptr && socket[0] != '\0') {
+		if (wl_display_add_socket(components->display, socket) != 0) {
+			wlr_log(WLR_ERROR, "failed to add socket KRISTAL_SOCKET=%s", socket);
+			socket = nullptr;
+		}
+	} else {
+		socket = wl_display_add_socket_auto(components->display);
+	}
 	if (!socket) {
+		server_power_finish(reinterpret_cast<KristalServer *>(components.get()));
+		server_frame_policy_finish(reinterpret_cast<KristalServer *>(components.get()));
+		server_clients_finish(reinterpret_cast<KristalServer *>(components.get()));
+		server_metrics_finish(reinterpret_cast<KristalServer *>(components.get()));
+		server_watchdog_finish(reinterpret_cast<KristalServer *>(components.get()));
 		wlr_backend_destroy(components->backend);
+		kristal_log_finish();
 		return 1;
 	}
+	kristal_startup_mark("socket");
 
 	/* Start the backend. This will enumerate outputs and inputs, become the DRM
 	 * master, etc */
 	if (!wlr_backend_start(components->backend)) {
+		server_power_finish(reinterpret_cast<KristalServer *>(components.get()));
+		server_frame_policy_finish(reinterpret_cast<KristalServer *>(components.get()));
+		server_clients_finish(reinterpret_cast<KristalServer *>(components.get()));
+		server_metrics_finish(reinterpret_cast<KristalServer *>(components.get()));
+		server_watchdog_finish(reinterpret_cast<KristalServer *>(components.get()));
 		wlr_backend_destroy(components->backend);
 		wl_display_destroy(components->display);
+		kristal_log_finish();
 		return 1;
 	}
+	kristal_startup_mark("backend-start");
 
 	/* Set the WAYLAND_DISPLAY environment variable to our socket and run the
 	 * startup command if requested. */
 	setenv("WAYLAND_DISPLAY", socket, 1);
 	if (!startup_cmd.empty()) {
-		if (fork() == 0) {
-			execl("/bin/sh", "/bin/sh", "-c", startup_cmd.c_str(), nullptr);
-		}
+		server_spawn_command(
+			reinterpret_cast<KristalServer *>(components.get()),
+			startup_cmd.c_str());
 	}
+	server_input_replay_start(reinterpret_cast<KristalServer *>(components.get()));
 	/* Run the Wayland event loop. This does not return until you exit the
 	 * compositor. Starting the backend rigged up all of the necessary event
 	 * loop configuration to listen to libinput events, DRM events, generate
 	 * frame events at the refresh rate, and so on. */
 	wlr_log(WLR_INFO, "Running Wayland compositor on WAYLAND_DISPLAY=%s",
 			socket);
+	kristal_realtime_init();
 	wl_display_run(components->display);
+	server_input_replay_finish(reinterpret_cast<KristalServer *>(components.get()));
+	server_input_record_finish(reinterpret_cast<KristalServer *>(components.get()));
+	server_perf_finish(reinterpret_cast<KristalServer *>(components.get()));
+	server_frame_clock_finish(reinterpret_cast<KristalServer *>(components.get()));
+	server_power_finish(reinterpret_cast<KristalServer *>(components.get()));
+	server_frame_policy_finish(reinterpret_cast<KristalServer *>(components.get()));
+	server_clients_finish(reinterpret_cast<KristalServer *>(components.get()));
+	server_metrics_finish(reinterpret_cast<KristalServer *>(components.get()));
+	server_watchdog_finish(reinterpret_cast<KristalServer *>(components.get()));
+	server_profile_finish(reinterpret_cast<KristalServer *>(components.get()));
 
 	/* Once wl_display_run returns, we destroy all clients then shut down the
 	 * server. */
 	wl_display_destroy_clients(components->display);
+	server_hud_finish(reinterpret_cast<KristalServer *>(components.get()));
 	wlr_scene_node_destroy(&components->scene->tree.node);
 #ifdef KRISTAL_HAVE_XWAYLAND
 	if (components->xwayland != nullptr) {
 		wlr_xwayland_destroy(components->xwayland);
 	}
 #endif
+	server_launcher_finish(reinterpret_cast<KristalServer *>(components.get()));
+	server_latency_finish(reinterpret_cast<KristalServer *>(components.get()));
 	wlr_xcursor_manager_destroy(components->cursor_mgr);
 	wlr_cursor_destroy(components->cursor);
 	wlr_allocator_destroy(components->allocator);
 	wlr_renderer_destroy(components->renderer);
 	wlr_backend_destroy(components->backend);
 	wl_display_destroy(components->display);
+	kristal_log_finish();
 
     return 0;
 }
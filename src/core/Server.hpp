@@ -137,6 +137,36 @@ struct ServerComponents {
 #endif
 	int current_workspace;
 	int workspace_count;
+	enum CursorImageSource cursor_image_source;
+	char cursor_image_name[64];
+	Surface *cursor_image_surface;
+	int32_t cursor_image_hotspot_x;
+	int32_t cursor_image_hotspot_y;
+	Listener cursor_image_surface_destroy;
+	struct wl_event_source *idle_activity_timer;
+	int idle_activity_interval_ms;
+	bool idle_activity_pending;
+	bool idle_activity_armed;
+	List processes;
+	struct wl_event_source *sigchld_source;
+	bool cgroup_enabled;
+	bool cgroup_weights_enabled;
+	char cgroup_root[256];
+	int cgroup_focused_weight;
+	int cgroup_visible_weight;
+	int cgroup_hidden_weight;
+	Listener new_virtual_keyboard;
+	VirtualPointerManager *virtual_pointer_mgr;
+	Listener new_virtual_pointer;
+	SceneTree *hud_tree;
+	List clients;
+	size_t client_count;
+	Listener new_surface;
+	SceneTree *retained_tree;
+	SceneTree *layer_trees[4];
+	SceneTree *view_tree;
+	bool cgroup_weights_dirty;
+	Listener new_client;
 };
 
 class KristalCompositor 
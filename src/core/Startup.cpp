@@ -0,0 +1,90 @@
+#include "core/internal.h"
+
+/*
+ * Startup phase timing. Run() marks the end of each phase; the first output
+ * frame closes the timeline, logs the breakdown and kicks off the work that
+ * was deferred past time-to-first-frame (xcursor theme loading).
+ */
+
+namespace {
+
+constexpr size_t kMaxPhases = 48;
+
+struct StartupPhase {
+	const char *name;
+	uint64_t duration_ns;
+};
+
+struct StartupTimeline {
+	uint64_t begin_ns;
+	uint64_t last_ns;
+	uint64_t first_frame_ns;
+	uint64_t deferred_ns;
+	StartupPhase phases[kMaxPhases];
+	size_t phase_count;
+	bool complete;
+};
+
+StartupTimeline startup{};
+
+double ms(uint64_t ns) {
+	return static_cast<double>(ns) / 1000000.0;
+}
+
+void log_breakdown() {
+	wlr_log(WLR_INFO, "Startup: first frame after %.2f ms", ms(startup.first_frame_ns - startup.begin_ns));
+	for (size_t i = 0; i < startup.phase_count; ++i) {
+		wlr_log(WLR_INFO, "Startup:   %-20s %8.2f ms", startup.phases[i].name, ms(startup.phases[i].duration_ns));
+	}
+}
+
+void run_deferred(void *data) {
+	auto *server = static_cast<KristalServer *>(data);
+	const uint64_t start = kristal_now_ns();
+	server_cursor_load_deferred_themes(server);
+	startup.deferred_ns = kristal_now_ns() - start;
+	wlr_log(
+		WLR_INFO,
+		"Startup: deferred work took %.2f ms after the first frame",
+		ms(startup.deferred_ns));
+}
+
+} // namespace
+
+void kristal_startup_begin(void) {
+	startup = StartupTimeline{};
+	startup.begin_ns = kristal_now_ns();
+	startup.last_ns = startup.begin_ns;
+}
+
+void kristal_startup_mark(const char *phase) {
+	const uint64_t now = kristal_now_ns();
+	if (!startup.complete && startup.phase_count < kMaxPhases) {
+		startup.phases[startup.phase_count++] = StartupPhase{phase, now - startup.last_ns};
+	}
+	startup.last_ns = now;
+}
+
+bool kristal_startup_complete(void) {
+	return startup.complete;
+}
+
+void server_startup_first_frame(KristalServer *server) {
+	if (startup.complete) {
+		return;
+	}
+	kristal_startup_mark("first-frame");
+	startup.complete = true;
+	startup.first_frame_ns = startup.last_ns;
+	log_breakdown();
+	wl_event_loop_add_idle(wl_display_get_event_loop(server->display), run_deferred, server);
+}
+
+void server_startup_dump(KristalServer * /*server*/) {
+	if (!startup.complete) {
+		wlr_log(WLR_INFO, "Startup: no frame presented yet");
+		return;
+	}
+	log_breakdown();
+	wlr_log(WLR_INFO, "Startup: deferred work %.2f ms", ms(startup.deferred_ns));
+}
@@ -0,0 +1,243 @@
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <signal.h>
+
+#include "core/internal.h"
+
+/*
+ * Event-loop stall watchdog (KRISTAL_WATCHDOG_MS).
+ *
+ * A loop timer refreshes a heartbeat every quarter threshold. A separate
+ * thread checks it; when the heartbeat is older than the threshold the loop
+ * is stuck inside some callback, and the profiling-zone context says which
+ * one. Stalls are logged when detected and when the loop recovers, and
+ * counted per handler for the SIGUSR1 dump.
+ */
+
+namespace {
+
+constexpr size_t kMaxHandlers = 64;
+constexpr uint64_t kMinIntervalNs = 5000000ull;
+
+struct StallCounter {
+	const char *handler;
+	uint32_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+};
+
+struct Watchdog {
+	bool enabled;
+	uint64_t threshold_ns;
+	uint64_t interval_ns;
+	wl_event_source *heartbeat_timer;
+	std::atomic<uint64_t> heartbeat_ns;
+	std::atomic<const char *> zone_name;
+	std::atomic<uint64_t> zone_start_ns;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stop;
+	StallCounter counters[kMaxHandlers];
+	size_t counter_count;
+	uint32_t stalls;
+};
+
+Watchdog watchdog;
+
+const char *const kUnknownHandler = "(outside profiled handlers)";
+
+double ms(uint64_t ns) {
+	return static_cast<double>(ns) / 1000000.0;
+}
+
+bool parse_watchdog_threshold(uint64_t *threshold_ns) {
+	const char *value = getenv("KRISTAL_WATCHDOG_MS");
+	if (value == nullptr || value[0] == '\0' || strcmp(value, "0") == 0) {
+		return false;
+	}
+	char *end = nullptr;
+	errno = 0;
+	const long threshold = strtol(value, &end, 10);
+	if (errno != 0 || end == value || (end != nullptr && *end != '\0') || threshold <= 0) {
+		wlr_log(
+			WLR_ERROR,
+			"Ignoring invalid KRISTAL_WATCHDOG_MS='%s'; expected a positive number of milliseconds",
+			value);
+		return false;
+	}
+	*threshold_ns = static_cast<uint64_t>(threshold) * 1000000ull;
+	return true;
+}
+
+int heartbeat(void * /*data*/) {
+	watchdog.heartbeat_ns.store(kristal_now_ns(), std::memory_order_relaxed);
+	wl_event_source_timer_update(
+		watchdog.heartbeat_timer,
+		static_cast<int>(watchdog.interval_ns / 1000000ull));
+	return 0;
+}
+
+/* Called with watchdog.mutex held. */
+void count_stall(const char *handler, uint64_t duration_ns) {
+	watchdog.stalls++;
+	StallCounter *counter = nullptr;
+	for (size_t i = 0; i < watchdog.counter_count; ++i) {
+		if (watchdog.counters[i].handler == handler) {
+			counter = &watchdog.counters[i];
+			break;
+		}
+	}
+	if (counter == nullptr) {
+		if (watchdog.counter_count == kMaxHandlers) {
+			return;
+		}
+		counter = &watchdog.counters[watchdog.counter_count++];
+		counter->handler = handler;
+	}
+	counter->count++;
+	counter->total_ns += duration_ns;
+	if (duration_ns > counter->max_ns) {
+		counter->max_ns = duration_ns;
+	}
+}
+
+void watchdog_main() {
+	std::unique_lock<std::mutex> lock(watchdog.mutex);
+	bool stalled = false;
+	const char *stall_handler = nullptr;
+	uint64_t stall_beat = 0;
+	uint64_t stall_start = 0;
+	while (!watchdog.stop) {
+		watchdog.wake.wait_for(lock, std::chrono::nanoseconds(watchdog.interval_ns));
+		if (watchdog.stop) {
+			break;
+		}
+		const uint64_t now = kristal_now_ns();
+		const uint64_t beat = watchdog.heartbeat_ns.load(std::memory_order_relaxed);
+		if (stalled) {
+			if (beat != stall_beat) {
+				/* The first heartbeat after the stall is when the loop
+				 * got back to its timers. */
+				const uint64_t duration = beat - stall_start;
+				count_stall(stall_handler, duration);
+				wlr_log(
+					WLR_ERROR,
+					"Watchdog: event loop recovered after %.1f ms stalled in %s",
+					ms(duration),
+					stall_handler);
+				stalled = false;
+			}
+			continue;
+		}
+		if (now <= beat || now - beat <= watchdog.threshold_ns) {
+			continue;
+		}
+
+		const char *zone = watchdog.zone_name.load(std::memory_order_acquire);
+		const uint64_t zone_start = watchdog.zone_start_ns.load(std::memory_order_relaxed);
+		stalled = true;
+		stall_beat = beat;
+		/* The last heartbeat can predate the stalling handler by up to
+		 * an interval; its zone start is exact. */
+		stall_start = zone != nullptr && zone_start > beat && zone_start < now ? zone_start : beat;
+		stall_handler = zone != nullptr ? zone : kUnknownHandler;
+		wlr_log(
+			WLR_ERROR,
+			"Watchdog: event loop stalled for %.1f ms in %s (handler running %.1f ms)",
+			ms(now - beat),
+			stall_handler,
+			zone != nullptr && now > zone_start ? ms(now - zone_start) : ms(now - beat));
+	}
+}
+
+} // namespace
+
+void server_watchdog_init(KristalServer *server) {
+	if (!parse_watchdog_threshold(&watchdog.threshold_ns)) {
+		return;
+	}
+	watchdog.interval_ns = watchdog.threshold_ns / 4;
+	if (watchdog.interval_ns < kMinIntervalNs) {
+		watchdog.interval_ns = kMinIntervalNs;
+	}
+	watchdog.heartbeat_timer = wl_event_loop_add_timer(
+		wl_display_get_event_loop(server->display),
+		heartbeat,
+		nullptr);
+	if (watchdog.heartbeat_timer == nullptr) {
+		wlr_log(WLR_ERROR, "Watchdog disabled: cannot create heartbeat timer");
+		return;
+	}
+	heartbeat(nullptr);
+	watchdog.stop = false;
+	watchdog.enabled = true;
+	kristal_profile_flags.fetch_or(KRISTAL_PROFILE_TRACK, std::memory_order_relaxed);
+	/* Started with every signal blocked so process-wide signals reach the
+	 * event loop's handlers instead of killing the process from here. */
+	sigset_t all;
+	sigset_t previous;
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &previous);
+	watchdog.thread = std::thread(watchdog_main);
+	pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+	wlr_log(WLR_INFO, "Watchdog: reporting event-loop stalls over %.0f ms", ms(watchdog.threshold_ns));
+}
+
+void server_watchdog_finish(KristalServer * /*server*/) {
+	if (!watchdog.enabled) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(watchdog.mutex);
+		watchdog.stop = true;
+	}
+	watchdog.wake.notify_one();
+	watchdog.thread.join();
+	kristal_profile_flags.fetch_and(
+		~static_cast<unsigned>(KRISTAL_PROFILE_TRACK),
+		std::memory_order_relaxed);
+	wl_event_source_remove(watchdog.heartbeat_timer);
+	watchdog.heartbeat_timer = nullptr;
+	watchdog.enabled = false;
+}
+
+void server_watchdog_dump(KristalServer * /*server*/) {
+	if (!watchdog.enabled) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(watchdog.mutex);
+	wlr_log(WLR_INFO, "Watchdog: %u stalls", watchdog.stalls);
+	for (size_t i = 0; i < watchdog.counter_count; ++i) {
+		const StallCounter &counter = watchdog.counters[i];
+		wlr_log(
+			WLR_INFO,
+			"Watchdog:   %s: %u stalls, total %.1f ms, max %.1f ms",
+			counter.handler,
+			counter.count,
+			ms(counter.total_ns),
+			ms(counter.max_ns));
+	}
+}
+
+void kristal_watchdog_enter(
+	const char *name,
+	uint64_t start_ns,
+	const char **parent_name,
+	uint64_t *parent_start_ns) {
+	*parent_name = watchdog.zone_name.load(std::memory_order_relaxed);
+	*parent_start_ns = watchdog.zone_start_ns.load(std::memory_order_relaxed);
+	watchdog.zone_start_ns.store(start_ns, std::memory_order_relaxed);
+	watchdog.zone_name.store(name, std::memory_order_release);
+}
+
+void kristal_watchdog_leave(const char *parent_name, uint64_t parent_start_ns) {
+	watchdog.zone_start_ns.store(parent_start_ns, std::memory_order_relaxed);
+	watchdog.zone_name.store(parent_name, std::memory_order_release);
+}
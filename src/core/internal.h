@@ -6,6 +6,7 @@ extern "C" {
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/types.h>
 
 #include <wayland-server-core.h>
 #include <wlr/backend.h>
@@ -55,6 +56,7 @@ extern "C" {
 #include <wlr/types/wlr_foreign_toplevel_management_v1.h>
 #include <wlr/types/wlr_session_lock_v1.h>
 #include <wlr/types/wlr_virtual_keyboard_v1.h>
+#include <wlr/types/wlr_virtual_pointer_v1.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_xdg_activation_v1.h>
 #include <wlr/types/wlr_xdg_decoration_v1.h>
@@ -66,6 +68,8 @@ extern "C" {
 #endif
 #include <xkbcommon/xkbcommon.h>
 
+#include "layout/Layout.h"
+
 typedef struct wlr_surface Surface;
 typedef struct wl_display Display;
 typedef struct wl_listener Listener;
@@ -79,6 +83,7 @@ typedef struct wlr_input_device InputDevice;
 typedef struct wlr_keyboard Keyboard;
 typedef struct wlr_keyboard_key_event KeyboardKeyEvent;
 typedef struct wlr_output Output;
+typedef struct wlr_output_event_present OutputEventPresent;
 typedef struct wlr_output_event_request_state OutputEventRequestState;
 typedef struct wlr_output_layout OutputLayout;
 typedef struct wlr_output_layout_output OutputLayoutOutput;
@@ -133,6 +138,9 @@ typedef struct wlr_fractional_scale_manager_v1 FractionalScaleManager;
 typedef struct wlr_primary_selection_v1_device_manager PrimarySelectionManager;
 typedef struct wlr_screencopy_manager_v1 ScreencopyManager;
 typedef struct wlr_virtual_keyboard_manager_v1 VirtualKeyboardManager;
+typedef struct wlr_virtual_keyboard_v1 VirtualKeyboard;
+typedef struct wlr_virtual_pointer_manager_v1 VirtualPointerManager;
+typedef struct wlr_virtual_pointer_v1_new_pointer_event VirtualPointerNewEvent;
 typedef struct wlr_text_input_manager_v3 TextInputManagerV3;
 typedef struct wlr_text_input_v3 TextInputV3;
 typedef struct wlr_input_method_manager_v2 InputMethodManagerV2;
@@ -148,6 +156,7 @@ typedef struct wlr_xwayland Xwayland;
 typedef struct wlr_xwayland_surface XwaylandSurface;
 typedef struct wlr_xwayland_surface_configure_event XwaylandConfigureEvent;
 typedef struct wlr_xwayland_resize_event XwaylandResizeEvent;
+typedef struct wlr_xwayland_minimize_event XwaylandMinimizeEvent;
 #endif
 
 struct wlr_layer_shell_v1;
@@ -161,6 +170,12 @@ enum CursorMode {
 	CURSOR_RESIZE,
 };
 
+enum CursorImageSource {
+	CURSOR_IMAGE_NONE,
+	CURSOR_IMAGE_XCURSOR,
+	CURSOR_IMAGE_SURFACE,
+};
+
 enum KristalViewType {
 	KRISTAL_VIEW_XDG,
 	KRISTAL_VIEW_XWAYLAND,
@@ -178,11 +193,25 @@ enum WindowPlacementMode {
 	WINDOW_PLACE_CASCADE,
 };
 
-enum WindowLayoutMode {
-	WINDOW_LAYOUT_FLOATING,
-	WINDOW_LAYOUT_STACK,
-	WINDOW_LAYOUT_GRID,
-	WINDOW_LAYOUT_MONOCLE,
+enum KristalPerfStat {
+	KRISTAL_PERF_FRAME,
+	KRISTAL_PERF_ARRANGE,
+	KRISTAL_PERF_BORDERS,
+	KRISTAL_PERF_WORKSPACE_SWITCH,
+	KRISTAL_PERF_MAP,
+	KRISTAL_PERF_LAYOUT,
+	KRISTAL_PERF_STAT_COUNT,
+};
+
+enum KristalFrameClass {
+	KRISTAL_FRAME_FOCUSED,
+	KRISTAL_FRAME_UNFOCUSED,
+	KRISTAL_FRAME_OCCLUDED,
+	KRISTAL_FRAME_HIDDEN,
+	KRISTAL_FRAME_EXEMPT,
+	KRISTAL_FRAME_THROTTLED,
+	KRISTAL_FRAME_LOCKED,
+	KRISTAL_FRAME_CLASS_COUNT,
 };
 
 typedef struct KristalServer KristalServer;
@@ -196,6 +225,9 @@ typedef struct KristalXwaylandSurface KristalXwaylandSurface;
 typedef struct KristalTablet KristalTablet;
 typedef struct KristalTabletTool KristalTabletTool;
 typedef struct KristalSwitch KristalSwitch;
+typedef struct KristalHudOutput KristalHudOutput;
+typedef struct KristalClient KristalClient;
+typedef struct KristalProcess KristalProcess;
 
 struct KristalServer {
 	Display *display;
@@ -324,6 +356,36 @@ struct KristalServer {
 #endif
 	int current_workspace;
 	int workspace_count;
+	enum CursorImageSource cursor_image_source;
+	char cursor_image_name[64];
+	Surface *cursor_image_surface;
+	int32_t cursor_image_hotspot_x;
+	int32_t cursor_image_hotspot_y;
+	Listener cursor_image_surface_destroy;
+	struct wl_event_source *idle_activity_timer;
+	int idle_activity_interval_ms;
+	bool idle_activity_pending;
+	bool idle_activity_armed;
+	List processes;
+	struct wl_event_source *sigchld_source;
+	bool cgroup_enabled;
+	bool cgroup_weights_enabled;
+	char cgroup_root[256];
+	int cgroup_focused_weight;
+	int cgroup_visible_weight;
+	int cgroup_hidden_weight;
+	Listener new_virtual_keyboard;
+	VirtualPointerManager *virtual_pointer_mgr;
+	Listener new_virtual_pointer;
+	SceneTree *hud_tree;
+	List clients;
+	size_t client_count;
+	Listener new_surface;
+	SceneTree *retained_tree;
+	SceneTree *layer_trees[4];
+	SceneTree *view_tree;
+	bool cgroup_weights_dirty;
+	Listener new_client;
 };
 
 struct KristalOutput {
@@ -333,6 +395,24 @@ struct KristalOutput {
 	Listener frame;
 	Listener request_state;
 	Listener destroy;
+	Listener latency_present;
+	uint32_t latency_commit_seq;
+	bool latency_armed;
+	bool virtual_clock;
+	bool virtual_frame_pending;
+	Listener present;
+	uint64_t metrics_frames;
+	uint64_t metrics_missed;
+	uint64_t metrics_frame_start_ns;
+	uint64_t metrics_last_present_ns;
+	bool metrics_present_pending;
+	uint64_t metrics_damage_pixels;
+	uint64_t last_frame_ns;
+	uint64_t last_damage_area;
+	KristalHudOutput *hud;
+	bool idle_off;
+	bool lid_off;
+	Box lid_box;
 };
 
 struct KristalView {
@@ -342,8 +422,22 @@ struct KristalView {
 	enum KristalViewType type;
 	int workspace;
 	bool mapped;
+	bool minimized;
+	bool scratchpad;
+	bool stashed;
+	bool suspended;
 	bool force_floating;
+	bool frame_exempt;
+	uint64_t frame_next_ns;
+	uint64_t frame_sent_ns;
+	bool geometry_pending;
+	Box pending_geometry;
+	/* The two occlusion passes' verdicts; the view is suspended while
+	 * either holds. */
+	bool covered_by_geometry;
+	bool covered_by_scene;
 	ForeignToplevelHandle *foreign_toplevel;
+	KristalProcess *process;
 };
 
 struct KristalToplevel {
@@ -359,11 +453,13 @@ struct KristalToplevel {
 	Listener map;
 	Listener unmap;
 	Listener commit;
+	Listener configure;
 	Listener destroy;
 	Listener request_move;
 	Listener request_resize;
 	Listener request_maximize;
 	Listener request_fullscreen;
+	Listener request_minimize;
 	Listener set_title;
 	Listener set_app_id;
 };
@@ -387,6 +483,7 @@ struct KristalXwaylandSurface {
 	Listener request_resize;
 	Listener request_configure;
 	Listener request_activate;
+	Listener request_minimize;
 	Listener map_request;
 	Listener set_title;
 };
@@ -444,8 +541,157 @@ struct KristalSessionLockSurface {
 	Listener destroy;
 };
 
+struct KristalProcess {
+	List link;
+	KristalServer *server;
+	pid_t pid;
+	uint64_t spawn_start_ns;
+	uint64_t spawned_ns;
+	bool mapped;
+	bool exited;
+	char command[128];
+	char cgroup_path[256];
+	int cpu_weight;
+	int pending_weight;
+};
+
+struct KristalClient {
+	List link;
+	KristalServer *server;
+	struct wl_client *client;
+	Listener destroy;
+	List tracked_surfaces;
+	pid_t pid;
+	char comm[32];
+	uint32_t surfaces;
+	uint32_t subsurfaces;
+	uint32_t popups;
+	uint64_t buffer_bytes;
+	uint64_t commits;
+	uint64_t configures;
+	uint64_t damage_pixels;
+	uint64_t texture_uploads;
+	uint64_t upload_pixels;
+	uint64_t rate_commits;
+	uint64_t rate_start_ns;
+	double commit_rate;
+	bool throttled;
+	bool disconnecting;
+	uint64_t throttle_next_ns;
+	uint64_t throttle_sent_ns;
+};
+
+uint64_t kristal_now_ns(void);
+void kristal_realtime_init(void);
+void server_dump_diagnostics(KristalServer *server);
+void server_perf_init(KristalServer *server);
+void server_perf_finish(KristalServer *server);
+uint64_t kristal_perf_begin(enum KristalPerfStat stat);
+void kristal_perf_end(enum KristalPerfStat stat, uint64_t start);
+void server_latency_init(KristalServer *server);
+void server_latency_finish(KristalServer *server);
+void server_latency_output_init(KristalOutput *output);
+void server_latency_output_finish(KristalOutput *output);
+void server_latency_input(KristalServer *server, uint32_t time_msec, Surface *surface);
+void server_latency_dump(KristalServer *server);
+void server_profile_init(KristalServer *server);
+void server_profile_finish(KristalServer *server);
+void server_profile_toggle(KristalServer *server);
+void kristal_profile_record(const char *name, uint64_t start_ns);
+void kristal_log_init(void);
+void kristal_log_reload(void);
+void kristal_log_dump(void);
+void kristal_log_finish(void);
+void server_watchdog_init(KristalServer *server);
+void server_watchdog_finish(KristalServer *server);
+void server_watchdog_dump(KristalServer *server);
+void server_metrics_init(KristalServer *server);
+void server_metrics_finish(KristalServer *server);
+void kristal_metrics_input_event(void);
+void kristal_metrics_keymap_compile(void);
+uint64_t kristal_region_area(const pixman_region32_t *region);
+uint64_t kristal_metrics_input_count(void);
+void server_metrics_dump(KristalServer *server);
+void kristal_watchdog_enter(
+	const char *name,
+	uint64_t start_ns,
+	const char **parent_name,
+	uint64_t *parent_start_ns);
+void kristal_watchdog_leave(const char *parent_name, uint64_t parent_start_ns);
+void kristal_startup_begin(void);
+void kristal_startup_mark(const char *phase);
+bool kristal_startup_complete(void);
+void server_startup_first_frame(KristalServer *server);
+void server_startup_dump(KristalServer *server);
+void server_frame_clock_init(KristalServer *server);
+void server_frame_clock_finish(KristalServer *server);
+void server_frame_clock_output_init(KristalOutput *output);
+void server_frame_clock_now(KristalOutput *output, struct timespec *out);
+bool server_frame_clock_accept_frame(KristalOutput *output);
+void server_frame_clock_frame_done(KristalOutput *output, bool drew);
+void server_hud_init(KristalServer *server);
+void server_hud_finish(KristalServer *server);
+void server_hud_output_init(KristalOutput *output);
+void server_hud_output_finish(KristalOutput *output);
+void server_hud_output_frame(KristalOutput *output);
+void server_hud_output_subtract_damage(KristalOutput *output, pixman_region32_t *damage);
+void server_hud_toggle(KristalServer *server);
+void server_hud_raise(KristalServer *server);
+void server_clients_init(KristalServer *server);
+void server_clients_finish(KristalServer *server);
+KristalClient *server_client_from_surface(Surface *surface);
+void server_client_configured(Surface *surface);
+double server_client_commit_rate(KristalClient *client);
+bool server_clients_any_throttled(void);
+bool server_client_frame_due(Surface *surface, uint64_t now_ns);
+void server_clients_dump(KristalServer *server);
+void server_clients_log_damage_ranking(KristalServer *server, size_t limit);
+void server_damage_debug_init(KristalServer *server);
+void server_damage_debug_toggle(KristalServer *server);
+void server_damage_debug_dump(KristalServer *server);
+void server_power_init(KristalServer *server);
+void server_power_finish(KristalServer *server);
+void server_power_activity(KristalServer *server);
+void server_power_update_inhibit(KristalServer *server, struct wlr_idle_inhibitor_v1 *dying);
+void server_power_request(KristalServer *server, Output *output, bool on);
+void server_power_lid(KristalServer *server, bool closed);
+void server_power_outputs_changed(KristalServer *server);
+void server_frame_policy_init(KristalServer *server);
+void server_frame_policy_finish(KristalServer *server);
+void server_frame_policy_dump(KristalServer *server);
+void server_send_frame_done(SceneOutput *scene_output, struct timespec *now);
+const char *server_frame_class_name(enum KristalFrameClass frame_class);
+void server_frame_policy_counts(enum KristalFrameClass frame_class, uint64_t *sent, uint64_t *suppressed);
+void server_input_record_init(KristalServer *server);
+void server_input_record_device(KristalServer *server, InputDevice *device);
+void server_input_record_finish(KristalServer *server);
+void kristal_input_replay_configure_backend(void);
+void server_input_replay_start(KristalServer *server);
+void server_input_replay_finish(KristalServer *server);
+void server_launcher_init(KristalServer *server);
+void server_launcher_finish(KristalServer *server);
+pid_t server_spawn_command(KristalServer *server, const char *command);
+void server_launcher_view_mapped(KristalView *view, pid_t pid);
+void server_launcher_view_unmapped(KristalView *view);
+void server_launcher_destroy_process(KristalProcess *process);
+void server_cgroup_init(KristalServer *server);
+bool server_cgroup_create_scope(KristalServer *server, char *path, size_t path_len);
+void server_cgroup_remove_scope(const char *path);
+void server_cgroup_attach(KristalProcess *process, const char *scope);
+bool server_cgroup_release(KristalProcess *process);
+KristalProcess *server_cgroup_find_process(KristalServer *server, pid_t pid);
+void server_cgroup_update_weights(KristalServer *server);
+
 void focus_toplevel(KristalToplevel *toplevel, Surface *surface);
 void reset_cursor_mode(KristalServer *server);
+void server_set_cursor_xcursor(KristalServer *server, const char *name);
+void server_set_cursor_surface(
+	KristalServer *server,
+	Surface *surface,
+	int32_t hotspot_x,
+	int32_t hotspot_y);
+void server_preload_cursor_theme(KristalServer *server, float scale);
+void server_cursor_load_deferred_themes(KristalServer *server);
 void focus_surface(KristalServer *server, Surface *surface);
 void server_apply_workspace(KristalServer *server, int workspace);
 void server_move_focused_to_workspace(KristalServer *server, int workspace);
@@ -461,6 +707,17 @@ void server_set_workspace_layout(KristalServer *server, WindowLayoutMode mode);
 void server_cycle_workspace_layout(KristalServer *server);
 void server_update_output_manager_config(KristalServer *server);
 void server_arrange_workspace(KristalServer *server);
+bool server_view_is_shown(const KristalView *view);
+KristalView *server_view_from_surface(Surface *surface);
+Surface *server_view_surface(KristalView *view);
+void server_view_update_visibility(KristalView *view);
+void server_view_set_minimized(KristalView *view, bool minimized);
+void server_minimize_focused(KristalServer *server);
+void server_scratchpad_move_focused(KristalServer *server);
+void server_scratchpad_toggle(KristalServer *server);
+void server_view_set_suspended(KristalView *view, bool suspended);
+void server_schedule_occlusion_update(KristalServer *server);
+void server_update_occlusion(KristalServer *server);
 void server_text_input_focus(KristalServer *server, Surface *surface);
 void server_register_foreign_toplevel(KristalView *view, const char *title, const char *app_id);
 void server_update_foreign_toplevel(KristalView *view, const char *title, const char *app_id);
@@ -493,7 +750,11 @@ void server_cursor_tablet_tip(Listener *listener, void *data);
 void server_cursor_tablet_button(Listener *listener, void *data);
 
 void server_new_input(Listener *listener, void *data);
+void server_new_virtual_keyboard(Listener *listener, void *data);
+void server_new_virtual_pointer(Listener *listener, void *data);
 void server_reload_input_settings(KristalServer *server);
+void server_init_idle_activity(KristalServer *server);
+void server_notify_activity(KristalServer *server);
 void server_reload_keybindings();
 void seat_request_cursor(Listener *listener, void *data);
 void seat_request_set_selection(Listener *listener, void *data);
@@ -524,3 +785,53 @@ void server_new_layer_surface(Listener *listener, void *data);
 #ifdef __cplusplus
 }
 #endif
+
+#ifdef __cplusplus
+#include <atomic>
+
+enum KristalProfileFlags {
+	KRISTAL_PROFILE_CAPTURE = 1u << 0,
+	KRISTAL_PROFILE_TRACK = 1u << 1,
+};
+
+/* Capture: a profiler capture is running. Track: the watchdog wants to know
+ * which handler the event loop is in. */
+extern std::atomic<unsigned> kristal_profile_flags;
+
+/* Times the enclosing scope into the profiler; one relaxed load when idle. */
+struct KristalProfileZone {
+	const char *name;
+	unsigned flags;
+	uint64_t start_ns;
+	const char *parent_name;
+	uint64_t parent_start_ns;
+
+	explicit KristalProfileZone(const char *zone_name)
+		: name(zone_name),
+		  flags(kristal_profile_flags.load(std::memory_order_relaxed)),
+		  start_ns(flags != 0 ? kristal_now_ns() : 0),
+		  parent_name(nullptr),
+		  parent_start_ns(0) {
+		if ((flags & KRISTAL_PROFILE_TRACK) != 0) {
+			kristal_watchdog_enter(name, start_ns, &parent_name, &parent_start_ns);
+		}
+	}
+	~KristalProfileZone() {
+		if ((flags & KRISTAL_PROFILE_TRACK) != 0) {
+			kristal_watchdog_leave(parent_name, parent_start_ns);
+		}
+		if ((flags & KRISTAL_PROFILE_CAPTURE) != 0) {
+			kristal_profile_record(name, start_ns);
+		}
+	}
+	KristalProfileZone(const KristalProfileZone &) = delete;
+	KristalProfileZone &operator=(const KristalProfileZone &) = delete;
+};
+
+/* Listener notify wrapper: `listener.notify = KRISTAL_PROFILED(handler);` */
+#define KRISTAL_PROFILED(fn) \
+	(+[](Listener *listener, void *data) { \
+		KristalProfileZone kristal_zone(#fn); \
+		fn(listener, data); \
+	})
+#endif
@@ -1,9 +1,16 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <linux/input-event-codes.h>
+#include <vector>
 
 #include "core/internal.h"
 
 namespace {
 
+/* Output scales whose xcursor themes wait for the first frame. */
+std::vector<float> deferred_cursor_scales;
+
 KristalView *desktop_view_at(
 	KristalServer *server,
 	double layout_x,
@@ -271,7 +278,7 @@ void process_cursor_motion(KristalServer *server, uint32_t time) {
 		&surface_x,
 		&surface_y);
 	if (view == nullptr) {
-		wlr_cursor_set_xcursor(server->cursor, server->cursor_mgr, "default");
+		server_set_cursor_xcursor(server, "default");
 	}
 
 	if (surface != nullptr) {
@@ -355,6 +362,21 @@ void update_pointer_constraint(KristalServer *server, Surface *surface) {
 	}
 }
 
+void clear_cursor_image_surface(KristalServer *server) {
+	if (server->cursor_image_surface == nullptr) {
+		return;
+	}
+	wl_list_remove(&server->cursor_image_surface_destroy.link);
+	wl_list_init(&server->cursor_image_surface_destroy.link);
+	server->cursor_image_surface = nullptr;
+}
+
+void cursor_image_surface_destroy(Listener *listener, void * /*data*/) {
+	KristalServer *server = wl_container_of(listener, server, cursor_image_surface_destroy);
+	clear_cursor_image_surface(server);
+	server->cursor_image_source = CURSOR_IMAGE_NONE;
+}
+
 void tablet_tool_handle_destroy(Listener *listener, void * /*data*/) {
 	KristalTabletTool *tool = wl_container_of(listener, tool, destroy);
 	wl_list_remove(&tool->destroy.link);
@@ -382,7 +404,7 @@ void focus_surface(KristalServer *server, Surface *surface) {
 	}
 
 	auto *view = view_from_surface(surface);
-	if (view != nullptr && view->workspace != server->current_workspace) {
+	if (view != nullptr && !server_view_is_shown(view)) {
 		return;
 	}
 
@@ -410,6 +432,7 @@ void focus_surface(KristalServer *server, Surface *surface) {
 		if (view->mapped) {
 			wl_list_remove(&view->link);
 			wl_list_insert(&server->views, &view->link);
+			server_update_occlusion(server);
 		}
 		if (view->foreign_toplevel != nullptr) {
 			wlr_foreign_toplevel_handle_v1_set_activated(
@@ -443,6 +466,7 @@ void focus_surface(KristalServer *server, Surface *surface) {
 
 	update_pointer_constraint(server, surface);
 	server_text_input_focus(server, surface);
+	server_cgroup_update_weights(server);
 }
 
 void reset_cursor_mode(KristalServer *server) {
@@ -451,6 +475,80 @@ void reset_cursor_mode(KristalServer *server) {
 	server->grabbed_xwayland = nullptr;
 }
 
+/*
+ * wlr_cursor resets its image state on every set call, which can mean a
+ * cursor plane update or software cursor damage. Remember the current source
+ * and drop requests that would not change anything.
+ */
+void server_set_cursor_xcursor(KristalServer *server, const char *name) {
+	if (server == nullptr || name == nullptr) {
+		return;
+	}
+	if (server->cursor_image_source == CURSOR_IMAGE_XCURSOR &&
+		std::strcmp(server->cursor_image_name, name) == 0) {
+		return;
+	}
+
+	clear_cursor_image_surface(server);
+	std::snprintf(server->cursor_image_name, sizeof(server->cursor_image_name), "%s", name);
+	server->cursor_image_source = CURSOR_IMAGE_XCURSOR;
+	wlr_cursor_set_xcursor(server->cursor, server->cursor_mgr, name);
+}
+
+void server_set_cursor_surface(
+	KristalServer *server,
+	Surface *surface,
+	int32_t hotspot_x,
+	int32_t hotspot_y) {
+	if (server == nullptr) {
+		return;
+	}
+	if (server->cursor_image_source == CURSOR_IMAGE_SURFACE &&
+		server->cursor_image_surface == surface &&
+		server->cursor_image_hotspot_x == hotspot_x &&
+		server->cursor_image_hotspot_y == hotspot_y) {
+		return;
+	}
+
+	clear_cursor_image_surface(server);
+	server->cursor_image_name[0] = '\0';
+	server->cursor_image_source = CURSOR_IMAGE_SURFACE;
+	server->cursor_image_surface = surface;
+	server->cursor_image_hotspot_x = hotspot_x;
+	server->cursor_image_hotspot_y = hotspot_y;
+	if (surface != nullptr) {
+		server->cursor_image_surface_destroy.notify = KRISTAL_PROFILED(cursor_image_surface_destroy);
+		wl_signal_add(&surface->events.destroy, &server->cursor_image_surface_destroy);
+	}
+	wlr_cursor_set_surface(server->cursor, surface, hotspot_x, hotspot_y);
+}
+
+void server_preload_cursor_theme(KristalServer *server, float scale) {
+	if (server == nullptr || server->cursor_mgr == nullptr || scale <= 0.0f) {
+		return;
+	}
+	/* Theme loading is not needed for the first frame; wlr_cursor loads
+	 * on demand anyway, so only warm the cache once startup is over. */
+	if (!kristal_startup_complete()) {
+		if (std::find(deferred_cursor_scales.begin(), deferred_cursor_scales.end(), scale) ==
+			deferred_cursor_scales.end()) {
+			deferred_cursor_scales.push_back(scale);
+		}
+		return;
+	}
+	if (!wlr_xcursor_manager_load(server->cursor_mgr, scale)) {
+		wlr_log(WLR_ERROR, "failed to load xcursor theme at scale %.2f", scale);
+	}
+}
+
+void server_cursor_load_deferred_themes(KristalServer *server) {
+	std::vector<float> scales;
+	scales.swap(deferred_cursor_scales);
+	for (float scale : scales) {
+		server_preload_cursor_theme(server, scale);
+	}
+}
+
 void server_cursor_motion(Listener *listener, void *data) {
 	KristalServer *server = wl_container_of(listener, server, cursor_motion);
 	auto *event = static_cast<PointerMotionEvent *>(data);
@@ -470,10 +568,9 @@ void server_cursor_motion(Listener *listener, void *data) {
 			event->delta_x,
 			event->delta_y);
 	}
-	if (server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
-	}
+	server_notify_activity(server);
 	process_cursor_motion(server, event->time_msec);
+	server_latency_input(server, event->time_msec, server->seat->pointer_state.focused_surface);
 }
 
 void server_cursor_motion_absolute(Listener *listener, void *data) {
@@ -485,10 +582,9 @@ void server_cursor_motion_absolute(Listener *listener, void *data) {
 		&event->pointer->base,
 		event->x,
 		event->y);
-	if (server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
-	}
+	server_notify_activity(server);
 	process_cursor_motion(server, event->time_msec);
+	server_latency_input(server, event->time_msec, server->seat->pointer_state.focused_surface);
 }
 
 void server_cursor_button(Listener *listener, void *data) {
@@ -534,9 +630,8 @@ void server_cursor_button(Listener *listener, void *data) {
 		event->time_msec,
 		event->button,
 		event->state);
-	if (server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
-	}
+	server_notify_activity(server);
+	server_latency_input(server, event->time_msec, server->seat->pointer_state.focused_surface);
 
 	focus_surface(server, surface);
 }
@@ -553,9 +648,8 @@ void server_cursor_axis(Listener *listener, void *data) {
 		event->delta_discrete,
 		event->source,
 		event->relative_direction);
-	if (server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
-	}
+	server_notify_activity(server);
+	server_latency_input(server, event->time_msec, server->seat->pointer_state.focused_surface);
 }
 
 void server_cursor_frame(Listener *listener, void * /*data*/) {
@@ -680,18 +774,14 @@ void server_cursor_touch_down(Listener *listener, void *data) {
 		wlr_seat_touch_notify_down(
 			server->seat, surface, event->time_msec, event->touch_id, sx, sy);
 	}
-	if (server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
-	}
+	server_notify_activity(server);
 }
 
 void server_cursor_touch_up(Listener *listener, void *data) {
 	KristalServer *server = wl_container_of(listener, server, cursor_touch_up);
 	auto *event = static_cast<TouchUpEvent *>(data);
 	wlr_seat_touch_notify_up(server->seat, event->time_msec, event->touch_id);
-	if (server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
-	}
+	server_notify_activity(server);
 }
 
 void server_cursor_touch_motion(Listener *listener, void *data) {
@@ -719,9 +809,7 @@ void server_cursor_touch_motion(Listener *listener, void *data) {
 		}
 		wlr_seat_touch_notify_motion(server->seat, event->time_msec, event->touch_id, sx, sy);
 	}
-	if (server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
-	}
+	server_notify_activity(server);
 }
 
 void server_cursor_touch_cancel(Listener *listener, void *data) {
@@ -729,9 +817,7 @@ void server_cursor_touch_cancel(Listener *listener, void *data) {
 	auto *event = static_cast<TouchCancelEvent *>(data);
 	(void)event;
 	wlr_seat_touch_notify_cancel(server->seat, server->seat->pointer_state.focused_client);
-	if (server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
-	}
+	server_notify_activity(server);
 }
 
 void server_cursor_touch_frame(Listener *listener, void * /*data*/) {
@@ -755,7 +841,7 @@ void server_cursor_tablet_axis(Listener *listener, void *data) {
 		tool_data->tool_v2 = wlr_tablet_tool_create(
 			server->tablet_manager, server->seat, event->tool);
 		event->tool->data = tool_data;
-		tool_data->destroy.notify = tablet_tool_handle_destroy;
+		tool_data->destroy.notify = KRISTAL_PROFILED(tablet_tool_handle_destroy);
 		wl_signal_add(&event->tool->events.destroy, &tool_data->destroy);
 		wl_list_insert(&server->tablet_tools, &tool_data->link);
 	}
@@ -782,9 +868,7 @@ void server_cursor_tablet_axis(Listener *listener, void *data) {
 		wlr_tablet_v2_tablet_tool_notify_wheel(
 			tool_data->tool_v2, event->wheel_delta, 0);
 	}
-	if (server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
-	}
+	server_notify_activity(server);
 }
 
 void server_cursor_tablet_proximity(Listener *listener, void *data) {
@@ -803,7 +887,7 @@ void server_cursor_tablet_proximity(Listener *listener, void *data) {
 		tool_data->tool_v2 = wlr_tablet_tool_create(
 			server->tablet_manager, server->seat, event->tool);
 		event->tool->data = tool_data;
-		tool_data->destroy.notify = tablet_tool_handle_destroy;
+		tool_data->destroy.notify = KRISTAL_PROFILED(tablet_tool_handle_destroy);
 		wl_signal_add(&event->tool->events.destroy, &tool_data->destroy);
 		wl_list_insert(&server->tablet_tools, &tool_data->link);
 	}
@@ -846,9 +930,7 @@ void server_cursor_tablet_tip(Listener *listener, void *data) {
 	} else {
 		wlr_tablet_v2_tablet_tool_notify_up(tool_data->tool_v2);
 	}
-	if (server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
-	}
+	server_notify_activity(server);
 }
 
 void server_cursor_tablet_button(Listener *listener, void *data) {
@@ -864,7 +946,5 @@ void server_cursor_tablet_button(Listener *listener, void *data) {
 		event->state == WLR_BUTTON_PRESSED
 			? ZWP_TABLET_PAD_V2_BUTTON_STATE_PRESSED
 			: ZWP_TABLET_PAD_V2_BUTTON_STATE_RELEASED);
-	if (server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
-	}
+	server_notify_activity(server);
 }
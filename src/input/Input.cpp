@@ -3,7 +3,6 @@
 #include <cstdlib>
 #include <cstring>
 #include <cerrno>
-#include <cmath>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -35,16 +34,23 @@ struct XkbKeymapDeleter {
 	}
 };
 
-bool apply_keyboard_keymap(Keyboard *wlr_keyboard) {
-	if (wlr_keyboard == nullptr) {
-		return false;
-	}
+long parse_env_long(const char *name, long fallback);
 
+/* Compiled once and shared by every keyboard; reload drops it. */
+std::unique_ptr<xkb_keymap, XkbKeymapDeleter> cached_keymap;
+
+xkb_keymap *compile_keymap() {
+	if (cached_keymap) {
+		return cached_keymap.get();
+	}
+	KristalProfileZone zone("compile_keymap");
+	const uint64_t start = kristal_now_ns();
+	kristal_metrics_keymap_compile();
 	std::unique_ptr<xkb_context, XkbContextDeleter> context(
 		xkb_context_new(XKB_CONTEXT_NO_FLAGS));
 	if (!context) {
 		wlr_log(WLR_ERROR, "failed to allocate xkb context");
-		return false;
+		return nullptr;
 	}
 
 	xkb_rule_names rules{};
@@ -61,11 +67,27 @@ bool apply_keyboard_keymap(Keyboard *wlr_keyboard) {
 		keymap.reset(
 			xkb_keymap_new_from_names(context.get(), nullptr, XKB_KEYMAP_COMPILE_NO_FLAGS));
 		if (!keymap) {
-			return false;
+			return nullptr;
 		}
 	}
+	wlr_log(
+		WLR_DEBUG,
+		"Compiled xkb keymap in %.2f ms",
+		static_cast<double>(kristal_now_ns() - start) / 1000000.0);
+	cached_keymap = std::move(keymap);
+	return cached_keymap.get();
+}
 
-	wlr_keyboard_set_keymap(wlr_keyboard, keymap.get());
+bool apply_keyboard_keymap(Keyboard *wlr_keyboard) {
+	if (wlr_keyboard == nullptr) {
+		return false;
+	}
+	xkb_keymap *keymap = compile_keymap();
+	if (keymap == nullptr) {
+		return false;
+	}
+
+	wlr_keyboard_set_keymap(wlr_keyboard, keymap);
 	const long repeat_rate = parse_env_long("KRISTAL_KEY_REPEAT_RATE", 25);
 	const long repeat_delay = parse_env_long("KRISTAL_KEY_REPEAT_DELAY", 600);
 	wlr_keyboard_set_repeat_info(
@@ -119,17 +141,6 @@ double parse_env_double(const char *name, double fallback) {
 	return parsed;
 }
 
-bool spawn_command(const char *command) {
-	if (command == nullptr || command[0] == '\0') {
-		return false;
-	}
-	if (fork() == 0) {
-		execl("/bin/sh", "/bin/sh", "-c", command, nullptr);
-		_exit(1);
-	}
-	return true;
-}
-
 void apply_libinput_config(InputDevice *device) {
 	if (device == nullptr || !wlr_input_device_is_libinput(device)) {
 		return;
@@ -212,7 +223,7 @@ KristalView *next_view_in_workspace(KristalServer *server) {
 	KristalView *view = nullptr;
 	bool found_focused = false;
 	wl_list_for_each(view, &server->views, link) {
-		if (!view->mapped || view->workspace != server->current_workspace) {
+		if (!server_view_is_shown(view)) {
 			continue;
 		}
 		if (first == nullptr) {
@@ -241,7 +252,7 @@ KristalView *prev_view_in_workspace(KristalServer *server) {
 	KristalView *view = nullptr;
 	bool found_focused = false;
 	wl_list_for_each_reverse(view, &server->views, link) {
-		if (!view->mapped || view->workspace != server->current_workspace) {
+		if (!server_view_is_shown(view)) {
 			continue;
 		}
 		if (first == nullptr) {
@@ -320,6 +331,7 @@ void view_apply_box(KristalView *view, const Box &box) {
 	if (view == nullptr || view->scene_tree == nullptr) {
 		return;
 	}
+	view->geometry_pending = false;
 	const int width = std::max(64, box.width);
 	const int height = std::max(64, box.height);
 	if (view->type == KRISTAL_VIEW_XDG) {
@@ -365,17 +377,11 @@ bool view_is_resize_blocked(KristalView *view) {
 #endif
 }
 
-void apply_tiled_geometry(
-	KristalView *view,
-	const Box &output_box,
-	int index,
-	int count) {
-	const int base_height = output_box.height / count;
-	const int extra_height = output_box.height - base_height * count;
-	const int height = base_height + (index == count - 1 ? extra_height : 0);
-	const int width = output_box.width;
-	const int x = output_box.x;
-	const int y = output_box.y + index * base_height;
+void apply_tiled_geometry(KristalView *view, const Box &box) {
+	const int x = box.x;
+	const int y = box.y;
+	const int width = box.width;
+	const int height = box.height;
 
 	if (view->type == KRISTAL_VIEW_XDG) {
 		auto *toplevel = wl_container_of(view, (KristalToplevel *)nullptr, view);
@@ -450,6 +456,11 @@ enum class KeyActionType {
 	LAYOUT_CYCLE,
 	WORKSPACE,
 	MOVE_WORKSPACE,
+	HUD_TOGGLE,
+	DAMAGE_DEBUG,
+	MINIMIZE,
+	SCRATCHPAD_MOVE,
+	SCRATCHPAD_TOGGLE,
 };
 
 struct KeyBinding {
@@ -563,6 +574,26 @@ bool parse_binding_action(const std::string &action_text, KeyActionType *out_act
 		*out_action = KeyActionType::LAYOUT_CYCLE;
 		return true;
 	}
+	if (action == "hud-toggle") {
+		*out_action = KeyActionType::HUD_TOGGLE;
+		return true;
+	}
+	if (action == "damage-debug") {
+		*out_action = KeyActionType::DAMAGE_DEBUG;
+		return true;
+	}
+	if (action == "minimize") {
+		*out_action = KeyActionType::MINIMIZE;
+		return true;
+	}
+	if (action == "scratchpad-move") {
+		*out_action = KeyActionType::SCRATCHPAD_MOVE;
+		return true;
+	}
+	if (action == "scratchpad") {
+		*out_action = KeyActionType::SCRATCHPAD_TOGGLE;
+		return true;
+	}
 	if (action.rfind("ws", 0) == 0 && action.size() == 3) {
 		const int ws = action[2] - '0';
 		if (ws >= 1 && ws <= 9) {
@@ -661,6 +692,11 @@ void load_keybindings_from_env() {
 			"Alt+Ctrl+Up=resize-up",
 			"Alt+Ctrl+Down=resize-down",
 			"Alt+Space=layout-cycle",
+			"Alt+Shift+H=hud-toggle",
+			"Alt+Shift+D=damage-debug",
+			"Alt+M=minimize",
+			"Alt+Shift+Minus=scratchpad-move",
+			"Alt+Minus=scratchpad",
 			"Alt+1=ws1",
 			"Alt+2=ws2",
 			"Alt+3=ws3",
@@ -710,10 +746,10 @@ bool handle_keybinding(KristalServer *server, xkb_keysym_t sym, uint32_t modifie
 			wl_display_terminate(server->display);
 			break;
 		case KeyActionType::TERMINAL:
-			spawn_command(getenv("KRISTAL_TERMINAL"));
+			server_spawn_command(server, getenv("KRISTAL_TERMINAL"));
 			break;
 		case KeyActionType::LAUNCHER:
-			spawn_command(getenv("KRISTAL_LAUNCHER"));
+			server_spawn_command(server, getenv("KRISTAL_LAUNCHER"));
 			break;
 		case KeyActionType::CLOSE:
 			server_close_focused(server);
@@ -777,6 +813,21 @@ bool handle_keybinding(KristalServer *server, xkb_keysym_t sym, uint32_t modifie
 		case KeyActionType::MOVE_WORKSPACE:
 			server_move_focused_to_workspace(server, binding.workspace);
 			break;
+		case KeyActionType::HUD_TOGGLE:
+			server_hud_toggle(server);
+			break;
+		case KeyActionType::DAMAGE_DEBUG:
+			server_damage_debug_toggle(server);
+			break;
+		case KeyActionType::MINIMIZE:
+			server_minimize_focused(server);
+			break;
+		case KeyActionType::SCRATCHPAD_MOVE:
+			server_scratchpad_move_focused(server);
+			break;
+		case KeyActionType::SCRATCHPAD_TOGGLE:
+			server_scratchpad_toggle(server);
+			break;
 		}
 		return true;
 	}
@@ -805,10 +856,14 @@ void keyboard_handle_key(Listener *listener, void *data) {
 	if (!handled) {
 		wlr_seat_set_keyboard(seat, keyboard->wlr_keyboard);
 		wlr_seat_keyboard_notify_key(seat, event->time_msec, event->keycode, event->state);
+		if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+			server_latency_input(
+				server,
+				event->time_msec,
+				seat->keyboard_state.focused_surface);
+		}
 	}
-	if (server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
-	}
+	server_notify_activity(server);
 }
 
 void keyboard_handle_destroy(Listener *listener, void * /*data*/) {
@@ -820,25 +875,35 @@ void keyboard_handle_destroy(Listener *listener, void * /*data*/) {
 	delete keyboard;
 }
 
+/* Virtual keyboards arrive with the keymap their client uploaded. */
+bool keyboard_is_virtual(Keyboard *wlr_keyboard) {
+	return wlr_input_device_get_virtual_keyboard(&wlr_keyboard->base) != nullptr;
+}
+
 void server_new_keyboard(KristalServer *server, InputDevice *device) {
 	auto *wlr_keyboard = wlr_keyboard_from_input_device(device);
 	auto *keyboard = new KristalKeyboard{};
 	keyboard->server = server;
 	keyboard->wlr_keyboard = wlr_keyboard;
 
-	if (!apply_keyboard_keymap(wlr_keyboard)) {
+	const bool is_virtual = keyboard_is_virtual(wlr_keyboard);
+	if (!is_virtual && !apply_keyboard_keymap(wlr_keyboard)) {
 		delete keyboard;
 		return;
 	}
 
-	keyboard->modifiers.notify = keyboard_handle_modifiers;
+	keyboard->modifiers.notify = KRISTAL_PROFILED(keyboard_handle_modifiers);
 	wl_signal_add(&wlr_keyboard->events.modifiers, &keyboard->modifiers);
-	keyboard->key.notify = keyboard_handle_key;
+	keyboard->key.notify = KRISTAL_PROFILED(keyboard_handle_key);
 	wl_signal_add(&wlr_keyboard->events.key, &keyboard->key);
-	keyboard->destroy.notify = keyboard_handle_destroy;
+	keyboard->destroy.notify = KRISTAL_PROFILED(keyboard_handle_destroy);
 	wl_signal_add(&device->events.destroy, &keyboard->destroy);
 
-	wlr_seat_set_keyboard(server->seat, keyboard->wlr_keyboard);
+	/* A virtual keyboard may not have a keymap yet; it becomes the seat
+	 * keyboard on its first key like any other. */
+	if (!is_virtual) {
+		wlr_seat_set_keyboard(server->seat, keyboard->wlr_keyboard);
+	}
 	wl_list_insert(&server->keyboards, &keyboard->link);
 }
 
@@ -854,15 +919,39 @@ void tablet_handle_destroy(Listener *listener, void * /*data*/) {
 	delete tablet;
 }
 
+void notify_idle_activity_now(KristalServer *server) {
+	if (server->idle_notifier != nullptr) {
+		wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat);
+	}
+	server_power_activity(server);
+	if (server->idle_activity_timer != nullptr && server->idle_activity_interval_ms > 0) {
+		wl_event_source_timer_update(
+			server->idle_activity_timer,
+			server->idle_activity_interval_ms);
+		server->idle_activity_armed = true;
+	}
+}
+
+int idle_activity_timer_fired(void *data) {
+	auto *server = static_cast<KristalServer *>(data);
+	server->idle_activity_armed = false;
+	if (server->idle_activity_pending) {
+		server->idle_activity_pending = false;
+		notify_idle_activity_now(server);
+	}
+	return 0;
+}
+
 void switch_handle_toggle(Listener *listener, void *data) {
 	KristalSwitch *device = wl_container_of(listener, device, toggle);
 	auto *event = static_cast<SwitchToggleEvent *>(data);
 	const char *type_name = event->switch_type == WLR_SWITCH_TYPE_LID ? "lid" : "tablet-mode";
 	const char *state_name = event->switch_state == WLR_SWITCH_STATE_ON ? "on" : "off";
 	wlr_log(WLR_INFO, "switch %s toggled %s", type_name, state_name);
-	if (device->server->idle_notifier != nullptr) {
-		wlr_idle_notifier_v1_notify_activity(device->server->idle_notifier, device->server->seat);
+	if (event->switch_type == WLR_SWITCH_TYPE_LID) {
+		server_power_lid(device->server, event->switch_state == WLR_SWITCH_STATE_ON);
 	}
+	server_notify_activity(device->server);
 }
 
 void switch_handle_destroy(Listener *listener, void * /*data*/) {
@@ -887,7 +976,7 @@ void server_new_tablet(KristalServer *server, InputDevice *device) {
 	tablet->tablet_v2 = wlr_tablet_create(server->tablet_manager, server->seat, device);
 	wlr_tablet->data = tablet;
 
-	tablet->destroy.notify = tablet_handle_destroy;
+	tablet->destroy.notify = KRISTAL_PROFILED(tablet_handle_destroy);
 	wl_signal_add(&device->events.destroy, &tablet->destroy);
 	wl_list_insert(&server->tablets, &tablet->link);
 
@@ -899,19 +988,14 @@ void server_new_switch(KristalServer *server, InputDevice *device) {
 	auto *switch_device = new KristalSwitch{};
 	switch_device->server = server;
 	switch_device->wlr_switch = wlr_switch;
-	switch_device->toggle.notify = switch_handle_toggle;
+	switch_device->toggle.notify = KRISTAL_PROFILED(switch_handle_toggle);
 	wl_signal_add(&wlr_switch->events.toggle, &switch_device->toggle);
-	switch_device->destroy.notify = switch_handle_destroy;
+	switch_device->destroy.notify = KRISTAL_PROFILED(switch_handle_destroy);
 	wl_signal_add(&device->events.destroy, &switch_device->destroy);
 	wl_list_insert(&server->switches, &switch_device->link);
 }
 
-} // namespace
-
-void server_new_input(Listener *listener, void *data) {
-	KristalServer *server = wl_container_of(listener, server, new_input);
-	auto *device = static_cast<InputDevice *>(data);
-
+void server_add_input_device(KristalServer *server, InputDevice *device) {
 	switch (device->type) {
 	case WLR_INPUT_DEVICE_KEYBOARD:
 		server_new_keyboard(server, device);
@@ -931,6 +1015,7 @@ void server_new_input(Listener *listener, void *data) {
 	default:
 		break;
 	}
+	server_input_record_device(server, device);
 
 	uint32_t caps = WL_SEAT_CAPABILITY_POINTER;
 	if (!wl_list_empty(&server->keyboards)) {
@@ -942,14 +1027,40 @@ void server_new_input(Listener *listener, void *data) {
 	wlr_seat_set_capabilities(server->seat, caps);
 }
 
+} // namespace
+
+void server_new_input(Listener *listener, void *data) {
+	KristalServer *server = wl_container_of(listener, server, new_input);
+	server_add_input_device(server, static_cast<InputDevice *>(data));
+}
+
+void server_new_virtual_keyboard(Listener *listener, void *data) {
+	KristalServer *server = wl_container_of(listener, server, new_virtual_keyboard);
+	auto *keyboard = static_cast<VirtualKeyboard *>(data);
+	server_add_input_device(server, &keyboard->keyboard.base);
+}
+
+void server_new_virtual_pointer(Listener *listener, void *data) {
+	KristalServer *server = wl_container_of(listener, server, new_virtual_pointer);
+	auto *event = static_cast<VirtualPointerNewEvent *>(data);
+	auto *device = &event->new_pointer->pointer.base;
+	server_add_input_device(server, device);
+	if (event->suggested_output != nullptr) {
+		wlr_cursor_map_input_to_output(server->cursor, device, event->suggested_output);
+	}
+}
+
 void server_reload_input_settings(KristalServer *server) {
 	if (server == nullptr) {
 		return;
 	}
 
+	cached_keymap.reset();
 	KristalKeyboard *keyboard = nullptr;
 	wl_list_for_each(keyboard, &server->keyboards, link) {
-		apply_keyboard_keymap(keyboard->wlr_keyboard);
+		if (!keyboard_is_virtual(keyboard->wlr_keyboard)) {
+			apply_keyboard_keymap(keyboard->wlr_keyboard);
+		}
 	}
 }
 
@@ -959,6 +1070,33 @@ void server_reload_keybindings() {
 	load_keybindings_from_env();
 }
 
+/*
+ * Idle notification is coalesced: the first input event after a quiet period
+ * is forwarded right away and opens a window of idle_activity_interval_ms.
+ * Events inside the window only set a flag, and the timer forwards a single
+ * notification when the window closes.
+ */
+void server_notify_activity(KristalServer *server) {
+	kristal_metrics_input_event();
+	if (server->idle_activity_armed) {
+		server->idle_activity_pending = true;
+		return;
+	}
+	notify_idle_activity_now(server);
+}
+
+void server_init_idle_activity(KristalServer *server) {
+	server->idle_activity_pending = false;
+	server->idle_activity_armed = false;
+	server->idle_activity_timer = wl_event_loop_add_timer(
+		wl_display_get_event_loop(server->display),
+		idle_activity_timer_fired,
+		server);
+	if (server->idle_activity_timer == nullptr) {
+		wlr_log(WLR_ERROR, "failed to create idle activity timer; notifying per event");
+	}
+}
+
 void server_new_pointer_constraint(Listener *listener, void *data) {
 	KristalServer *server = wl_container_of(listener, server, new_pointer_constraint);
 	auto *constraint = static_cast<PointerConstraint *>(data);
@@ -966,7 +1104,7 @@ void server_new_pointer_constraint(Listener *listener, void *data) {
 	auto *handle = new KristalConstraintHandle{};
 	handle->server = server;
 	handle->constraint = constraint;
-	handle->destroy.notify = pointer_constraint_destroy;
+	handle->destroy.notify = KRISTAL_PROFILED(pointer_constraint_destroy);
 	wl_signal_add(&constraint->events.destroy, &handle->destroy);
 	constraint->data = handle;
 
@@ -985,8 +1123,8 @@ void seat_request_cursor(Listener *listener, void *data) {
 	auto *focused_client = server->seat->pointer_state.focused_client;
 
 	if (focused_client == event->seat_client) {
-		wlr_cursor_set_surface(
-			server->cursor,
+		server_set_cursor_surface(
+			server,
 			event->surface,
 			event->hotspot_x,
 			event->hotspot_y);
@@ -1004,24 +1142,27 @@ void server_apply_workspace(KristalServer *server, int workspace) {
 		return;
 	}
 
+	const uint64_t perf_start = kristal_perf_begin(KRISTAL_PERF_WORKSPACE_SWITCH);
 	server->current_workspace = workspace;
 	server->window_layout_mode = server->workspace_layouts[workspace];
 	KristalView *view = nullptr;
 	wl_list_for_each(view, &server->views, link) {
-		const bool visible = view->mapped && view->workspace == workspace;
-		wlr_scene_node_set_enabled(&view->scene_tree->node, visible);
+		server_view_update_visibility(view);
 	}
 
 	auto *next_view = next_view_in_workspace(server);
 	if (next_view != nullptr) {
 		focus_surface(server, view_surface(next_view));
+		kristal_perf_end(KRISTAL_PERF_WORKSPACE_SWITCH, perf_start);
 		return;
 	}
 
 	server->focused_surface = nullptr;
 	wlr_seat_keyboard_clear_focus(server->seat);
 	server_text_input_focus(server, nullptr);
+	server_cgroup_update_weights(server);
 	server_arrange_workspace(server);
+	kristal_perf_end(KRISTAL_PERF_WORKSPACE_SWITCH, perf_start);
 }
 
 void server_move_focused_to_workspace(KristalServer *server, int workspace) {
@@ -1035,8 +1176,8 @@ void server_move_focused_to_workspace(KristalServer *server, int workspace) {
 	}
 
 	view->workspace = workspace;
-	const bool visible = view->mapped && view->workspace == server->current_workspace;
-	wlr_scene_node_set_enabled(&view->scene_tree->node, visible);
+	server_view_update_visibility(view);
+	server_cgroup_update_weights(server);
 	server_arrange_workspace(server);
 }
 
@@ -1138,11 +1279,18 @@ void server_cycle_workspace_layout(KristalServer *server) {
 	server_set_workspace_layout(server, next);
 }
 
-void server_arrange_workspace(KristalServer *server) {
-	if (server == nullptr || server->window_layout_mode == WINDOW_LAYOUT_FLOATING) {
-		return;
-	}
+namespace {
+
+/* Scratch storage reused across arranges so layout never allocates once warm. */
+struct ArrangeScratch {
+	std::vector<KristalView *> views;
+	std::vector<KristalLayoutView> layout_views;
+	std::vector<KristalLayoutBox> boxes;
+};
 
+ArrangeScratch arrange_scratch;
+
+void arrange_current_workspace(KristalServer *server) {
 	auto *output = wlr_output_layout_get_center_output(server->output_layout);
 	if (output == nullptr) {
 		return;
@@ -1154,74 +1302,353 @@ void server_arrange_workspace(KristalServer *server) {
 		return;
 	}
 
-	int count = 0;
+	auto &scratch = arrange_scratch;
+	scratch.views.clear();
+	scratch.layout_views.clear();
 	KristalView *view = nullptr;
 	wl_list_for_each(view, &server->views, link) {
-		if (view->workspace != server->current_workspace) {
+		if (!server_view_is_shown(view)) {
 			continue;
 		}
-		if (view_is_tiled_candidate(view)) {
-			count++;
+		KristalLayoutView layout_view{};
+		layout_view.state = view_is_tiled_candidate(view)
+			? KRISTAL_LAYOUT_TILED
+			: KRISTAL_LAYOUT_FLOATING;
+		scratch.views.push_back(view);
+		scratch.layout_views.push_back(layout_view);
+	}
+	scratch.boxes.resize(scratch.views.size());
+
+	const KristalLayoutBox area{ output_box.x, output_box.y, output_box.width, output_box.height };
+	const uint64_t perf_start = kristal_perf_begin(KRISTAL_PERF_LAYOUT);
+	const size_t tiled = kristal_layout_compute(
+		server->window_layout_mode,
+		&area,
+		scratch.layout_views.data(),
+		scratch.layout_views.size(),
+		scratch.boxes.data());
+	kristal_perf_end(KRISTAL_PERF_LAYOUT, perf_start);
+	if (tiled == 0) {
+		return;
+	}
+
+	/* Only recorded here; the occlusion pass that follows configures the
+	 * views that end up visible and merely positions the covered ones. */
+	for (size_t i = 0; i < scratch.views.size(); ++i) {
+		if (scratch.layout_views[i].state != KRISTAL_LAYOUT_TILED) {
+			continue;
 		}
+		const KristalLayoutBox &cell = scratch.boxes[i];
+		scratch.views[i]->geometry_pending = true;
+		scratch.views[i]->pending_geometry = Box{ cell.x, cell.y, cell.width, cell.height };
 	}
-	if (count == 0) {
+}
+
+} // namespace
+
+void server_arrange_workspace(KristalServer *server) {
+	if (server == nullptr) {
+		return;
+	}
+	if (server->window_layout_mode == WINDOW_LAYOUT_FLOATING) {
+		server_update_occlusion(server);
 		return;
 	}
+	const uint64_t perf_start = kristal_perf_begin(KRISTAL_PERF_ARRANGE);
+	arrange_current_workspace(server);
+	server_update_occlusion(server);
+	kristal_perf_end(KRISTAL_PERF_ARRANGE, perf_start);
+}
 
-	switch (server->window_layout_mode) {
-	case WINDOW_LAYOUT_STACK: {
-		int index = 0;
-		wl_list_for_each(view, &server->views, link) {
-			if (view->workspace != server->current_workspace) {
-				continue;
-			}
-			if (!view_is_tiled_candidate(view)) {
-				continue;
-			}
-			apply_tiled_geometry(view, output_box, index, count);
-			index++;
+bool server_view_is_shown(const KristalView *view) {
+	return view->mapped && !view->minimized && !view->stashed &&
+		view->workspace == view->server->current_workspace;
+}
+
+KristalView *server_view_from_surface(Surface *surface) {
+	return view_from_surface(surface);
+}
+
+Surface *server_view_surface(KristalView *view) {
+	return view_surface(view);
+}
+
+/* Hidden views are disabled in the scene and told they are suspended, so
+ * well-behaved clients stop rendering and animating until shown again.
+ * Minimized and stashed views also leave the workspace's part of the scene
+ * for the retained tree; moving them back is a reparent, and the client
+ * keeps its buffers and state throughout. */
+void server_view_update_visibility(KristalView *view) {
+	KristalServer *server = view->server;
+	const bool shown = server_view_is_shown(view);
+	SceneTree *parent = view->minimized || view->stashed
+		? server->retained_tree
+		: server->view_tree;
+	if (view->scene_tree->node.parent != parent) {
+		wlr_scene_node_reparent(&view->scene_tree->node, parent);
+	}
+	wlr_scene_node_set_enabled(&view->scene_tree->node, shown);
+	server_view_set_suspended(view, !shown);
+}
+
+namespace {
+
+/* The view has just left or rejoined the current workspace. */
+void view_presence_changed(KristalView *view, bool was_focused) {
+	KristalServer *server = view->server;
+	server_view_update_visibility(view);
+	if (server_view_is_shown(view)) {
+		focus_surface(server, view_surface(view));
+	} else if (was_focused) {
+		auto *next_view = next_view_in_workspace(server);
+		if (next_view != nullptr) {
+			focus_surface(server, view_surface(next_view));
+		} else {
+			server->focused_surface = nullptr;
+			wlr_seat_keyboard_clear_focus(server->seat);
+			server_text_input_focus(server, nullptr);
 		}
-		break;
 	}
-	case WINDOW_LAYOUT_GRID: {
-		const int cols = std::max(1, static_cast<int>(std::ceil(std::sqrt(count))));
-		const int rows = std::max(1, (count + cols - 1) / cols);
-		const int base_width = output_box.width / cols;
-		const int extra_width = output_box.width - base_width * cols;
-		const int base_height = output_box.height / rows;
-		const int extra_height = output_box.height - base_height * rows;
-		int index = 0;
-		wl_list_for_each(view, &server->views, link) {
-			if (view->workspace != server->current_workspace) {
-				continue;
-			}
-			if (!view_is_tiled_candidate(view)) {
-				continue;
-			}
-			const int col = index % cols;
-			const int row = index / cols;
-			const int width = base_width + (col == cols - 1 ? extra_width : 0);
-			const int height = base_height + (row == rows - 1 ? extra_height : 0);
-			const int x = output_box.x + col * base_width;
-			const int y = output_box.y + row * base_height;
-			Box cell_box{ x, y, width, height };
-			view_apply_box(view, cell_box);
-			index++;
+	server_cgroup_update_weights(server);
+	server_arrange_workspace(server);
+}
+
+void center_view(KristalView *view) {
+	auto *output = wlr_output_layout_get_center_output(view->server->output_layout);
+	Box box{};
+	if (output == nullptr || !view_get_box(view, &box)) {
+		return;
+	}
+	Box output_box{};
+	wlr_output_layout_get_box(view->server->output_layout, output, &output_box);
+	if (box.width <= 0 || box.height <= 0) {
+		box.width = output_box.width / 2;
+		box.height = output_box.height / 2;
+	}
+	box.x = output_box.x + (output_box.width - box.width) / 2;
+	box.y = output_box.y + (output_box.height - box.height) / 2;
+	view_apply_box(view, box);
+}
+
+} // namespace
+
+void server_view_set_minimized(KristalView *view, bool minimized) {
+	if (view->minimized == minimized) {
+		return;
+	}
+	const bool was_focused = view_surface(view) == view->server->focused_surface;
+	view->minimized = minimized;
+#ifdef KRISTAL_HAVE_XWAYLAND
+	if (view->type == KRISTAL_VIEW_XWAYLAND) {
+		auto *xsurface = wl_container_of(view, (KristalXwaylandSurface *)nullptr, view);
+		if (xsurface->xwayland_surface != nullptr) {
+			wlr_xwayland_surface_set_minimized(xsurface->xwayland_surface, minimized);
 		}
-		break;
 	}
-	case WINDOW_LAYOUT_MONOCLE:
-		wl_list_for_each(view, &server->views, link) {
-			if (view->workspace != server->current_workspace) {
-				continue;
+#endif
+	if (view->foreign_toplevel != nullptr) {
+		wlr_foreign_toplevel_handle_v1_set_minimized(view->foreign_toplevel, minimized);
+	}
+	view_presence_changed(view, was_focused);
+}
+
+void server_minimize_focused(KristalServer *server) {
+	auto *view = view_from_surface(server->focused_surface);
+	if (view != nullptr) {
+		server_view_set_minimized(view, true);
+	}
+}
+
+/* Scratchpad views float and leave the layout; while stashed they belong to
+ * no workspace. */
+void server_scratchpad_move_focused(KristalServer *server) {
+	auto *view = view_from_surface(server->focused_surface);
+	if (view == nullptr) {
+		return;
+	}
+	view->scratchpad = true;
+	view->force_floating = true;
+	view->stashed = true;
+	view_presence_changed(view, true);
+}
+
+/* Stashes the scratchpad view shown on this workspace, or else brings the
+ * most recently used one here, centred and focused. */
+void server_scratchpad_toggle(KristalServer *server) {
+	KristalView *shown = nullptr;
+	KristalView *candidate = nullptr;
+	KristalView *view = nullptr;
+	wl_list_for_each(view, &server->views, link) {
+		if (!view->scratchpad || view->minimized) {
+			continue;
+		}
+		if (server_view_is_shown(view)) {
+			shown = shown != nullptr ? shown : view;
+		} else if (candidate == nullptr) {
+			candidate = view;
+		}
+	}
+	if (shown != nullptr) {
+		const bool was_focused = view_surface(shown) == server->focused_surface;
+		shown->stashed = true;
+		view_presence_changed(shown, was_focused);
+		return;
+	}
+	if (candidate == nullptr) {
+		return;
+	}
+	candidate->stashed = false;
+	candidate->workspace = server->current_workspace;
+	center_view(candidate);
+	view_presence_changed(candidate, false);
+}
+
+namespace {
+
+wl_event_source *occlusion_idle = nullptr;
+
+void flush_view_geometry(KristalView *view) {
+	if (!view->geometry_pending) {
+		return;
+	}
+	if (view->server->window_layout_mode == WINDOW_LAYOUT_STACK) {
+		view->geometry_pending = false;
+		apply_tiled_geometry(view, view->pending_geometry);
+	} else {
+		view_apply_box(view, view->pending_geometry);
+	}
+}
+
+/* Moves a covered view into its slot without a configure, so uncovering it
+ * later does not have to move anything the user can see. */
+void position_view(KristalView *view, const Box &box) {
+	int x = box.x;
+	int y = box.y;
+	if (view->type == KRISTAL_VIEW_XDG) {
+		auto *toplevel = wl_container_of(view, (KristalToplevel *)nullptr, view);
+		Box geometry{};
+		wlr_xdg_surface_get_geometry(toplevel->xdg_toplevel->base, &geometry);
+		x -= geometry.x;
+		y -= geometry.y;
+	}
+	wlr_scene_node_set_position(&view->scene_tree->node, x, y);
+}
+
+/* Uncovering a view sends the geometry arrange held back for it, once
+ * neither pass considers it covered. */
+void apply_view_covered(KristalView *view) {
+	const bool covered = view->covered_by_geometry || view->covered_by_scene;
+	if (!covered) {
+		flush_view_geometry(view);
+	}
+	server_view_set_suspended(view, covered);
+}
+
+/* Judged from the declared opaque region over the window geometry, which is
+ * what wlr_scene goes by for buffers with an alpha channel. */
+bool view_is_opaque(KristalView *view) {
+	Surface *surface = view_surface(view);
+	if (surface == nullptr) {
+		return false;
+	}
+	pixman_box32_t rect{0, 0, surface->current.width, surface->current.height};
+	if (view->type == KRISTAL_VIEW_XDG) {
+		auto *toplevel = wl_container_of(view, (KristalToplevel *)nullptr, view);
+		Box geometry{};
+		wlr_xdg_surface_get_geometry(toplevel->xdg_toplevel->base, &geometry);
+		rect = {geometry.x, geometry.y, geometry.x + geometry.width, geometry.y + geometry.height};
+	}
+	if (rect.x2 <= rect.x1 || rect.y2 <= rect.y1) {
+		return false;
+	}
+	return pixman_region32_contains_rectangle(&surface->opaque_region, &rect) == PIXMAN_REGION_IN;
+}
+
+void note_visible_buffer(SceneBuffer *buffer, int /*sx*/, int /*sy*/, void *data) {
+	if (pixman_region32_not_empty(&buffer->node.visible)) {
+		*static_cast<bool *>(data) = true;
+	}
+}
+
+/* wlr_scene keeps each node's visible region with opaque content above
+ * already subtracted; a view none of whose buffers has any left is fully
+ * covered. This catches what the geometric pass cannot know about, such as
+ * buffers without an alpha channel. */
+bool view_fully_occluded(KristalView *view) {
+	bool visible = false;
+	wlr_scene_node_for_each_buffer(&view->scene_tree->node, note_visible_buffer, &visible);
+	return !visible;
+}
+
+/* After frames the geometric pass runs again too: the windows above may
+ * have caught up with their arranged size since it last ran. */
+void update_occlusion(void *data) {
+	auto *server = static_cast<KristalServer *>(data);
+	occlusion_idle = nullptr;
+	KristalView *view = nullptr;
+	wl_list_for_each(view, &server->views, link) {
+		view->covered_by_scene = server_view_is_shown(view) && view_fully_occluded(view);
+	}
+	server_update_occlusion(server);
+}
+
+} // namespace
+
+/* Runs top-down over the stacking order after every arrange and restack.
+ * Each view is tested with the box arrange asked for, so a covered view is
+ * never configured just to be thrown away: in MONOCLE or under a fullscreen
+ * view only the top one is. What a view covers is the box it has now, as
+ * its opaque region describes that buffer rather than the arranged one. */
+void server_update_occlusion(KristalServer *server) {
+	pixman_region32_t opaque;
+	pixman_region32_init(&opaque);
+	KristalView *view = nullptr;
+	wl_list_for_each(view, &server->views, link) {
+		if (!server_view_is_shown(view)) {
+			view->covered_by_geometry = false;
+			view->covered_by_scene = false;
+			continue;
+		}
+		Box current{};
+		const bool has_box = view_get_box(view, &current);
+		const Box target = view->geometry_pending ? view->pending_geometry : current;
+		if ((!view->geometry_pending && !has_box) || target.width <= 0 || target.height <= 0) {
+			view->covered_by_geometry = false;
+			apply_view_covered(view);
+			continue;
+		}
+		pixman_box32_t rect{target.x, target.y, target.x + target.width, target.y + target.height};
+		view->covered_by_geometry = pixman_region32_contains_rectangle(&opaque, &rect) == PIXMAN_REGION_IN;
+		if (view->covered_by_geometry) {
+			if (view->geometry_pending) {
+				position_view(view, view->pending_geometry);
 			}
-			if (!view_is_tiled_candidate(view)) {
-				continue;
+		} else if (has_box && view_is_opaque(view)) {
+			/* Xwayland boxes report the configured size, which the
+			 * buffer may not have caught up to yet. */
+			Surface *surface = view_surface(view);
+			const int width = std::min(current.width, surface->current.width);
+			const int height = std::min(current.height, surface->current.height);
+			if (width > 0 && height > 0) {
+				pixman_region32_union_rect(&opaque, &opaque, current.x, current.y, width, height);
 			}
-			view_apply_box(view, output_box);
 		}
-		break;
-	default:
-		break;
+		apply_view_covered(view);
+	}
+	pixman_region32_fini(&opaque);
+	server_power_update_inhibit(server, nullptr);
+	if (server->cgroup_weights_dirty) {
+		server_cgroup_update_weights(server);
+	}
+}
+
+/* Coalesces the outputs that drew in one loop iteration into one pass. */
+void server_schedule_occlusion_update(KristalServer *server) {
+	if (occlusion_idle != nullptr) {
+		return;
 	}
+	occlusion_idle = wl_event_loop_add_idle(
+		wl_display_get_event_loop(server->display),
+		update_occlusion,
+		server);
 }
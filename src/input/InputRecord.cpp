@@ -0,0 +1,1152 @@
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/resource.h>
+
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/interfaces/wlr_tablet_tool.h>
+#include <wlr/interfaces/wlr_touch.h>
+
+#include "core/internal.h"
+
+/*
+ * Input recorder and replayer.
+ *
+ * KRISTAL_INPUT_RECORD=<path> appends every event the input devices emit to a
+ * binary log. KRISTAL_INPUT_REPLAY=<path> creates virtual devices matching the
+ * recorded ones and feeds the log back through the regular device signals, so
+ * the same cursor, keyboard, touch and tablet handlers run. The log is in host
+ * byte order; it is meant for comparing builds on one machine.
+ *
+ * Each record is an 8-byte header followed by a kind-specific payload. The
+ * header carries the payload size so unknown kinds can be skipped.
+ */
+
+namespace {
+
+constexpr char kLogMagic[4] = {'K', 'R', 'I', 'R'};
+constexpr uint16_t kLogVersion = 1;
+constexpr int kReplayBatch = 512;
+
+enum RecordKind : uint8_t {
+	RECORD_DEVICE_ADDED = 1,
+	RECORD_DEVICE_REMOVED,
+	RECORD_TOOL_ADDED,
+	RECORD_KEY,
+	RECORD_POINTER_MOTION,
+	RECORD_POINTER_MOTION_ABSOLUTE,
+	RECORD_POINTER_BUTTON,
+	RECORD_POINTER_AXIS,
+	RECORD_POINTER_FRAME,
+	RECORD_TOUCH_DOWN,
+	RECORD_TOUCH_UP,
+	RECORD_TOUCH_MOTION,
+	RECORD_TOUCH_CANCEL,
+	RECORD_TOUCH_FRAME,
+	RECORD_TABLET_AXIS,
+	RECORD_TABLET_PROXIMITY,
+	RECORD_TABLET_TIP,
+	RECORD_TABLET_BUTTON,
+	RECORD_KIND_COUNT,
+};
+
+const char *const kRecordKindNames[RECORD_KIND_COUNT] = {
+	"?",
+	"device-added",
+	"device-removed",
+	"tool-added",
+	"key",
+	"motion",
+	"motion-absolute",
+	"button",
+	"axis",
+	"frame",
+	"touch-down",
+	"touch-up",
+	"touch-motion",
+	"touch-cancel",
+	"touch-frame",
+	"tablet-axis",
+	"tablet-proximity",
+	"tablet-tip",
+	"tablet-button",
+};
+
+struct LogHeader {
+	char magic[4];
+	uint16_t version;
+	uint16_t reserved;
+};
+
+struct RecordHeader {
+	uint8_t kind;
+	uint8_t size;
+	/* Device id, or tool id for RECORD_TOOL_ADDED. */
+	uint16_t device;
+	/* Time since the previous record, saturated. */
+	uint32_t delta_us;
+};
+
+struct DevicePayload {
+	uint8_t type;
+	uint8_t name_len;
+	char name[64];
+};
+
+struct ToolPayload {
+	uint64_t hardware_serial;
+	uint64_t hardware_wacom;
+	uint32_t type;
+	uint32_t capabilities;
+};
+
+enum ToolCapability : uint32_t {
+	TOOL_HAS_TILT = 1u << 0,
+	TOOL_HAS_PRESSURE = 1u << 1,
+	TOOL_HAS_DISTANCE = 1u << 2,
+	TOOL_HAS_ROTATION = 1u << 3,
+	TOOL_HAS_SLIDER = 1u << 4,
+	TOOL_HAS_WHEEL = 1u << 5,
+};
+
+struct KeyPayload {
+	uint32_t keycode;
+	uint32_t state;
+};
+
+struct MotionPayload {
+	float delta_x;
+	float delta_y;
+	float unaccel_dx;
+	float unaccel_dy;
+};
+
+struct PositionPayload {
+	double x;
+	double y;
+};
+
+struct ButtonPayload {
+	uint32_t button;
+	uint32_t state;
+};
+
+struct AxisPayload {
+	double delta;
+	int32_t delta_discrete;
+	uint8_t source;
+	uint8_t orientation;
+	uint8_t relative_direction;
+	uint8_t reserved;
+};
+
+struct TouchPayload {
+	int32_t touch_id;
+	uint32_t reserved;
+	double x;
+	double y;
+};
+
+struct TabletAxisPayload {
+	uint16_t tool;
+	uint16_t reserved;
+	uint32_t updated_axes;
+	float x;
+	float y;
+	float dx;
+	float dy;
+	float pressure;
+	float distance;
+	float tilt_x;
+	float tilt_y;
+	float rotation;
+	float slider;
+	float wheel_delta;
+};
+
+struct TabletStatePayload {
+	uint16_t tool;
+	uint16_t reserved;
+	uint32_t state;
+	double x;
+	double y;
+};
+
+struct TabletButtonPayload {
+	uint16_t tool;
+	uint16_t reserved;
+	uint32_t button;
+	uint32_t state;
+	uint32_t reserved2;
+};
+
+static_assert(sizeof(RecordHeader) == 8, "record header must stay 8 bytes");
+static_assert(sizeof(TabletAxisPayload) <= 255, "payload size must fit in a byte");
+
+uint32_t event_time_msec() {
+	return static_cast<uint32_t>(kristal_now_ns() / 1000000ull);
+}
+
+/* ---- Recording ---------------------------------------------------------- */
+
+struct RecordedDevice {
+	List link;
+	uint16_t id;
+	InputDevice *device;
+	Listener key;
+	Listener motion;
+	Listener motion_absolute;
+	Listener button;
+	Listener axis;
+	Listener frame;
+	Listener touch_down;
+	Listener touch_up;
+	Listener touch_motion;
+	Listener touch_cancel;
+	Listener touch_frame;
+	Listener tablet_axis;
+	Listener tablet_proximity;
+	Listener tablet_tip;
+	Listener tablet_button;
+	Listener destroy;
+};
+
+struct RecordedTool {
+	List link;
+	uint16_t id;
+	struct wlr_tablet_tool *tool;
+	Listener destroy;
+};
+
+struct InputRecorder {
+	FILE *file;
+	uint64_t last_ns;
+	uint64_t records;
+	uint16_t next_device_id;
+	uint16_t next_tool_id;
+	List devices;
+	List tools;
+};
+
+InputRecorder recorder{};
+
+void write_record(uint8_t kind, uint16_t device, const void *payload, size_t size) {
+	const uint64_t now = kristal_now_ns();
+	const uint64_t delta_us = (now - recorder.last_ns) / 1000u;
+	RecordHeader header{};
+	header.kind = kind;
+	header.size = static_cast<uint8_t>(size);
+	header.device = device;
+	header.delta_us = delta_us > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(delta_us);
+	/* Advance by what was written so rounding does not accumulate. */
+	recorder.last_ns += static_cast<uint64_t>(header.delta_us) * 1000u;
+
+	std::fwrite(&header, sizeof(header), 1, recorder.file);
+	if (size > 0) {
+		std::fwrite(payload, size, 1, recorder.file);
+	}
+	recorder.records++;
+}
+
+void recorded_tool_destroy(Listener *listener, void * /*data*/) {
+	RecordedTool *recorded = wl_container_of(listener, recorded, destroy);
+	wl_list_remove(&recorded->destroy.link);
+	wl_list_remove(&recorded->link);
+	delete recorded;
+}
+
+uint16_t recorded_tool_id(struct wlr_tablet_tool *tool) {
+	RecordedTool *recorded = nullptr;
+	wl_list_for_each(recorded, &recorder.tools, link) {
+		if (recorded->tool == tool) {
+			return recorded->id;
+		}
+	}
+
+	recorded = new RecordedTool{};
+	recorded->id = recorder.next_tool_id++;
+	recorded->tool = tool;
+	recorded->destroy.notify = recorded_tool_destroy;
+	wl_signal_add(&tool->events.destroy, &recorded->destroy);
+	wl_list_insert(&recorder.tools, &recorded->link);
+
+	ToolPayload payload{};
+	payload.hardware_serial = tool->hardware_serial;
+	payload.hardware_wacom = tool->hardware_wacom;
+	payload.type = static_cast<uint32_t>(tool->type);
+	payload.capabilities = (tool->tilt ? TOOL_HAS_TILT : 0) |
+		(tool->pressure ? TOOL_HAS_PRESSURE : 0) |
+		(tool->distance ? TOOL_HAS_DISTANCE : 0) |
+		(tool->rotation ? TOOL_HAS_ROTATION : 0) |
+		(tool->slider ? TOOL_HAS_SLIDER : 0) |
+		(tool->wheel ? TOOL_HAS_WHEEL : 0);
+	write_record(RECORD_TOOL_ADDED, recorded->id, &payload, sizeof(payload));
+	return recorded->id;
+}
+
+void record_key(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, key);
+	auto *event = static_cast<KeyboardKeyEvent *>(data);
+	KeyPayload payload{event->keycode, static_cast<uint32_t>(event->state)};
+	write_record(RECORD_KEY, recorded->id, &payload, sizeof(payload));
+}
+
+void record_motion(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, motion);
+	auto *event = static_cast<PointerMotionEvent *>(data);
+	MotionPayload payload{
+		static_cast<float>(event->delta_x),
+		static_cast<float>(event->delta_y),
+		static_cast<float>(event->unaccel_dx),
+		static_cast<float>(event->unaccel_dy),
+	};
+	write_record(RECORD_POINTER_MOTION, recorded->id, &payload, sizeof(payload));
+}
+
+void record_motion_absolute(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, motion_absolute);
+	auto *event = static_cast<PointerMotionAbsoluteEvent *>(data);
+	PositionPayload payload{event->x, event->y};
+	write_record(RECORD_POINTER_MOTION_ABSOLUTE, recorded->id, &payload, sizeof(payload));
+}
+
+void record_button(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, button);
+	auto *event = static_cast<PointerButtonEvent *>(data);
+	ButtonPayload payload{event->button, static_cast<uint32_t>(event->state)};
+	write_record(RECORD_POINTER_BUTTON, recorded->id, &payload, sizeof(payload));
+}
+
+void record_axis(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, axis);
+	auto *event = static_cast<PointerAxisEvent *>(data);
+	AxisPayload payload{};
+	payload.delta = event->delta;
+	payload.delta_discrete = event->delta_discrete;
+	payload.source = static_cast<uint8_t>(event->source);
+	payload.orientation = static_cast<uint8_t>(event->orientation);
+	payload.relative_direction = static_cast<uint8_t>(event->relative_direction);
+	write_record(RECORD_POINTER_AXIS, recorded->id, &payload, sizeof(payload));
+}
+
+void record_frame(Listener *listener, void * /*data*/) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, frame);
+	write_record(RECORD_POINTER_FRAME, recorded->id, nullptr, 0);
+}
+
+void record_touch_down(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, touch_down);
+	auto *event = static_cast<TouchDownEvent *>(data);
+	TouchPayload payload{event->touch_id, 0, event->x, event->y};
+	write_record(RECORD_TOUCH_DOWN, recorded->id, &payload, sizeof(payload));
+}
+
+void record_touch_up(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, touch_up);
+	auto *event = static_cast<TouchUpEvent *>(data);
+	TouchPayload payload{event->touch_id, 0, 0.0, 0.0};
+	write_record(RECORD_TOUCH_UP, recorded->id, &payload, sizeof(payload));
+}
+
+void record_touch_motion(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, touch_motion);
+	auto *event = static_cast<TouchMotionEvent *>(data);
+	TouchPayload payload{event->touch_id, 0, event->x, event->y};
+	write_record(RECORD_TOUCH_MOTION, recorded->id, &payload, sizeof(payload));
+}
+
+void record_touch_cancel(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, touch_cancel);
+	auto *event = static_cast<TouchCancelEvent *>(data);
+	TouchPayload payload{event->touch_id, 0, 0.0, 0.0};
+	write_record(RECORD_TOUCH_CANCEL, recorded->id, &payload, sizeof(payload));
+}
+
+void record_touch_frame(Listener *listener, void * /*data*/) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, touch_frame);
+	write_record(RECORD_TOUCH_FRAME, recorded->id, nullptr, 0);
+}
+
+void record_tablet_axis(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, tablet_axis);
+	auto *event = static_cast<wlr_tablet_tool_axis_event *>(data);
+	TabletAxisPayload payload{};
+	payload.tool = recorded_tool_id(event->tool);
+	payload.updated_axes = event->updated_axes;
+	payload.x = static_cast<float>(event->x);
+	payload.y = static_cast<float>(event->y);
+	payload.dx = static_cast<float>(event->dx);
+	payload.dy = static_cast<float>(event->dy);
+	payload.pressure = static_cast<float>(event->pressure);
+	payload.distance = static_cast<float>(event->distance);
+	payload.tilt_x = static_cast<float>(event->tilt_x);
+	payload.tilt_y = static_cast<float>(event->tilt_y);
+	payload.rotation = static_cast<float>(event->rotation);
+	payload.slider = static_cast<float>(event->slider);
+	payload.wheel_delta = static_cast<float>(event->wheel_delta);
+	write_record(RECORD_TABLET_AXIS, recorded->id, &payload, sizeof(payload));
+}
+
+void record_tablet_proximity(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, tablet_proximity);
+	auto *event = static_cast<wlr_tablet_tool_proximity_event *>(data);
+	TabletStatePayload payload{};
+	payload.tool = recorded_tool_id(event->tool);
+	payload.state = static_cast<uint32_t>(event->state);
+	payload.x = event->x;
+	payload.y = event->y;
+	write_record(RECORD_TABLET_PROXIMITY, recorded->id, &payload, sizeof(payload));
+}
+
+void record_tablet_tip(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, tablet_tip);
+	auto *event = static_cast<wlr_tablet_tool_tip_event *>(data);
+	TabletStatePayload payload{};
+	payload.tool = recorded_tool_id(event->tool);
+	payload.state = static_cast<uint32_t>(event->state);
+	payload.x = event->x;
+	payload.y = event->y;
+	write_record(RECORD_TABLET_TIP, recorded->id, &payload, sizeof(payload));
+}
+
+void record_tablet_button(Listener *listener, void *data) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, tablet_button);
+	auto *event = static_cast<wlr_tablet_tool_button_event *>(data);
+	TabletButtonPayload payload{};
+	payload.tool = recorded_tool_id(event->tool);
+	payload.button = event->button;
+	payload.state = static_cast<uint32_t>(event->state);
+	write_record(RECORD_TABLET_BUTTON, recorded->id, &payload, sizeof(payload));
+}
+
+void recorded_device_destroy(Listener *listener, void * /*data*/) {
+	RecordedDevice *recorded = wl_container_of(listener, recorded, destroy);
+	if (recorder.file != nullptr) {
+		write_record(RECORD_DEVICE_REMOVED, recorded->id, nullptr, 0);
+	}
+	wl_list_remove(&recorded->key.link);
+	wl_list_remove(&recorded->motion.link);
+	wl_list_remove(&recorded->motion_absolute.link);
+	wl_list_remove(&recorded->button.link);
+	wl_list_remove(&recorded->axis.link);
+	wl_list_remove(&recorded->frame.link);
+	wl_list_remove(&recorded->touch_down.link);
+	wl_list_remove(&recorded->touch_up.link);
+	wl_list_remove(&recorded->touch_motion.link);
+	wl_list_remove(&recorded->touch_cancel.link);
+	wl_list_remove(&recorded->touch_frame.link);
+	wl_list_remove(&recorded->tablet_axis.link);
+	wl_list_remove(&recorded->tablet_proximity.link);
+	wl_list_remove(&recorded->tablet_tip.link);
+	wl_list_remove(&recorded->tablet_button.link);
+	wl_list_remove(&recorded->destroy.link);
+	wl_list_remove(&recorded->link);
+	delete recorded;
+}
+
+void add_listener(Listener *listener, wl_signal *signal, wl_notify_func_t notify) {
+	listener->notify = notify;
+	wl_signal_add(signal, listener);
+}
+
+/* ---- Replay ------------------------------------------------------------- */
+
+struct ReplayDevice {
+	List link;
+	uint16_t id;
+	enum wlr_input_device_type type;
+	char name[64];
+	Keyboard keyboard;
+	struct wlr_pointer pointer;
+	struct wlr_touch touch;
+	struct wlr_tablet tablet;
+};
+
+struct ReplayTool {
+	List link;
+	uint16_t id;
+	struct wlr_tablet_tool tool;
+};
+
+struct ReplayKindStats {
+	uint64_t count;
+	uint64_t handler_ns;
+};
+
+struct InputReplay {
+	KristalServer *server;
+	FILE *file;
+	wl_event_source *timer;
+	double speed;
+	bool exit_when_done;
+	uint64_t start_ns;
+	uint64_t offset_us;
+	bool have_record;
+	RecordHeader header;
+	unsigned char payload[256];
+	List devices;
+	List tools;
+	rusage start_usage;
+	ReplayKindStats stats[RECORD_KIND_COUNT];
+};
+
+InputReplay replay{};
+
+const struct wlr_keyboard_impl replay_keyboard_impl = {"kristal-replay-keyboard", nullptr};
+const struct wlr_pointer_impl replay_pointer_impl = {"kristal-replay-pointer"};
+const struct wlr_touch_impl replay_touch_impl = {"kristal-replay-touch"};
+const struct wlr_tablet_impl replay_tablet_impl = {"kristal-replay-tablet"};
+
+ReplayDevice *find_replay_device(uint16_t id) {
+	ReplayDevice *device = nullptr;
+	wl_list_for_each(device, &replay.devices, link) {
+		if (device->id == id) {
+			return device;
+		}
+	}
+	return nullptr;
+}
+
+struct wlr_tablet_tool *find_replay_tool(uint16_t id) {
+	ReplayTool *tool = nullptr;
+	wl_list_for_each(tool, &replay.tools, link) {
+		if (tool->id == id) {
+			return &tool->tool;
+		}
+	}
+	return nullptr;
+}
+
+void replay_device_destroy(ReplayDevice *device) {
+	switch (device->type) {
+	case WLR_INPUT_DEVICE_KEYBOARD:
+		wlr_keyboard_finish(&device->keyboard);
+		break;
+	case WLR_INPUT_DEVICE_POINTER:
+		wlr_pointer_finish(&device->pointer);
+		break;
+	case WLR_INPUT_DEVICE_TOUCH:
+		wlr_touch_finish(&device->touch);
+		break;
+	case WLR_INPUT_DEVICE_TABLET:
+		wlr_tablet_finish(&device->tablet);
+		break;
+	default:
+		break;
+	}
+	wl_list_remove(&device->link);
+	delete device;
+}
+
+void replay_add_device(uint16_t id, const DevicePayload *payload) {
+	auto *device = new ReplayDevice{};
+	device->id = id;
+	device->type = static_cast<enum wlr_input_device_type>(payload->type);
+	const size_t available = replay.header.size - offsetof(DevicePayload, name);
+	const int name_len = static_cast<int>(
+		payload->name_len <= available ? payload->name_len : available);
+	std::snprintf(device->name, sizeof(device->name), "replay: %.*s", name_len, payload->name);
+
+	InputDevice *base = nullptr;
+	switch (device->type) {
+	case WLR_INPUT_DEVICE_KEYBOARD:
+		wlr_keyboard_init(&device->keyboard, &replay_keyboard_impl, device->name);
+		base = &device->keyboard.base;
+		break;
+	case WLR_INPUT_DEVICE_POINTER:
+		wlr_pointer_init(&device->pointer, &replay_pointer_impl, device->name);
+		base = &device->pointer.base;
+		break;
+	case WLR_INPUT_DEVICE_TOUCH:
+		wlr_touch_init(&device->touch, &replay_touch_impl, device->name);
+		base = &device->touch.base;
+		break;
+	case WLR_INPUT_DEVICE_TABLET:
+		wlr_tablet_init(&device->tablet, &replay_tablet_impl, device->name);
+		base = &device->tablet.base;
+		break;
+	default:
+		wlr_log(WLR_ERROR, "input replay: skipping device of unknown type %u", payload->type);
+		delete device;
+		return;
+	}
+	wl_list_insert(&replay.devices, &device->link);
+	/* Announce it the way a backend would, so server_new_input sets it up. */
+	wl_signal_emit_mutable(&replay.server->backend->events.new_input, base);
+}
+
+void replay_add_tool(uint16_t id, const ToolPayload *payload) {
+	auto *tool = new ReplayTool{};
+	tool->id = id;
+	tool->tool.type = static_cast<enum wlr_tablet_tool_type>(payload->type);
+	tool->tool.hardware_serial = payload->hardware_serial;
+	tool->tool.hardware_wacom = payload->hardware_wacom;
+	tool->tool.tilt = (payload->capabilities & TOOL_HAS_TILT) != 0;
+	tool->tool.pressure = (payload->capabilities & TOOL_HAS_PRESSURE) != 0;
+	tool->tool.distance = (payload->capabilities & TOOL_HAS_DISTANCE) != 0;
+	tool->tool.rotation = (payload->capabilities & TOOL_HAS_ROTATION) != 0;
+	tool->tool.slider = (payload->capabilities & TOOL_HAS_SLIDER) != 0;
+	tool->tool.wheel = (payload->capabilities & TOOL_HAS_WHEEL) != 0;
+	wl_signal_init(&tool->tool.events.destroy);
+	wl_list_insert(&replay.tools, &tool->link);
+}
+
+template <typename T>
+const T *payload_as(size_t minimum = sizeof(T)) {
+	if (replay.header.size < minimum) {
+		return nullptr;
+	}
+	return reinterpret_cast<const T *>(replay.payload);
+}
+
+void inject_record() {
+	const RecordHeader &header = replay.header;
+	if (header.kind == RECORD_DEVICE_ADDED) {
+		if (auto *payload = payload_as<DevicePayload>(offsetof(DevicePayload, name))) {
+			replay_add_device(header.device, payload);
+		}
+		return;
+	}
+	if (header.kind == RECORD_TOOL_ADDED) {
+		if (auto *payload = payload_as<ToolPayload>()) {
+			replay_add_tool(header.device, payload);
+		}
+		return;
+	}
+
+	ReplayDevice *device = find_replay_device(header.device);
+	if (device == nullptr) {
+		return;
+	}
+	if (header.kind == RECORD_DEVICE_REMOVED) {
+		replay_device_destroy(device);
+		return;
+	}
+
+	const uint32_t time_msec = event_time_msec();
+	switch (header.kind) {
+	case RECORD_KEY: {
+		auto *payload = payload_as<KeyPayload>();
+		if (payload == nullptr || device->type != WLR_INPUT_DEVICE_KEYBOARD) {
+			return;
+		}
+		KeyboardKeyEvent event{};
+		event.time_msec = time_msec;
+		event.keycode = payload->keycode;
+		event.update_state = true;
+		event.state = static_cast<enum wl_keyboard_key_state>(payload->state);
+		wlr_keyboard_notify_key(&device->keyboard, &event);
+		break;
+	}
+	case RECORD_POINTER_MOTION: {
+		auto *payload = payload_as<MotionPayload>();
+		if (payload == nullptr || device->type != WLR_INPUT_DEVICE_POINTER) {
+			return;
+		}
+		PointerMotionEvent event{};
+		event.pointer = &device->pointer;
+		event.time_msec = time_msec;
+		event.delta_x = payload->delta_x;
+		event.delta_y = payload->delta_y;
+		event.unaccel_dx = payload->unaccel_dx;
+		event.unaccel_dy = payload->unaccel_dy;
+		wl_signal_emit_mutable(&device->pointer.events.motion, &event);
+		break;
+	}
+	case RECORD_POINTER_MOTION_ABSOLUTE: {
+		auto *payload = payload_as<PositionPayload>();
+		if (payload == nullptr || device->type != WLR_INPUT_DEVICE_POINTER) {
+			return;
+		}
+		PointerMotionAbsoluteEvent event{};
+		event.pointer = &device->pointer;
+		event.time_msec = time_msec;
+		event.x = payload->x;
+		event.y = payload->y;
+		wl_signal_emit_mutable(&device->pointer.events.motion_absolute, &event);
+		break;
+	}
+	case RECORD_POINTER_BUTTON: {
+		auto *payload = payload_as<ButtonPayload>();
+		if (payload == nullptr || device->type != WLR_INPUT_DEVICE_POINTER) {
+			return;
+		}
+		PointerButtonEvent event{};
+		event.pointer = &device->pointer;
+		event.time_msec = time_msec;
+		event.button = payload->button;
+		event.state = static_cast<decltype(event.state)>(payload->state);
+		wl_signal_emit_mutable(&device->pointer.events.button, &event);
+		break;
+	}
+	case RECORD_POINTER_AXIS: {
+		auto *payload = payload_as<AxisPayload>();
+		if (payload == nullptr || device->type != WLR_INPUT_DEVICE_POINTER) {
+			return;
+		}
+		PointerAxisEvent event{};
+		event.pointer = &device->pointer;
+		event.time_msec = time_msec;
+		event.source = static_cast<decltype(event.source)>(payload->source);
+		event.orientation = static_cast<decltype(event.orientation)>(payload->orientation);
+		event.relative_direction =
+			static_cast<decltype(event.relative_direction)>(payload->relative_direction);
+		event.delta = payload->delta;
+		event.delta_discrete = payload->delta_discrete;
+		wl_signal_emit_mutable(&device->pointer.events.axis, &event);
+		break;
+	}
+	case RECORD_POINTER_FRAME:
+		if (device->type == WLR_INPUT_DEVICE_POINTER) {
+			wl_signal_emit_mutable(&device->pointer.events.frame, &device->pointer);
+		}
+		break;
+	case RECORD_TOUCH_DOWN:
+	case RECORD_TOUCH_MOTION: {
+		auto *payload = payload_as<TouchPayload>();
+		if (payload == nullptr || device->type != WLR_INPUT_DEVICE_TOUCH) {
+			return;
+		}
+		if (header.kind == RECORD_TOUCH_DOWN) {
+			TouchDownEvent event{};
+			event.touch = &device->touch;
+			event.time_msec = time_msec;
+			event.touch_id = payload->touch_id;
+			event.x = payload->x;
+			event.y = payload->y;
+			wl_signal_emit_mutable(&device->touch.events.down, &event);
+		} else {
+			TouchMotionEvent event{};
+			event.touch = &device->touch;
+			event.time_msec = time_msec;
+			event.touch_id = payload->touch_id;
+			event.x = payload->x;
+			event.y = payload->y;
+			wl_signal_emit_mutable(&device->touch.events.motion, &event);
+		}
+		break;
+	}
+	case RECORD_TOUCH_UP:
+	case RECORD_TOUCH_CANCEL: {
+		auto *payload = payload_as<TouchPayload>();
+		if (payload == nullptr || device->type != WLR_INPUT_DEVICE_TOUCH) {
+			return;
+		}
+		if (header.kind == RECORD_TOUCH_UP) {
+			TouchUpEvent event{};
+			event.touch = &device->touch;
+			event.time_msec = time_msec;
+			event.touch_id = payload->touch_id;
+			wl_signal_emit_mutable(&device->touch.events.up, &event);
+		} else {
+			TouchCancelEvent event{};
+			event.touch = &device->touch;
+			event.time_msec = time_msec;
+			event.touch_id = payload->touch_id;
+			wl_signal_emit_mutable(&device->touch.events.cancel, &event);
+		}
+		break;
+	}
+	case RECORD_TOUCH_FRAME:
+		if (device->type == WLR_INPUT_DEVICE_TOUCH) {
+			wl_signal_emit_mutable(&device->touch.events.frame, nullptr);
+		}
+		break;
+	case RECORD_TABLET_AXIS: {
+		auto *payload = payload_as<TabletAxisPayload>();
+		if (payload == nullptr || device->type != WLR_INPUT_DEVICE_TABLET) {
+			return;
+		}
+		auto *tool = find_replay_tool(payload->tool);
+		if (tool == nullptr) {
+			return;
+		}
+		wlr_tablet_tool_axis_event event{};
+		event.tablet = &device->tablet;
+		event.tool = tool;
+		event.time_msec = time_msec;
+		event.updated_axes = payload->updated_axes;
+		event.x = payload->x;
+		event.y = payload->y;
+		event.dx = payload->dx;
+		event.dy = payload->dy;
+		event.pressure = payload->pressure;
+		event.distance = payload->distance;
+		event.tilt_x = payload->tilt_x;
+		event.tilt_y = payload->tilt_y;
+		event.rotation = payload->rotation;
+		event.slider = payload->slider;
+		event.wheel_delta = payload->wheel_delta;
+		wl_signal_emit_mutable(&device->tablet.events.axis, &event);
+		break;
+	}
+	case RECORD_TABLET_PROXIMITY:
+	case RECORD_TABLET_TIP: {
+		auto *payload = payload_as<TabletStatePayload>();
+		if (payload == nullptr || device->type != WLR_INPUT_DEVICE_TABLET) {
+			return;
+		}
+		auto *tool = find_replay_tool(payload->tool);
+		if (tool == nullptr) {
+			return;
+		}
+		if (header.kind == RECORD_TABLET_PROXIMITY) {
+			wlr_tablet_tool_proximity_event event{};
+			event.tablet = &device->tablet;
+			event.tool = tool;
+			event.time_msec = time_msec;
+			event.x = payload->x;
+			event.y = payload->y;
+			event.state = static_cast<decltype(event.state)>(payload->state);
+			wl_signal_emit_mutable(&device->tablet.events.proximity, &event);
+		} else {
+			wlr_tablet_tool_tip_event event{};
+			event.tablet = &device->tablet;
+			event.tool = tool;
+			event.time_msec = time_msec;
+			event.x = payload->x;
+			event.y = payload->y;
+			event.state = static_cast<decltype(event.state)>(payload->state);
+			wl_signal_emit_mutable(&device->tablet.events.tip, &event);
+		}
+		break;
+	}
+	case RECORD_TABLET_BUTTON: {
+		auto *payload = payload_as<TabletButtonPayload>();
+		if (payload == nullptr || device->type != WLR_INPUT_DEVICE_TABLET) {
+			return;
+		}
+		auto *tool = find_replay_tool(payload->tool);
+		if (tool == nullptr) {
+			return;
+		}
+		wlr_tablet_tool_button_event event{};
+		event.tablet = &device->tablet;
+		event.tool = tool;
+		event.time_msec = time_msec;
+		event.button = payload->button;
+		event.state = static_cast<decltype(event.state)>(payload->state);
+		wl_signal_emit_mutable(&device->tablet.events.button, &event);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+bool read_next_record() {
+	replay.have_record = false;
+	if (std::fread(&replay.header, sizeof(replay.header), 1, replay.file) != 1) {
+		return false;
+	}
+	if (replay.header.size > 0 &&
+		std::fread(replay.payload, replay.header.size, 1, replay.file) != 1) {
+		wlr_log(WLR_ERROR, "input replay: truncated record");
+		return false;
+	}
+	replay.offset_us += replay.header.delta_us;
+	replay.have_record = true;
+	return true;
+}
+
+double timeval_ms(const timeval &value) {
+	return static_cast<double>(value.tv_sec) * 1000.0 +
+		static_cast<double>(value.tv_usec) / 1000.0;
+}
+
+void finish_replay() {
+	rusage end_usage{};
+	getrusage(RUSAGE_SELF, &end_usage);
+	const double wall_ms =
+		static_cast<double>(kristal_now_ns() - replay.start_ns) / 1000000.0;
+	const double user_ms = timeval_ms(end_usage.ru_utime) - timeval_ms(replay.start_usage.ru_utime);
+	const double system_ms = timeval_ms(end_usage.ru_stime) - timeval_ms(replay.start_usage.ru_stime);
+
+	uint64_t total = 0;
+	for (int kind = 0; kind < RECORD_KIND_COUNT; ++kind) {
+		total += replay.stats[kind].count;
+	}
+	wlr_log(
+		WLR_INFO,
+		"input replay: %llu records in %.1f ms wall, %.1f ms user + %.1f ms system CPU",
+		static_cast<unsigned long long>(total),
+		wall_ms,
+		user_ms,
+		system_ms);
+	for (int kind = RECORD_KEY; kind < RECORD_KIND_COUNT; ++kind) {
+		const ReplayKindStats &stats = replay.stats[kind];
+		if (stats.count == 0) {
+			continue;
+		}
+		wlr_log(
+			WLR_INFO,
+			"input replay: %-16s n=%llu handler mean=%.2f us total=%.2f ms",
+			kRecordKindNames[kind],
+			static_cast<unsigned long long>(stats.count),
+			static_cast<double>(stats.handler_ns) / stats.count / 1000.0,
+			static_cast<double>(stats.handler_ns) / 1000000.0);
+	}
+
+	std::fclose(replay.file);
+	replay.file = nullptr;
+	wl_event_source_remove(replay.timer);
+	replay.timer = nullptr;
+
+	ReplayDevice *device = nullptr;
+	ReplayDevice *device_tmp = nullptr;
+	wl_list_for_each_safe(device, device_tmp, &replay.devices, link) {
+		replay_device_destroy(device);
+	}
+	ReplayTool *tool = nullptr;
+	ReplayTool *tool_tmp = nullptr;
+	wl_list_for_each_safe(tool, tool_tmp, &replay.tools, link) {
+		wl_signal_emit_mutable(&tool->tool.events.destroy, &tool->tool);
+		wl_list_remove(&tool->link);
+		delete tool;
+	}
+
+	if (replay.exit_when_done) {
+		wl_display_terminate(replay.server->display);
+	}
+}
+
+int replay_tick(void * /*data*/) {
+	const uint64_t now = kristal_now_ns();
+	for (int budget = kReplayBatch; replay.have_record; --budget) {
+		if (replay.speed > 0.0) {
+			const uint64_t due = replay.start_ns +
+				static_cast<uint64_t>(static_cast<double>(replay.offset_us) * 1000.0 / replay.speed);
+			if (due > now) {
+				const uint64_t wait_ms = (due - now + 999999u) / 1000000u;
+				wl_event_source_timer_update(replay.timer, static_cast<int>(wait_ms));
+				return 0;
+			}
+		}
+		if (budget == 0) {
+			/* Yield so clients and outputs get to run between batches. */
+			wl_event_source_timer_update(replay.timer, 1);
+			return 0;
+		}
+
+		const uint8_t kind = replay.header.kind < RECORD_KIND_COUNT ? replay.header.kind : 0;
+		const uint64_t before = kristal_now_ns();
+		inject_record();
+		replay.stats[kind].count++;
+		replay.stats[kind].handler_ns += kristal_now_ns() - before;
+		read_next_record();
+	}
+	finish_replay();
+	return 0;
+}
+
+double parse_replay_speed() {
+	const char *value = getenv("KRISTAL_REPLAY_SPEED");
+	if (value == nullptr || value[0] == '\0') {
+		return 1.0;
+	}
+	char *end = nullptr;
+	errno = 0;
+	const double speed = strtod(value, &end);
+	if (errno != 0 || end == value || (end != nullptr && *end != '\0') ||
+		!std::isfinite(speed) || speed < 0.0) {
+		wlr_log(
+			WLR_ERROR,
+			"Ignoring invalid KRISTAL_REPLAY_SPEED='%s'; expected factor >= 0 (0 = unthrottled)",
+			value);
+		return 1.0;
+	}
+	return speed;
+}
+
+} // namespace
+
+void server_input_record_init(KristalServer * /*server*/) {
+	wl_list_init(&recorder.devices);
+	wl_list_init(&recorder.tools);
+	const char *path = getenv("KRISTAL_INPUT_RECORD");
+	if (path == nullptr || path[0] == '\0') {
+		return;
+	}
+	recorder.file = std::fopen(path, "wbe");
+	if (recorder.file == nullptr) {
+		wlr_log(WLR_ERROR, "input record: cannot open %s: %s", path, std::strerror(errno));
+		return;
+	}
+	/* Keep writes off the input path's syscall budget. */
+	std::setvbuf(recorder.file, nullptr, _IOFBF, 1 << 16);
+	LogHeader header{};
+	std::memcpy(header.magic, kLogMagic, sizeof(header.magic));
+	header.version = kLogVersion;
+	std::fwrite(&header, sizeof(header), 1, recorder.file);
+	recorder.last_ns = kristal_now_ns();
+	wlr_log(WLR_INFO, "Recording input to %s", path);
+}
+
+void server_input_record_device(KristalServer * /*server*/, InputDevice *device) {
+	if (recorder.file == nullptr) {
+		return;
+	}
+
+	auto *recorded = new RecordedDevice{};
+	recorded->id = recorder.next_device_id++;
+	recorded->device = device;
+	wl_list_init(&recorded->key.link);
+	wl_list_init(&recorded->motion.link);
+	wl_list_init(&recorded->motion_absolute.link);
+	wl_list_init(&recorded->button.link);
+	wl_list_init(&recorded->axis.link);
+	wl_list_init(&recorded->frame.link);
+	wl_list_init(&recorded->touch_down.link);
+	wl_list_init(&recorded->touch_up.link);
+	wl_list_init(&recorded->touch_motion.link);
+	wl_list_init(&recorded->touch_cancel.link);
+	wl_list_init(&recorded->touch_frame.link);
+	wl_list_init(&recorded->tablet_axis.link);
+	wl_list_init(&recorded->tablet_proximity.link);
+	wl_list_init(&recorded->tablet_tip.link);
+	wl_list_init(&recorded->tablet_button.link);
+
+	switch (device->type) {
+	case WLR_INPUT_DEVICE_KEYBOARD: {
+		auto *keyboard = wlr_keyboard_from_input_device(device);
+		add_listener(&recorded->key, &keyboard->events.key, record_key);
+		break;
+	}
+	case WLR_INPUT_DEVICE_POINTER: {
+		auto *pointer = wlr_pointer_from_input_device(device);
+		add_listener(&recorded->motion, &pointer->events.motion, record_motion);
+		add_listener(&recorded->motion_absolute, &pointer->events.motion_absolute, record_motion_absolute);
+		add_listener(&recorded->button, &pointer->events.button, record_button);
+		add_listener(&recorded->axis, &pointer->events.axis, record_axis);
+		add_listener(&recorded->frame, &pointer->events.frame, record_frame);
+		break;
+	}
+	case WLR_INPUT_DEVICE_TOUCH: {
+		auto *touch = wlr_touch_from_input_device(device);
+		add_listener(&recorded->touch_down, &touch->events.down, record_touch_down);
+		add_listener(&recorded->touch_up, &touch->events.up, record_touch_up);
+		add_listener(&recorded->touch_motion, &touch->events.motion, record_touch_motion);
+		add_listener(&recorded->touch_cancel, &touch->events.cancel, record_touch_cancel);
+		add_listener(&recorded->touch_frame, &touch->events.frame, record_touch_frame);
+		break;
+	}
+	case WLR_INPUT_DEVICE_TABLET: {
+		auto *tablet = wlr_tablet_from_input_device(device);
+		add_listener(&recorded->tablet_axis, &tablet->events.axis, record_tablet_axis);
+		add_listener(&recorded->tablet_proximity, &tablet->events.proximity, record_tablet_proximity);
+		add_listener(&recorded->tablet_tip, &tablet->events.tip, record_tablet_tip);
+		add_listener(&recorded->tablet_button, &tablet->events.button, record_tablet_button);
+		break;
+	}
+	default:
+		delete recorded;
+		return;
+	}
+	add_listener(&recorded->destroy, &device->events.destroy, recorded_device_destroy);
+	wl_list_insert(&recorder.devices, &recorded->link);
+
+	DevicePayload payload{};
+	payload.type = static_cast<uint8_t>(device->type);
+	const char *name = device->name != nullptr ? device->name : "";
+	const size_t name_len = std::strlen(name);
+	payload.name_len = static_cast<uint8_t>(
+		name_len < sizeof(payload.name) ? name_len : sizeof(payload.name));
+	std::memcpy(payload.name, name, payload.name_len);
+	write_record(
+		RECORD_DEVICE_ADDED,
+		recorded->id,
+		&payload,
+		offsetof(DevicePayload, name) + payload.name_len);
+}
+
+void server_input_record_finish(KristalServer * /*server*/) {
+	if (recorder.file == nullptr) {
+		return;
+	}
+	RecordedDevice *recorded = nullptr;
+	RecordedDevice *tmp = nullptr;
+	wl_list_for_each_safe(recorded, tmp, &recorder.devices, link) {
+		recorded_device_destroy(&recorded->destroy, nullptr);
+	}
+	RecordedTool *tool = nullptr;
+	RecordedTool *tool_tmp = nullptr;
+	wl_list_for_each_safe(tool, tool_tmp, &recorder.tools, link) {
+		recorded_tool_destroy(&tool->destroy, nullptr);
+	}
+	std::fclose(recorder.file);
+	recorder.file = nullptr;
+	wlr_log(
+		WLR_INFO,
+		"input record: wrote %llu records",
+		static_cast<unsigned long long>(recorder.records));
+}
+
+/*
+ * Replay runs on the headless backend unless the caller picked one, so the
+ * recorded session is the only input the handlers see.
+ */
+void kristal_input_replay_configure_backend(void) {
+	const char *path = getenv("KRISTAL_INPUT_REPLAY");
+	if (path == nullptr || path[0] == '\0') {
+		return;
+	}
+	setenv("WLR_BACKENDS", "headless", 0);
+	setenv("WLR_HEADLESS_OUTPUTS", "1", 0);
+}
+
+void server_input_replay_start(KristalServer *server) {
+	replay.server = server;
+	wl_list_init(&replay.devices);
+	wl_list_init(&replay.tools);
+	const char *path = getenv("KRISTAL_INPUT_REPLAY");
+	if (path == nullptr || path[0] == '\0') {
+		return;
+	}
+
+	replay.file = std::fopen(path, "rbe");
+	if (replay.file == nullptr) {
+		wlr_log(WLR_ERROR, "input replay: cannot open %s: %s", path, std::strerror(errno));
+		return;
+	}
+	LogHeader header{};
+	if (std::fread(&header, sizeof(header), 1, replay.file) != 1 ||
+		std::memcmp(header.magic, kLogMagic, sizeof(header.magic)) != 0 ||
+		header.version != kLogVersion) {
+		wlr_log(WLR_ERROR, "input replay: %s is not a kristal input log", path);
+		std::fclose(replay.file);
+		replay.file = nullptr;
+		return;
+	}
+
+	replay.speed = parse_replay_speed();
+	const char *exit_value = getenv("KRISTAL_REPLAY_EXIT");
+	replay.exit_when_done = exit_value != nullptr && exit_value[0] != '\0' &&
+		std::strcmp(exit_value, "0") != 0;
+	replay.timer = wl_event_loop_add_timer(
+		wl_display_get_event_loop(server->display),
+		replay_tick,
+		nullptr);
+	if (replay.timer == nullptr) {
+		wlr_log(WLR_ERROR, "input replay: failed to create timer");
+		std::fclose(replay.file);
+		replay.file = nullptr;
+		return;
+	}
+
+	replay.offset_us = 0;
+	read_next_record();
+	replay.start_ns = kristal_now_ns();
+	getrusage(RUSAGE_SELF, &replay.start_usage);
+	wl_event_source_timer_update(replay.timer, 1);
+	wlr_log(WLR_INFO, "Replaying input from %s at speed %.2f", path, replay.speed);
+}
+
+void server_input_replay_finish(KristalServer * /*server*/) {
+	if (replay.file != nullptr) {
+		finish_replay();
+	}
+}
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cmath>
+
+#include "layout/Layout.h"
+
+namespace {
+
+/* Rows of the full width; the last row absorbs the rounding remainder. */
+KristalLayoutBox stack_cell(const KristalLayoutBox &area, size_t index, size_t tiled) {
+	const int count = static_cast<int>(tiled);
+	const int row = static_cast<int>(index);
+	const int base_height = area.height / count;
+	const int extra_height = area.height - base_height * count;
+	return KristalLayoutBox{
+		area.x,
+		area.y + row * base_height,
+		area.width,
+		base_height + (row == count - 1 ? extra_height : 0),
+	};
+}
+
+struct GridShape {
+	int cols;
+	int rows;
+	int base_width;
+	int extra_width;
+	int base_height;
+	int extra_height;
+};
+
+GridShape grid_shape(const KristalLayoutBox &area, size_t tiled) {
+	GridShape shape{};
+	shape.cols = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(tiled)))));
+	shape.rows = std::max(1, (static_cast<int>(tiled) + shape.cols - 1) / shape.cols);
+	shape.base_width = area.width / shape.cols;
+	shape.extra_width = area.width - shape.base_width * shape.cols;
+	shape.base_height = area.height / shape.rows;
+	shape.extra_height = area.height - shape.base_height * shape.rows;
+	return shape;
+}
+
+KristalLayoutBox grid_cell(const KristalLayoutBox &area, const GridShape &shape, size_t index) {
+	const int col = static_cast<int>(index) % shape.cols;
+	const int row = static_cast<int>(index) / shape.cols;
+	return KristalLayoutBox{
+		area.x + col * shape.base_width,
+		area.y + row * shape.base_height,
+		shape.base_width + (col == shape.cols - 1 ? shape.extra_width : 0),
+		shape.base_height + (row == shape.rows - 1 ? shape.extra_height : 0),
+	};
+}
+
+} // namespace
+
+size_t kristal_layout_compute(
+	enum WindowLayoutMode mode,
+	const KristalLayoutBox *area,
+	const KristalLayoutView *views,
+	size_t count,
+	KristalLayoutBox *boxes) {
+	size_t tiled = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (views[i].state == KRISTAL_LAYOUT_TILED) {
+			tiled++;
+		}
+	}
+	const bool arranges = mode != WINDOW_LAYOUT_FLOATING && tiled > 0 &&
+		area->width > 0 && area->height > 0;
+	const GridShape shape = mode == WINDOW_LAYOUT_GRID && arranges
+		? grid_shape(*area, tiled)
+		: GridShape{};
+
+	size_t index = 0;
+	for (size_t i = 0; i < count; ++i) {
+		switch (views[i].state) {
+		case KRISTAL_LAYOUT_FULLSCREEN:
+			boxes[i] = *area;
+			continue;
+		case KRISTAL_LAYOUT_FLOATING:
+			boxes[i] = KristalLayoutBox{};
+			continue;
+		case KRISTAL_LAYOUT_TILED:
+			break;
+		}
+		if (!arranges) {
+			boxes[i] = KristalLayoutBox{};
+			continue;
+		}
+		switch (mode) {
+		case WINDOW_LAYOUT_STACK:
+			boxes[i] = stack_cell(*area, index, tiled);
+			break;
+		case WINDOW_LAYOUT_GRID:
+			boxes[i] = grid_cell(*area, shape, index);
+			break;
+		case WINDOW_LAYOUT_MONOCLE:
+			boxes[i] = *area;
+			break;
+		case WINDOW_LAYOUT_FLOATING:
+			boxes[i] = KristalLayoutBox{};
+			break;
+		}
+		index++;
+	}
+	return arranges ? tiled : 0;
+}
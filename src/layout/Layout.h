@@ -0,0 +1,56 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/*
+ * Pure tiling math: no wlroots, no allocation. The compositor describes the
+ * views of a workspace in stacking-list order and gets one target box per
+ * view back in storage it owns, so the layout cost can be measured on its
+ * own (see kristal-layout-bench).
+ */
+
+enum WindowLayoutMode {
+	WINDOW_LAYOUT_FLOATING,
+	WINDOW_LAYOUT_STACK,
+	WINDOW_LAYOUT_GRID,
+	WINDOW_LAYOUT_MONOCLE,
+};
+
+enum KristalLayoutState {
+	KRISTAL_LAYOUT_TILED,
+	KRISTAL_LAYOUT_FLOATING,
+	KRISTAL_LAYOUT_FULLSCREEN,
+};
+
+/* Same shape as struct wlr_box. */
+struct KristalLayoutBox {
+	int x;
+	int y;
+	int width;
+	int height;
+};
+
+struct KristalLayoutView {
+	enum KristalLayoutState state;
+};
+
+/*
+ * Fill boxes[0..count) for the given mode and area. Tiled views get their
+ * cell, fullscreen views the whole area and floating views (or every view in
+ * WINDOW_LAYOUT_FLOATING) an empty box meaning "leave it where it is".
+ * Returns the number of views given a tiled cell.
+ */
+size_t kristal_layout_compute(
+	enum WindowLayoutMode mode,
+	const struct KristalLayoutBox *area,
+	const struct KristalLayoutView *views,
+	size_t count,
+	struct KristalLayoutBox *boxes);
+
+#ifdef __cplusplus
+}
+#endif
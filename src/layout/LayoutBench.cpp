@@ -0,0 +1,111 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "layout/Layout.h"
+
+/*
+ * kristal-layout-bench: times kristal_layout_compute() on its own for each
+ * tiling mode with thousands of views in a mix of tiled, floating and
+ * fullscreen states. Storage is allocated once per view count, the way the
+ * compositor reuses its scratch buffers.
+ */
+
+namespace {
+
+constexpr double kMinSampleSeconds = 0.2;
+
+struct ModeName {
+	enum WindowLayoutMode mode;
+	const char *name;
+};
+
+const ModeName kModes[] = {
+	{WINDOW_LAYOUT_STACK, "stack"},
+	{WINDOW_LAYOUT_GRID, "grid"},
+	{WINDOW_LAYOUT_MONOCLE, "monocle"},
+};
+
+/* Roughly one in seven floating and one in thirteen fullscreen. */
+void fill_views(std::vector<KristalLayoutView> *views) {
+	for (size_t i = 0; i < views->size(); ++i) {
+		KristalLayoutView &view = (*views)[i];
+		if (i % 13 == 12) {
+			view.state = KRISTAL_LAYOUT_FULLSCREEN;
+		} else if (i % 7 == 6) {
+			view.state = KRISTAL_LAYOUT_FLOATING;
+		} else {
+			view.state = KRISTAL_LAYOUT_TILED;
+		}
+	}
+}
+
+/* Folds the output into a value the compiler cannot discard. */
+uint64_t checksum(const std::vector<KristalLayoutBox> &boxes) {
+	uint64_t sum = 0;
+	for (const KristalLayoutBox &box : boxes) {
+		sum = sum * 31 + static_cast<uint64_t>(box.x + box.y * 3 + box.width * 5 + box.height * 7);
+	}
+	return sum;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	std::vector<size_t> counts = {16, 256, 1024, 4096, 16384};
+	if (argc > 1) {
+		counts.clear();
+		for (int i = 1; i < argc; ++i) {
+			const long count = std::strtol(argv[i], nullptr, 10);
+			if (count <= 0) {
+				std::fprintf(stderr, "Usage: %s [view-count...]\n", argv[0]);
+				return 1;
+			}
+			counts.push_back(static_cast<size_t>(count));
+		}
+	}
+
+	const KristalLayoutBox area{0, 0, 3840, 2160};
+	uint64_t sink = 0;
+	std::printf("%-8s %8s %12s %10s %10s\n", "mode", "views", "iterations", "ns/call", "ns/view");
+	for (size_t count : counts) {
+		std::vector<KristalLayoutView> views(count);
+		std::vector<KristalLayoutBox> boxes(count);
+		fill_views(&views);
+
+		for (const ModeName &mode : kModes) {
+			using Clock = std::chrono::steady_clock;
+			uint64_t iterations = 0;
+			const auto start = Clock::now();
+			auto elapsed = Clock::duration::zero();
+			do {
+				for (int batch = 0; batch < 64; ++batch) {
+					sink += kristal_layout_compute(
+						mode.mode,
+						&area,
+						views.data(),
+						views.size(),
+						boxes.data());
+				}
+				iterations += 64;
+				elapsed = Clock::now() - start;
+			} while (std::chrono::duration<double>(elapsed).count() < kMinSampleSeconds);
+			sink += checksum(boxes);
+
+			const double ns_per_call =
+				std::chrono::duration<double, std::nano>(elapsed).count() /
+				static_cast<double>(iterations);
+			std::printf(
+				"%-8s %8zu %12llu %10.1f %10.2f\n",
+				mode.name,
+				count,
+				static_cast<unsigned long long>(iterations),
+				ns_per_call,
+				ns_per_call / static_cast<double>(count));
+		}
+	}
+	std::printf("checksum %llu\n", static_cast<unsigned long long>(sink));
+	return 0;
+}
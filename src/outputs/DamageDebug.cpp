@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "core/internal.h"
+
+/*
+ * Runtime damage debugging. The damage-debug key action (or
+ * KRISTAL_DAMAGE_DEBUG=1 at startup) switches wlr_scene's damage highlight
+ * on and off without a restart. Turning it off, or a SIGUSR1 dump once it
+ * has been used, logs outputs and clients ranked by damaged pixels.
+ * Per-output figures include the highlight's own repaints while it is on;
+ * per-client figures come from surface commits and do not.
+ */
+
+namespace {
+
+constexpr size_t kRankedClients = 10;
+constexpr size_t kMaxRankedOutputs = 16;
+
+struct DamageDebug {
+	bool highlight;
+	bool used;
+};
+
+DamageDebug damage_debug{};
+
+double mean_fraction(const KristalOutput *output) {
+	const double area = static_cast<double>(output->wlr_output->width) * output->wlr_output->height;
+	if (output->metrics_frames == 0 || area <= 0.0) {
+		return 0.0;
+	}
+	return static_cast<double>(output->metrics_damage_pixels) /
+		static_cast<double>(output->metrics_frames) / area;
+}
+
+/* Highlights fade out on their own only while the option is on; repaint
+ * everything once so switching off leaves no tinted regions behind. */
+void damage_all_outputs(KristalServer *server) {
+	KristalOutput *output = nullptr;
+	wl_list_for_each(output, &server->outputs, link) {
+		auto *scene_output = wlr_scene_get_scene_output(server->scene, output->wlr_output);
+		if (scene_output != nullptr) {
+			wlr_damage_ring_add_whole(&scene_output->damage_ring);
+		}
+		wlr_output_schedule_frame(output->wlr_output);
+	}
+}
+
+void set_highlight(KristalServer *server, bool enabled) {
+	damage_debug.highlight = enabled;
+	server->scene->debug_damage_option = enabled
+		? WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT
+		: WLR_SCENE_DEBUG_DAMAGE_NONE;
+	damage_all_outputs(server);
+}
+
+} // namespace
+
+void server_damage_debug_init(KristalServer *server) {
+	const char *value = getenv("KRISTAL_DAMAGE_DEBUG");
+	if (value == nullptr || value[0] == '\0' || strcmp(value, "0") == 0) {
+		return;
+	}
+	if (strcmp(value, "1") != 0) {
+		wlr_log(WLR_ERROR, "Ignoring invalid KRISTAL_DAMAGE_DEBUG='%s'; expected 0 or 1", value);
+		return;
+	}
+	damage_debug.used = true;
+	damage_debug.highlight = true;
+	server->scene->debug_damage_option = WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT;
+}
+
+void server_damage_debug_toggle(KristalServer *server) {
+	if (damage_debug.highlight) {
+		set_highlight(server, false);
+		wlr_log(WLR_INFO, "Damage debug off");
+		server_damage_debug_dump(server);
+		return;
+	}
+	damage_debug.used = true;
+	set_highlight(server, true);
+	wlr_log(WLR_INFO, "Damage debug on");
+}
+
+void server_damage_debug_dump(KristalServer *server) {
+	if (!damage_debug.used) {
+		return;
+	}
+	KristalOutput *outputs[kMaxRankedOutputs];
+	size_t count = 0;
+	KristalOutput *output = nullptr;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (count < kMaxRankedOutputs) {
+			outputs[count++] = output;
+		}
+	}
+	std::sort(outputs, outputs + count, [](const KristalOutput *a, const KristalOutput *b) {
+		return a->metrics_damage_pixels > b->metrics_damage_pixels;
+	});
+	wlr_log(WLR_INFO, "Damage: outputs by damaged pixels");
+	for (size_t i = 0; i < count; ++i) {
+		wlr_log(
+			WLR_INFO,
+			"Damage:   output %s: %llu px over %llu frames, mean %.1f%% of the output per frame",
+			outputs[i]->wlr_output->name,
+			static_cast<unsigned long long>(outputs[i]->metrics_damage_pixels),
+			static_cast<unsigned long long>(outputs[i]->metrics_frames),
+			mean_fraction(outputs[i]) * 100.0);
+	}
+	wlr_log(WLR_INFO, "Damage: clients by committed buffer damage");
+	server_clients_log_damage_ranking(server, kRankedClients);
+}
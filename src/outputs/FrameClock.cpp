@@ -0,0 +1,192 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <wlr/backend/headless.h>
+#include <wlr/interfaces/wlr_output.h>
+
+#include "core/internal.h"
+
+/*
+ * Virtual frame clock for headless runs (KRISTAL_VIRTUAL_CLOCK).
+ *
+ * The headless backend paces frames with a wall-clock timer at the mode's
+ * refresh rate. With the virtual clock, every frame that actually drew
+ * schedules the next one through an eventfd, so frames run back to back as
+ * fast as the compositor can process them. "max" stamps frame-done with the
+ * real monotonic time; a refresh rate in Hz stamps it with a fake clock that
+ * advances exactly one period per frame, which makes frame pacing
+ * reproducible regardless of machine speed. Frame events from the headless
+ * timer are never drawn on such outputs: they only wake an idle output by
+ * requesting a virtual tick, so every frame and callback a client sees
+ * comes from the virtual clock.
+ */
+
+namespace {
+
+struct FrameClock {
+	bool enabled;
+	bool simulated;
+	uint64_t period_ns;
+	uint64_t now_ns;
+	int fd;
+	wl_event_source *source;
+	KristalServer *server;
+	uint64_t frames;
+	bool sending;
+};
+
+FrameClock clock_state{};
+
+bool parse_virtual_clock(uint64_t *period_ns) {
+	const char *value = getenv("KRISTAL_VIRTUAL_CLOCK");
+	*period_ns = 0;
+	if (value == nullptr || value[0] == '\0' || strcmp(value, "0") == 0) {
+		return false;
+	}
+	if (strcmp(value, "max") == 0) {
+		return true;
+	}
+	char *end = nullptr;
+	errno = 0;
+	const double hz = strtod(value, &end);
+	if (errno != 0 || end == value || (end != nullptr && *end != '\0') ||
+		hz <= 0.0 || hz > 100000.0) {
+		wlr_log(
+			WLR_ERROR,
+			"Ignoring invalid KRISTAL_VIRTUAL_CLOCK='%s'; expected max or a refresh rate in Hz",
+			value);
+		return false;
+	}
+	*period_ns = static_cast<uint64_t>(1000000000.0 / hz);
+	return true;
+}
+
+void request_tick(KristalOutput *output) {
+	output->virtual_frame_pending = true;
+	const uint64_t one = 1;
+	if (write(clock_state.fd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN) {
+		wlr_log(WLR_ERROR, "Virtual frame clock: eventfd write: %s", strerror(errno));
+	}
+}
+
+void timespec_from_ns(uint64_t ns, timespec *out) {
+	out->tv_sec = static_cast<time_t>(ns / 1000000000ull);
+	out->tv_nsec = static_cast<long>(ns % 1000000000ull);
+}
+
+int handle_tick(int fd, uint32_t /*mask*/, void * /*data*/) {
+	uint64_t count = 0;
+	if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+		return 0;
+	}
+	if (clock_state.simulated) {
+		clock_state.now_ns += clock_state.period_ns;
+	}
+	KristalOutput *output = nullptr;
+	wl_list_for_each(output, &clock_state.server->outputs, link) {
+		if (!output->virtual_frame_pending) {
+			continue;
+		}
+		output->virtual_frame_pending = false;
+		if (!output->wlr_output->enabled) {
+			continue;
+		}
+		/* Stands in for the backend's vblank. */
+		clock_state.sending = true;
+		wlr_output_send_frame(output->wlr_output);
+		clock_state.sending = false;
+	}
+	return 0;
+}
+
+} // namespace
+
+void server_frame_clock_init(KristalServer *server) {
+	clock_state.server = server;
+	clock_state.fd = -1;
+	clock_state.enabled = parse_virtual_clock(&clock_state.period_ns);
+	if (!clock_state.enabled) {
+		return;
+	}
+	clock_state.simulated = clock_state.period_ns != 0;
+	clock_state.now_ns = kristal_now_ns();
+
+	clock_state.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (clock_state.fd < 0) {
+		wlr_log(WLR_ERROR, "Virtual frame clock disabled: eventfd: %s", strerror(errno));
+		clock_state.enabled = false;
+		return;
+	}
+	clock_state.source = wl_event_loop_add_fd(
+		wl_display_get_event_loop(server->display),
+		clock_state.fd,
+		WL_EVENT_READABLE,
+		handle_tick,
+		nullptr);
+	if (clock_state.simulated) {
+		wlr_log(
+			WLR_INFO,
+			"Virtual frame clock: unthrottled, simulated refresh %.3f Hz",
+			1000000000.0 / static_cast<double>(clock_state.period_ns));
+	} else {
+		wlr_log(WLR_INFO, "Virtual frame clock: unthrottled, real timestamps");
+	}
+}
+
+void server_frame_clock_finish(KristalServer * /*server*/) {
+	if (clock_state.source != nullptr) {
+		wl_event_source_remove(clock_state.source);
+		clock_state.source = nullptr;
+	}
+	if (clock_state.fd >= 0) {
+		close(clock_state.fd);
+		clock_state.fd = -1;
+	}
+	if (clock_state.enabled) {
+		wlr_log(WLR_INFO, "Virtual frame clock: %llu frames driven",
+			static_cast<unsigned long long>(clock_state.frames));
+	}
+}
+
+void server_frame_clock_output_init(KristalOutput *output) {
+	output->virtual_frame_pending = false;
+	output->virtual_clock = clock_state.enabled && wlr_output_is_headless(output->wlr_output);
+	if (clock_state.enabled && !output->virtual_clock) {
+		wlr_log(
+			WLR_INFO,
+			"Virtual frame clock not used for non-headless output %s",
+			output->wlr_output->name);
+	}
+}
+
+void server_frame_clock_now(KristalOutput *output, timespec *out) {
+	if (output->virtual_clock && clock_state.simulated) {
+		timespec_from_ns(clock_state.now_ns, out);
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, out);
+}
+
+bool server_frame_clock_accept_frame(KristalOutput *output) {
+	if (!output->virtual_clock || clock_state.sending) {
+		return true;
+	}
+	if (!output->virtual_frame_pending) {
+		request_tick(output);
+	}
+	return false;
+}
+
+void server_frame_clock_frame_done(KristalOutput *output, bool drew) {
+	/* Idle frames do not re-arm, so an idle compositor still sleeps; the
+	 * next damage schedules a frame through wlroots as usual. */
+	if (!output->virtual_clock || !drew || output->virtual_frame_pending) {
+		return;
+	}
+	clock_state.frames++;
+	request_tick(output);
+}
@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "core/internal.h"
+
+/*
+ * Frame-callback policy. Each view is classed per delivery: focused,
+ * unfocused, occluded (shown but suspended by the occlusion pass) or hidden
+ * (not shown at all). KRISTAL_FRAME_RATE_UNFOCUSED, _OCCLUDED and _HIDDEN
+ * cap their classes at a rate in Hz, "0" for none or "max" for no cap; the
+ * defaults (max, 0, 0) match plain wlr_scene behaviour. Views matched by a
+ * frame_exempt window rule ignore the unfocused and occluded caps. Shown
+ * views get callbacks from output frames; occluded and hidden views, which
+ * wlr_scene never visits, from a background timer. A shown view held back
+ * by its cap arms a wake timer, so an idle screen still draws the frame
+ * that carries its next callback. While the session is locked only lock
+ * surfaces get any.
+ */
+
+namespace {
+
+constexpr uint64_t kRateSlackNs = 1000000ull;
+
+const char *const kClassNames[KRISTAL_FRAME_CLASS_COUNT] = {
+	"focused",
+	"unfocused",
+	"occluded",
+	"hidden",
+	"exempt",
+	"throttled",
+	"locked",
+};
+
+/* Interval per class: 0 is uncapped, UINT64_MAX is never. */
+constexpr uint64_t kNever = UINT64_MAX;
+
+struct FramePolicy {
+	KristalServer *server;
+	uint64_t interval_ns[KRISTAL_FRAME_CLASS_COUNT];
+	bool capped;
+	wl_event_source *background_timer;
+	uint64_t background_interval_ns;
+	wl_event_source *wake_timer;
+	uint64_t wake_ns;
+	uint64_t sent[KRISTAL_FRAME_CLASS_COUNT];
+	uint64_t suppressed[KRISTAL_FRAME_CLASS_COUNT];
+};
+
+FramePolicy policy{};
+
+uint64_t parse_rate(const char *name, uint64_t fallback) {
+	const char *value = getenv(name);
+	if (value == nullptr || value[0] == '\0') {
+		return fallback;
+	}
+	if (strcmp(value, "max") == 0) {
+		return 0;
+	}
+	char *end = nullptr;
+	errno = 0;
+	const long rate = strtol(value, &end, 10);
+	if (errno != 0 || end == value || (end != nullptr && *end != '\0') || rate < 0 || rate > 1000) {
+		wlr_log(WLR_ERROR, "Ignoring invalid %s='%s'; expected a rate in Hz, 0 or max", name, value);
+		return fallback;
+	}
+	return rate == 0 ? kNever : 1000000000ull / static_cast<uint64_t>(rate);
+}
+
+enum KristalFrameClass classify(KristalView *view) {
+	if (!server_view_is_shown(view)) {
+		return KRISTAL_FRAME_HIDDEN;
+	}
+	if (view->frame_exempt) {
+		return KRISTAL_FRAME_EXEMPT;
+	}
+	if (view->suspended) {
+		return KRISTAL_FRAME_OCCLUDED;
+	}
+	if (server_view_surface(view) == view->server->focused_surface) {
+		return KRISTAL_FRAME_FOCUSED;
+	}
+	return KRISTAL_FRAME_UNFOCUSED;
+}
+
+/* Paced against the previous due time rather than the delivery time, so a
+ * cap that does not divide the refresh rate still averages out right.
+ * Every surface of the view shares the delivery of one frame. */
+bool view_frame_due(KristalView *view, uint64_t interval_ns, uint64_t now_ns) {
+	if (interval_ns == 0 || view->frame_sent_ns == now_ns) {
+		return true;
+	}
+	if (interval_ns == kNever || now_ns + kRateSlackNs < view->frame_next_ns) {
+		return false;
+	}
+	view->frame_sent_ns = now_ns;
+	view->frame_next_ns = std::max(view->frame_next_ns + interval_ns, now_ns + interval_ns / 2);
+	return true;
+}
+
+int wake_tick(void * /*data*/) {
+	policy.wake_ns = 0;
+	KristalOutput *output = nullptr;
+	wl_list_for_each(output, &policy.server->outputs, link) {
+		if (output->wlr_output->enabled) {
+			wlr_output_schedule_frame(output->wlr_output);
+		}
+	}
+	return 0;
+}
+
+void arm_wake(uint64_t due_ns, uint64_t now_ns) {
+	if (policy.wake_timer == nullptr || (policy.wake_ns != 0 && policy.wake_ns <= due_ns)) {
+		return;
+	}
+	policy.wake_ns = due_ns;
+	const uint64_t delay_ms = due_ns > now_ns ? (due_ns - now_ns + 999999ull) / 1000000ull : 1;
+	wl_event_source_timer_update(policy.wake_timer, static_cast<int>(std::max<uint64_t>(delay_ms, 1)));
+}
+
+/* Popups share their toplevel's policy. */
+KristalView *view_for_surface(Surface *surface) {
+	Surface *root = wlr_surface_get_root_surface(surface);
+	auto *xdg_surface = wlr_xdg_surface_try_from_wlr_surface(root);
+	while (xdg_surface != nullptr && xdg_surface->role == WLR_XDG_SURFACE_ROLE_POPUP &&
+		xdg_surface->popup->parent != nullptr) {
+		root = wlr_surface_get_root_surface(xdg_surface->popup->parent);
+		xdg_surface = wlr_xdg_surface_try_from_wlr_surface(root);
+	}
+	return server_view_from_surface(root);
+}
+
+bool frame_due(Surface *surface, uint64_t now_ns) {
+	KristalView *view = view_for_surface(surface);
+	if (view == nullptr) {
+		return server_client_frame_due(surface, now_ns);
+	}
+	const enum KristalFrameClass frame_class = classify(view);
+	if (!view_frame_due(view, policy.interval_ns[frame_class], now_ns)) {
+		policy.suppressed[frame_class]++;
+		/* Occluded views are already served by the background timer. */
+		if (frame_class == KRISTAL_FRAME_UNFOCUSED && policy.interval_ns[frame_class] != kNever) {
+			arm_wake(view->frame_next_ns - kRateSlackNs, now_ns);
+		}
+		return false;
+	}
+	if (!server_client_frame_due(surface, now_ns)) {
+		policy.suppressed[KRISTAL_FRAME_THROTTLED]++;
+		return false;
+	}
+	policy.sent[frame_class]++;
+	return true;
+}
+
+struct FrameDoneData {
+	SceneOutput *scene_output;
+	struct timespec *now;
+	uint64_t now_ns;
+	bool locked;
+};
+
+void send_frame_done_iterator(SceneBuffer *buffer, int /*sx*/, int /*sy*/, void *user_data) {
+	auto *data = static_cast<FrameDoneData *>(user_data);
+	if (buffer->primary_output != data->scene_output) {
+		return;
+	}
+	SceneSurface *scene_surface = wlr_scene_surface_try_from_buffer(buffer);
+	if (scene_surface != nullptr && data->locked &&
+		wlr_session_lock_surface_v1_try_from_wlr_surface(
+			wlr_surface_get_root_surface(scene_surface->surface)) == nullptr) {
+		policy.suppressed[KRISTAL_FRAME_LOCKED]++;
+		return;
+	}
+	if (scene_surface != nullptr && !frame_due(scene_surface->surface, data->now_ns)) {
+		return;
+	}
+	wlr_scene_buffer_send_frame_done(buffer, data->now);
+}
+
+void send_surface_frame_done(Surface *surface, int /*sx*/, int /*sy*/, void *data) {
+	wlr_surface_send_frame_done(surface, static_cast<const struct timespec *>(data));
+}
+
+int background_tick(void *data) {
+	auto *server = static_cast<KristalServer *>(data);
+	if (server->session_locked) {
+		wl_event_source_timer_update(
+			policy.background_timer,
+			static_cast<int>(policy.background_interval_ns / 1000000ull));
+		return 0;
+	}
+	const uint64_t now_ns = kristal_now_ns();
+	struct timespec now{};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	KristalView *view = nullptr;
+	wl_list_for_each(view, &server->views, link) {
+		if (!view->mapped) {
+			continue;
+		}
+		const enum KristalFrameClass frame_class = classify(view);
+		if (frame_class != KRISTAL_FRAME_HIDDEN && frame_class != KRISTAL_FRAME_OCCLUDED) {
+			continue;
+		}
+		Surface *surface = server_view_surface(view);
+		if (surface == nullptr || !view_frame_due(view, policy.interval_ns[frame_class], now_ns)) {
+			continue;
+		}
+		if (!server_client_frame_due(surface, now_ns)) {
+			continue;
+		}
+		policy.sent[frame_class]++;
+		wlr_surface_for_each_surface(surface, send_surface_frame_done, &now);
+	}
+	wl_event_source_timer_update(
+		policy.background_timer,
+		static_cast<int>(policy.background_interval_ns / 1000000ull));
+	return 0;
+}
+
+} // namespace
+
+void server_frame_policy_init(KristalServer *server) {
+	policy.server = server;
+	policy.interval_ns[KRISTAL_FRAME_FOCUSED] = 0;
+	policy.interval_ns[KRISTAL_FRAME_EXEMPT] = 0;
+	policy.interval_ns[KRISTAL_FRAME_THROTTLED] = 0;
+	policy.interval_ns[KRISTAL_FRAME_UNFOCUSED] = parse_rate("KRISTAL_FRAME_RATE_UNFOCUSED", 0);
+	policy.interval_ns[KRISTAL_FRAME_OCCLUDED] = parse_rate("KRISTAL_FRAME_RATE_OCCLUDED", kNever);
+	policy.interval_ns[KRISTAL_FRAME_HIDDEN] = parse_rate("KRISTAL_FRAME_RATE_HIDDEN", kNever);
+	policy.capped = policy.interval_ns[KRISTAL_FRAME_UNFOCUSED] != 0 ||
+		policy.interval_ns[KRISTAL_FRAME_OCCLUDED] != kNever;
+	if (policy.interval_ns[KRISTAL_FRAME_UNFOCUSED] != 0) {
+		policy.wake_timer = wl_event_loop_add_timer(
+			wl_display_get_event_loop(server->display),
+			wake_tick,
+			nullptr);
+	}
+
+	/* Background views run off one timer at the faster of their rates. */
+	uint64_t background = kNever;
+	for (const enum KristalFrameClass frame_class : {KRISTAL_FRAME_OCCLUDED, KRISTAL_FRAME_HIDDEN}) {
+		const uint64_t interval = policy.interval_ns[frame_class];
+		if (interval != kNever) {
+			background = std::min(background, std::max<uint64_t>(interval, 1000000ull));
+		}
+	}
+	if (background == kNever) {
+		return;
+	}
+	policy.background_interval_ns = background;
+	policy.background_timer = wl_event_loop_add_timer(
+		wl_display_get_event_loop(server->display),
+		background_tick,
+		server);
+	wl_event_source_timer_update(
+		policy.background_timer,
+		static_cast<int>(background / 1000000ull));
+}
+
+void server_frame_policy_finish(KristalServer * /*server*/) {
+	if (policy.wake_timer != nullptr) {
+		wl_event_source_remove(policy.wake_timer);
+		policy.wake_timer = nullptr;
+	}
+	if (policy.background_timer != nullptr) {
+		wl_event_source_remove(policy.background_timer);
+		policy.background_timer = nullptr;
+	}
+}
+
+void server_send_frame_done(SceneOutput *scene_output, struct timespec *now) {
+	const bool locked = policy.server->session_locked;
+	if (!policy.capped && !locked && !server_clients_any_throttled()) {
+		wlr_scene_output_send_frame_done(scene_output, now);
+		return;
+	}
+	FrameDoneData data{scene_output, now, kristal_now_ns(), locked};
+	wlr_scene_output_for_each_buffer(scene_output, send_frame_done_iterator, &data);
+}
+
+const char *server_frame_class_name(enum KristalFrameClass frame_class) {
+	return kClassNames[frame_class];
+}
+
+void server_frame_policy_counts(enum KristalFrameClass frame_class, uint64_t *sent, uint64_t *suppressed) {
+	*sent = policy.sent[frame_class];
+	*suppressed = policy.suppressed[frame_class];
+}
+
+void server_frame_policy_dump(KristalServer * /*server*/) {
+	if (!policy.capped && policy.background_timer == nullptr && !server_clients_any_throttled()) {
+		return;
+	}
+	for (int i = 0; i < KRISTAL_FRAME_CLASS_COUNT; ++i) {
+		wlr_log(
+			WLR_INFO,
+			"Frame policy: %-9s %llu sent, %llu suppressed",
+			kClassNames[i],
+			static_cast<unsigned long long>(policy.sent[i]),
+			static_cast<unsigned long long>(policy.suppressed[i]));
+	}
+}
@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <cstring>
+
+#include <wlr/util/box.h>
+
+#include "core/internal.h"
+
+/*
+ * Performance HUD. Every output gets a small panel in its top-left corner:
+ * a frame-interval graph with a refresh-budget line, and gauges for commit
+ * time, damaged area and input rate. All nodes live in one top-level tree
+ * kept above lock_scene and are created with the output, so showing the HUD
+ * only resizes and recolours existing rects. Drawn frames are only sampled;
+ * the panel is repainted from a coarse timer, so the HUD's own damage never
+ * keeps an idle output at full refresh. That damage is taken back out of
+ * the frame's damage statistics, and the frames it causes fall into idle
+ * gaps, which the graph skips rather than showing as missed.
+ */
+
+namespace {
+
+constexpr int kGraphSamples = 120;
+constexpr int kBarWidth = 2;
+constexpr int kGraphHeight = 64;
+constexpr int kGaugeHeight = 6;
+constexpr int kPadding = 6;
+constexpr int kPanelWidth = kGraphSamples * kBarWidth + 2 * kPadding;
+constexpr int kPanelHeight = kGraphHeight + 3 * (kGaugeHeight + kPadding) + 2 * kPadding;
+constexpr uint64_t kInputRateWindowNs = 250000000ull;
+constexpr double kInputRateFullScale = 1000.0;
+constexpr uint64_t kFallbackPeriodNs = 16666667ull;
+constexpr int kUpdateIntervalMs = 250;
+constexpr uint64_t kIdleGapPeriods = 8;
+
+const float kBackground[4] = {0.0f, 0.0f, 0.0f, 0.6f};
+const float kBudgetLine[4] = {1.0f, 1.0f, 1.0f, 0.5f};
+const float kCursor[4] = {1.0f, 1.0f, 1.0f, 0.8f};
+const float kOnTime[4] = {0.2f, 0.8f, 0.3f, 0.9f};
+const float kLate[4] = {0.9f, 0.7f, 0.1f, 0.9f};
+const float kMissed[4] = {0.9f, 0.2f, 0.2f, 0.9f};
+const float kGaugeTrack[4] = {1.0f, 1.0f, 1.0f, 0.15f};
+const float kGaugeCommit[4] = {0.3f, 0.6f, 1.0f, 0.9f};
+const float kGaugeDamage[4] = {0.8f, 0.4f, 0.9f, 0.9f};
+const float kGaugeInput[4] = {0.9f, 0.9f, 0.3f, 0.9f};
+
+enum HudGauge {
+	HUD_GAUGE_COMMIT,
+	HUD_GAUGE_DAMAGE,
+	HUD_GAUGE_INPUT,
+	HUD_GAUGE_COUNT,
+};
+
+struct Hud {
+	KristalServer *server;
+	bool visible;
+	SceneTree *tree;
+	wl_event_source *update_timer;
+	uint64_t input_window_start_ns;
+	uint64_t input_window_events;
+	double input_rate;
+};
+
+Hud hud{};
+
+const float *bar_color(uint64_t interval_ns, uint64_t period_ns) {
+	if (interval_ns <= period_ns + period_ns / 10) {
+		return kOnTime;
+	}
+	if (interval_ns <= 2 * period_ns) {
+		return kLate;
+	}
+	return kMissed;
+}
+
+int scaled(double fraction, int full) {
+	if (fraction <= 0.0) {
+		return 0;
+	}
+	if (fraction >= 1.0) {
+		return full;
+	}
+	return static_cast<int>(fraction * full + 0.5);
+}
+
+uint64_t refresh_period_ns(const KristalOutput *output) {
+	const int refresh_mhz = output->wlr_output->refresh;
+	return refresh_mhz > 0 ? 1000000000000ull / static_cast<uint64_t>(refresh_mhz) : kFallbackPeriodNs;
+}
+
+void update_input_rate(uint64_t now) {
+	if (hud.input_window_start_ns == 0) {
+		hud.input_window_start_ns = now;
+		hud.input_window_events = kristal_metrics_input_count();
+		return;
+	}
+	const uint64_t elapsed = now - hud.input_window_start_ns;
+	if (elapsed < kInputRateWindowNs) {
+		return;
+	}
+	const uint64_t events = kristal_metrics_input_count();
+	hud.input_rate = static_cast<double>(events - hud.input_window_events) * 1e9 / static_cast<double>(elapsed);
+	hud.input_window_start_ns = now;
+	hud.input_window_events = events;
+}
+
+bool set_rect_size(SceneRect *rect, int width, int height) {
+	if (rect->width == width && rect->height == height) {
+		return false;
+	}
+	wlr_scene_rect_set_size(rect, width, height);
+	return true;
+}
+
+bool set_node_position(SceneNode *node, int x, int y) {
+	if (node->x == x && node->y == y) {
+		return false;
+	}
+	wlr_scene_node_set_position(node, x, y);
+	return true;
+}
+
+} // namespace
+
+struct KristalHudOutput {
+	SceneTree *tree;
+	SceneRect *background;
+	SceneRect *budget_line;
+	SceneRect *cursor;
+	SceneRect *bars[kGraphSamples];
+	SceneRect *gauge_tracks[HUD_GAUGE_COUNT];
+	SceneRect *gauges[HUD_GAUGE_COUNT];
+	/* Ring of frame intervals; the pending_samples ending at next_sample
+	 * have not been drawn yet. */
+	uint64_t samples[kGraphSamples];
+	int pending_samples;
+	int next_sample;
+	uint64_t last_frame_ns;
+	/* The panel changed since the output's last commit. */
+	bool damaged;
+};
+
+namespace {
+
+bool repaint_panel(KristalOutput *output) {
+	KristalHudOutput *panel = output->hud;
+	const uint64_t period = refresh_period_ns(output);
+	bool changed = false;
+
+	Box box{};
+	wlr_output_layout_get_box(output->server->output_layout, output->wlr_output, &box);
+	changed |= set_node_position(&panel->tree->node, box.x, box.y);
+
+	const int first = (panel->next_sample - panel->pending_samples + kGraphSamples) % kGraphSamples;
+	for (int n = 0; n < panel->pending_samples; ++n) {
+		const int i = (first + n) % kGraphSamples;
+		SceneRect *bar = panel->bars[i];
+		const uint64_t interval = panel->samples[i];
+		const int height = scaled(static_cast<double>(interval) / static_cast<double>(2 * period), kGraphHeight);
+		changed |= set_rect_size(bar, kBarWidth, height);
+		const float *color = bar_color(interval, period);
+		if (memcmp(bar->color, color, sizeof(bar->color)) != 0) {
+			wlr_scene_rect_set_color(bar, color);
+			changed = true;
+		}
+		changed |= set_node_position(&bar->node, kPadding + i * kBarWidth, kPadding + kGraphHeight - height);
+	}
+	panel->pending_samples = 0;
+	changed |= set_node_position(&panel->cursor->node, kPadding + panel->next_sample * kBarWidth, kPadding);
+
+	const int full = kGraphSamples * kBarWidth;
+	const double output_area = static_cast<double>(output->wlr_output->width) * output->wlr_output->height;
+	changed |= set_rect_size(
+		panel->gauges[HUD_GAUGE_COMMIT],
+		scaled(static_cast<double>(output->last_frame_ns) / static_cast<double>(period), full),
+		kGaugeHeight);
+	changed |= set_rect_size(
+		panel->gauges[HUD_GAUGE_DAMAGE],
+		output_area > 0.0 ? scaled(static_cast<double>(output->last_damage_area) / output_area, full) : 0,
+		kGaugeHeight);
+	changed |= set_rect_size(
+		panel->gauges[HUD_GAUGE_INPUT],
+		scaled(hud.input_rate / kInputRateFullScale, full),
+		kGaugeHeight);
+	return changed;
+}
+
+int update_tick(void * /*data*/) {
+	if (!hud.visible) {
+		return 0;
+	}
+	update_input_rate(kristal_now_ns());
+	KristalOutput *output = nullptr;
+	wl_list_for_each(output, &hud.server->outputs, link) {
+		if (output->hud != nullptr && output->wlr_output->enabled && repaint_panel(output)) {
+			output->hud->damaged = true;
+		}
+	}
+	wl_event_source_timer_update(hud.update_timer, kUpdateIntervalMs);
+	return 0;
+}
+
+} // namespace
+
+void server_hud_init(KristalServer *server) {
+	hud.server = server;
+	hud.update_timer = wl_event_loop_add_timer(
+		wl_display_get_event_loop(server->display),
+		update_tick,
+		nullptr);
+	hud.tree = wlr_scene_tree_create(&server->scene->tree);
+	wlr_scene_node_set_enabled(&hud.tree->node, false);
+	server->hud_tree = hud.tree;
+}
+
+/* The panels' nodes go down with the scene; only their bookkeeping is
+ * freed here so output teardown afterwards has nothing left to touch. */
+void server_hud_finish(KristalServer *server) {
+	KristalOutput *output = nullptr;
+	wl_list_for_each(output, &server->outputs, link) {
+		delete output->hud;
+		output->hud = nullptr;
+	}
+	if (hud.update_timer != nullptr) {
+		wl_event_source_remove(hud.update_timer);
+		hud.update_timer = nullptr;
+	}
+	hud.visible = false;
+	hud.tree = nullptr;
+	server->hud_tree = nullptr;
+}
+
+void server_hud_output_init(KristalOutput *output) {
+	auto *panel = new KristalHudOutput{};
+	panel->tree = wlr_scene_tree_create(output->server->hud_tree);
+	panel->background = wlr_scene_rect_create(panel->tree, kPanelWidth, kPanelHeight, kBackground);
+	for (int i = 0; i < kGraphSamples; ++i) {
+		panel->bars[i] = wlr_scene_rect_create(panel->tree, kBarWidth, 0, kOnTime);
+		wlr_scene_node_set_position(
+			&panel->bars[i]->node,
+			kPadding + i * kBarWidth,
+			kPadding + kGraphHeight);
+	}
+	/* The graph spans two refresh periods, so the budget sits halfway. */
+	panel->budget_line = wlr_scene_rect_create(panel->tree, kGraphSamples * kBarWidth, 1, kBudgetLine);
+	wlr_scene_node_set_position(&panel->budget_line->node, kPadding, kPadding + kGraphHeight / 2);
+	panel->cursor = wlr_scene_rect_create(panel->tree, 1, kGraphHeight, kCursor);
+	wlr_scene_node_set_position(&panel->cursor->node, kPadding, kPadding);
+
+	const float *gauge_colors[HUD_GAUGE_COUNT] = {kGaugeCommit, kGaugeDamage, kGaugeInput};
+	for (int i = 0; i < HUD_GAUGE_COUNT; ++i) {
+		const int y = 2 * kPadding + kGraphHeight + i * (kGaugeHeight + kPadding);
+		panel->gauge_tracks[i] = wlr_scene_rect_create(
+			panel->tree,
+			kGraphSamples * kBarWidth,
+			kGaugeHeight,
+			kGaugeTrack);
+		wlr_scene_node_set_position(&panel->gauge_tracks[i]->node, kPadding, y);
+		panel->gauges[i] = wlr_scene_rect_create(panel->tree, 0, kGaugeHeight, gauge_colors[i]);
+		wlr_scene_node_set_position(&panel->gauges[i]->node, kPadding, y);
+	}
+	output->hud = panel;
+}
+
+void server_hud_output_finish(KristalOutput *output) {
+	if (output->hud == nullptr) {
+		return;
+	}
+	wlr_scene_node_destroy(&output->hud->tree->node);
+	delete output->hud;
+	output->hud = nullptr;
+}
+
+void server_hud_toggle(KristalServer *server) {
+	hud.visible = !hud.visible;
+	if (hud.visible) {
+		hud.input_window_start_ns = 0;
+		hud.input_rate = 0.0;
+		KristalOutput *output = nullptr;
+		wl_list_for_each(output, &server->outputs, link) {
+			output->hud->last_frame_ns = 0;
+		}
+		server_hud_raise(server);
+		update_tick(nullptr);
+	} else {
+		wl_event_source_timer_update(hud.update_timer, 0);
+	}
+	wlr_scene_node_set_enabled(&server->hud_tree->node, hud.visible);
+	wlr_log(WLR_INFO, "HUD %s", hud.visible ? "shown" : "hidden");
+}
+
+void server_hud_raise(KristalServer *server) {
+	if (server->hud_tree != nullptr) {
+		wlr_scene_node_raise_to_top(&server->hud_tree->node);
+	}
+}
+
+void server_hud_output_frame(KristalOutput *output) {
+	if (!hud.visible || output->hud == nullptr) {
+		return;
+	}
+	KristalHudOutput *panel = output->hud;
+	const uint64_t now = kristal_now_ns();
+	const uint64_t interval = now - panel->last_frame_ns;
+	if (panel->last_frame_ns != 0 && interval <= kIdleGapPeriods * refresh_period_ns(output)) {
+		panel->samples[panel->next_sample] = interval;
+		panel->next_sample = (panel->next_sample + 1) % kGraphSamples;
+		panel->pending_samples = std::min(panel->pending_samples + 1, kGraphSamples);
+	}
+	panel->last_frame_ns = now;
+}
+
+/* Takes the panel's repaint out of a frame's damage, in buffer coordinates,
+ * so the damage statistics describe the desktop rather than the HUD. */
+void server_hud_output_subtract_damage(KristalOutput *output, pixman_region32_t *damage) {
+	KristalHudOutput *panel = output->hud;
+	if (panel == nullptr || !panel->damaged) {
+		return;
+	}
+	panel->damaged = false;
+	Output *wlr_output = output->wlr_output;
+	Box box{
+		0,
+		0,
+		static_cast<int>(kPanelWidth * wlr_output->scale + 0.5f),
+		static_cast<int>(kPanelHeight * wlr_output->scale + 0.5f),
+	};
+	int width = 0;
+	int height = 0;
+	wlr_output_transformed_resolution(wlr_output, &width, &height);
+	wlr_box_transform(&box, &box, wlr_output_transform_invert(wlr_output->transform), width, height);
+	pixman_region32_t panel_region;
+	pixman_region32_init_rect(&panel_region, box.x, box.y, box.width, box.height);
+	pixman_region32_subtract(damage, damage, &panel_region);
+	pixman_region32_fini(&panel_region);
+}
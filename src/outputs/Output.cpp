@@ -85,6 +85,7 @@ void save_output_config(KristalServer *server) {
 	if (path == nullptr || path[0] == '\0') {
 		return;
 	}
+	KristalProfileZone zone("save_output_config");
 
 	FILE *file = std::fopen(path, "w");
 	if (!file) {
@@ -165,6 +166,7 @@ bool apply_output_config(KristalServer *server, wlr_output_configuration_v1 *con
 				head->state.output,
 				head->state.x,
 				head->state.y);
+			server_preload_cursor_theme(server, head->state.output->scale);
 		}
 		update_output_manager_config(server);
 		save_output_config(server);
@@ -173,16 +175,94 @@ bool apply_output_config(KristalServer *server, wlr_output_configuration_v1 *con
 	return true;
 }
 
+/* wlr_scene_output_commit() split open so the frame's damage and outcome are
+ * visible to the health counters. A failed commit is a missed frame; one
+ * that committed is judged when it is presented. */
+void commit_scene_frame(KristalOutput *output, SceneOutput *scene_output, uint64_t start) {
+	OutputState state{};
+	wlr_output_state_init(&state);
+	const bool committed = wlr_scene_output_build_state(scene_output, &state, nullptr) &&
+		wlr_output_commit_state(output->wlr_output, &state);
+	output->last_frame_ns = kristal_now_ns() - start;
+	output->last_damage_area = 0;
+	if (committed && (state.committed & WLR_OUTPUT_STATE_DAMAGE) != 0) {
+		server_hud_output_subtract_damage(output, &state.damage);
+		output->last_damage_area = kristal_region_area(&state.damage);
+	}
+	wlr_output_state_finish(&state);
+
+	if (!committed) {
+		output->metrics_missed++;
+		return;
+	}
+	output->metrics_frames++;
+	output->metrics_damage_pixels += output->last_damage_area;
+	output->metrics_frame_start_ns = start;
+	output->metrics_present_pending = true;
+}
+
+/* A frame should reach the screen at the first vblank after it was started,
+ * found by stepping whole periods from the previous present. A frame that
+ * started late in its period and missed that vblank counts as well as one
+ * whose build overran. Half a period of slack absorbs timestamp jitter. */
+void output_present(Listener *listener, void *data) {
+	KristalOutput *output = wl_container_of(listener, output, present);
+	auto *event = static_cast<OutputEventPresent *>(data);
+	if (!output->metrics_present_pending) {
+		return;
+	}
+	output->metrics_present_pending = false;
+	if (!event->presented) {
+		output->metrics_missed++;
+		return;
+	}
+	uint64_t period_ns = static_cast<uint64_t>(event->refresh > 0 ? event->refresh : 0);
+	if (period_ns == 0 && output->wlr_output->refresh > 0) {
+		period_ns = 1000000000000ull / static_cast<uint64_t>(output->wlr_output->refresh);
+	}
+	if (period_ns == 0 || event->when == nullptr) {
+		return;
+	}
+	const uint64_t present_ns = static_cast<uint64_t>(event->when->tv_sec) * 1000000000ull +
+		static_cast<uint64_t>(event->when->tv_nsec);
+	const uint64_t start_ns = output->metrics_frame_start_ns;
+	const uint64_t last_ns = output->metrics_last_present_ns;
+	uint64_t deadline_ns = start_ns + period_ns;
+	if (last_ns != 0 && last_ns <= start_ns) {
+		deadline_ns = last_ns + ((start_ns - last_ns) / period_ns + 1) * period_ns;
+	}
+	output->metrics_last_present_ns = present_ns;
+	if (present_ns > deadline_ns + period_ns / 2) {
+		output->metrics_missed++;
+	}
+}
+
 void output_frame(Listener *listener, void * /*data*/) {
 	KristalOutput *output = wl_container_of(listener, output, frame);
+	/* Damage still schedules frames on outputs that are powered off. */
+	if (!output->wlr_output->enabled || !server_frame_clock_accept_frame(output)) {
+		return;
+	}
 	auto *scene = output->server->scene;
 	auto *scene_output = wlr_scene_get_scene_output(scene, output->wlr_output);
+	const uint64_t perf_start = kristal_perf_begin(KRISTAL_PERF_FRAME);
+	const uint64_t frame_start = kristal_now_ns();
 
-	wlr_scene_output_commit(scene_output, nullptr);
+	const bool drew = wlr_scene_output_needs_frame(scene_output);
+	if (drew) {
+		commit_scene_frame(output, scene_output, frame_start);
+	}
 
 	timespec now{};
-	clock_gettime(CLOCK_MONOTONIC, &now);
-	wlr_scene_output_send_frame_done(scene_output, &now);
+	server_frame_clock_now(output, &now);
+	server_send_frame_done(scene_output, &now);
+	server_frame_clock_frame_done(output, drew);
+	if (drew) {
+		server_startup_first_frame(output->server);
+		server_hud_output_frame(output);
+		server_schedule_occlusion_update(output->server);
+	}
+	kristal_perf_end(KRISTAL_PERF_FRAME, perf_start);
 }
 
 void output_request_state(Listener *listener, void *data) {
@@ -197,9 +277,14 @@ void output_destroy(Listener *listener, void * /*data*/) {
 	wl_list_remove(&output->frame.link);
 	wl_list_remove(&output->request_state.link);
 	wl_list_remove(&output->destroy.link);
+	wl_list_remove(&output->present.link);
+	server_latency_output_finish(output);
+	server_hud_output_finish(output);
+	output->wlr_output->data = nullptr;
 	wl_list_remove(&output->link);
 	update_output_manager_config(output->server);
 	save_output_config(output->server);
+	server_power_outputs_changed(output->server);
 	delete output;
 }
 
@@ -235,20 +320,29 @@ void server_new_output(Listener *listener, void *data) {
 
 	wlr_output_commit_state(wlr_output, &state);
 	wlr_output_state_finish(&state);
+	server_preload_cursor_theme(server, wlr_output->scale);
 
 	auto *output = new KristalOutput{};
 	output->wlr_output = wlr_output;
 	output->server = server;
+	wlr_output->data = output;
 
-	output->frame.notify = output_frame;
+	output->frame.notify = KRISTAL_PROFILED(output_frame);
 	wl_signal_add(&wlr_output->events.frame, &output->frame);
 
-	output->request_state.notify = output_request_state;
+	output->request_state.notify = KRISTAL_PROFILED(output_request_state);
 	wl_signal_add(&wlr_output->events.request_state, &output->request_state);
 
-	output->destroy.notify = output_destroy;
+	output->destroy.notify = KRISTAL_PROFILED(output_destroy);
 	wl_signal_add(&wlr_output->events.destroy, &output->destroy);
 
+	output->present.notify = KRISTAL_PROFILED(output_present);
+	wl_signal_add(&wlr_output->events.present, &output->present);
+
+	server_latency_output_init(output);
+	server_frame_clock_output_init(output);
+	server_hud_output_init(output);
+
 	wl_list_insert(&server->outputs, &output->link);
 
 	OutputLayoutOutput *layout_output = nullptr;
@@ -283,6 +377,7 @@ void server_new_output(Listener *listener, void *data) {
 	}
 	update_output_manager_config(server);
 	server_arrange_workspace(server);
+	server_power_outputs_changed(server);
 }
 
 void server_output_manager_apply(Listener *listener, void *data) {
@@ -0,0 +1,292 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "core/internal.h"
+
+/*
+ * Power management. After KRISTAL_IDLE_DPMS_TIMEOUT seconds without input
+ * (0 or unset: never) every enabled output is switched off, and the first
+ * input afterwards switches them back on; the timer rides on the same
+ * coalesced activity notifications that feed the idle notifier. While the
+ * lid is closed and another output is on, the internal panel (eDP, LVDS or
+ * DSI, or the output named by KRISTAL_INTERNAL_OUTPUT) is disabled and taken
+ * out of the layout. Idle inhibitors only count while their surface is on
+ * screen: a video player on another workspace, minimized or fully covered
+ * does not keep the display awake. Requests from wlr-output-power-management
+ * clients go through here too, so they cannot light a panel the lid has
+ * taken out of the layout.
+ */
+
+namespace {
+
+struct PowerManager {
+	KristalServer *server;
+	wl_event_source *idle_timer;
+	int idle_timeout_ms;
+	bool idle;
+	bool inhibited;
+	bool lid_closed;
+	const char *internal_output;
+};
+
+PowerManager power{};
+
+int parse_timeout_ms(const char *name) {
+	const char *value = getenv(name);
+	if (value == nullptr || value[0] == '\0') {
+		return 0;
+	}
+	char *end = nullptr;
+	errno = 0;
+	const long seconds = strtol(value, &end, 10);
+	if (errno != 0 || end == value || (end != nullptr && *end != '\0') ||
+		seconds < 0 || seconds > 86400) {
+		wlr_log(WLR_ERROR, "Ignoring invalid %s='%s'; expected seconds between 0 and 86400", name, value);
+		return 0;
+	}
+	return static_cast<int>(seconds * 1000);
+}
+
+bool is_internal_panel(const Output *output) {
+	const char *name = output->name;
+	if (power.internal_output != nullptr) {
+		return strcmp(name, power.internal_output) == 0;
+	}
+	return strncmp(name, "eDP", 3) == 0 ||
+		strncmp(name, "LVDS", 4) == 0 ||
+		strncmp(name, "DSI", 3) == 0;
+}
+
+bool commit_enabled(KristalOutput *output, bool enabled) {
+	OutputState state{};
+	wlr_output_state_init(&state);
+	wlr_output_state_set_enabled(&state, enabled);
+	const bool ok = wlr_output_commit_state(output->wlr_output, &state);
+	wlr_output_state_finish(&state);
+	if (!ok) {
+		wlr_log(WLR_ERROR, "Power: failed to turn output %s %s",
+			output->wlr_output->name, enabled ? "on" : "off");
+	}
+	return ok;
+}
+
+void arm_idle_timer() {
+	if (power.idle_timer != nullptr && !power.inhibited) {
+		wl_event_source_timer_update(power.idle_timer, power.idle_timeout_ms);
+	}
+}
+
+int idle_timeout(void *data) {
+	auto *server = static_cast<KristalServer *>(data);
+	if (power.inhibited || power.idle) {
+		return 0;
+	}
+	power.idle = true;
+	KristalOutput *output = nullptr;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (output->wlr_output->enabled && commit_enabled(output, false)) {
+			output->idle_off = true;
+		}
+	}
+	wlr_log(WLR_INFO, "Power: idle, outputs off");
+	return 0;
+}
+
+void wake_outputs(KristalServer *server) {
+	power.idle = false;
+	KristalOutput *output = nullptr;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (!output->idle_off) {
+			continue;
+		}
+		output->idle_off = false;
+		if (commit_enabled(output, true)) {
+			wlr_output_schedule_frame(output->wlr_output);
+		}
+	}
+	wlr_log(WLR_INFO, "Power: activity, outputs on");
+}
+
+/* The wlroots inhibitor is still listed while its destroy signal runs, so
+ * the caller names the one going away. */
+bool inhibitor_visible(KristalServer *server, struct wlr_idle_inhibitor_v1 *inhibitor) {
+	Surface *root = wlr_surface_get_root_surface(inhibitor->surface);
+	if (!root->mapped) {
+		return false;
+	}
+	if (wlr_session_lock_surface_v1_try_from_wlr_surface(root) != nullptr) {
+		return true;
+	}
+	if (server->session_locked) {
+		return false;
+	}
+	KristalView *view = server_view_from_surface(root);
+	if (view != nullptr) {
+		return server_view_is_shown(view) && !view->suspended;
+	}
+	return true;
+}
+
+void remove_from_layout(KristalOutput *output) {
+	KristalServer *server = output->server;
+	wlr_output_layout_get_box(server->output_layout, output->wlr_output, &output->lid_box);
+	wlr_output_layout_remove(server->output_layout, output->wlr_output);
+}
+
+void restore_to_layout(KristalOutput *output) {
+	KristalServer *server = output->server;
+	auto *layout_output = wlr_output_layout_add(
+		server->output_layout,
+		output->wlr_output,
+		output->lid_box.x,
+		output->lid_box.y);
+	auto *scene_output = wlr_scene_get_scene_output(server->scene, output->wlr_output);
+	if (scene_output == nullptr) {
+		scene_output = wlr_scene_output_create(server->scene, output->wlr_output);
+	}
+	if (layout_output != nullptr && scene_output != nullptr) {
+		wlr_scene_output_layout_add_output(server->scene_layout, layout_output, scene_output);
+	}
+}
+
+/* An output switched off for idle still counts as present: the panel
+ * should not light up just because everything is asleep. */
+void apply_lid(KristalServer *server) {
+	bool external = false;
+	KristalOutput *output = nullptr;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (!is_internal_panel(output->wlr_output) && (output->wlr_output->enabled || output->idle_off)) {
+			external = true;
+		}
+	}
+	const bool panel_off = power.lid_closed && external;
+	bool changed = false;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (!is_internal_panel(output->wlr_output) || output->lid_off == panel_off) {
+			continue;
+		}
+		if (panel_off) {
+			if (!output->wlr_output->enabled && !output->idle_off) {
+				continue;
+			}
+			output->lid_off = true;
+			output->idle_off = false;
+			remove_from_layout(output);
+			commit_enabled(output, false);
+			wlr_log(WLR_INFO, "Power: lid closed, output %s off", output->wlr_output->name);
+		} else {
+			output->lid_off = false;
+			restore_to_layout(output);
+			if (power.idle) {
+				output->idle_off = true;
+			} else {
+				commit_enabled(output, true);
+			}
+			wlr_log(WLR_INFO, "Power: lid open, output %s on", output->wlr_output->name);
+		}
+		changed = true;
+	}
+	if (changed) {
+		server_update_output_manager_config(server);
+		server_arrange_workspace(server);
+	}
+}
+
+} // namespace
+
+void server_power_init(KristalServer *server) {
+	power.server = server;
+	power.internal_output = getenv("KRISTAL_INTERNAL_OUTPUT");
+	if (power.internal_output != nullptr && power.internal_output[0] == '\0') {
+		power.internal_output = nullptr;
+	}
+	power.idle_timeout_ms = parse_timeout_ms("KRISTAL_IDLE_DPMS_TIMEOUT");
+	if (power.idle_timeout_ms == 0) {
+		return;
+	}
+	power.idle_timer = wl_event_loop_add_timer(
+		wl_display_get_event_loop(server->display),
+		idle_timeout,
+		server);
+	if (power.idle_timer == nullptr) {
+		wlr_log(WLR_ERROR, "Power: failed to create the idle timer; outputs stay on");
+		return;
+	}
+	arm_idle_timer();
+}
+
+void server_power_finish(KristalServer * /*server*/) {
+	if (power.idle_timer != nullptr) {
+		wl_event_source_remove(power.idle_timer);
+		power.idle_timer = nullptr;
+	}
+}
+
+void server_power_activity(KristalServer *server) {
+	if (power.idle) {
+		wake_outputs(server);
+	}
+	arm_idle_timer();
+}
+
+void server_power_update_inhibit(KristalServer *server, struct wlr_idle_inhibitor_v1 *dying) {
+	if (server->idle_inhibit_mgr == nullptr) {
+		return;
+	}
+	bool inhibited = false;
+	struct wlr_idle_inhibitor_v1 *inhibitor = nullptr;
+	wl_list_for_each(inhibitor, &server->idle_inhibit_mgr->inhibitors, link) {
+		if (inhibitor != dying && inhibitor_visible(server, inhibitor)) {
+			inhibited = true;
+			break;
+		}
+	}
+	if (inhibited == power.inhibited) {
+		return;
+	}
+	power.inhibited = inhibited;
+	if (server->idle_notifier != nullptr) {
+		wlr_idle_notifier_v1_set_inhibited(server->idle_notifier, inhibited);
+	}
+	/* The idle period starts over once nothing visible holds it off. */
+	arm_idle_timer();
+}
+
+/* An explicit request takes the output out of idle handling either way: one
+ * switched off by a client stays off until a client switches it back on. */
+void server_power_request(KristalServer *server, Output *wlr_output, bool on) {
+	KristalOutput *output = nullptr;
+	KristalOutput *found = nullptr;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (output->wlr_output == wlr_output) {
+			found = output;
+			break;
+		}
+	}
+	if (found == nullptr) {
+		return;
+	}
+	if (on && found->lid_off) {
+		wlr_log(WLR_INFO, "Power: ignoring request to turn on %s while the lid is closed", wlr_output->name);
+		return;
+	}
+	found->idle_off = false;
+	if (wlr_output->enabled == on) {
+		return;
+	}
+	if (commit_enabled(found, on) && on) {
+		wlr_output_schedule_frame(wlr_output);
+	}
+}
+
+void server_power_lid(KristalServer *server, bool closed) {
+	power.lid_closed = closed;
+	apply_lid(server);
+}
+
+void server_power_outputs_changed(KristalServer *server) {
+	if (power.lid_closed) {
+		apply_lid(server);
+	}
+}
@@ -47,15 +47,10 @@ struct KristalForeignToplevelHandle {
 	Listener destroy;
 };
 
-void update_idle_inhibit(KristalServer *server) {
-	bool inhibited = !wl_list_empty(&server->idle_inhibit_mgr->inhibitors);
-	wlr_idle_notifier_v1_set_inhibited(server->idle_notifier, inhibited);
-}
-
 void idle_inhibitor_destroy(Listener *listener, void * /*data*/) {
 	auto *handle = wl_container_of(listener, (KristalIdleInhibitorHandle *)nullptr, destroy);
 	wl_list_remove(&handle->destroy.link);
-	update_idle_inhibit(handle->server);
+	server_power_update_inhibit(handle->server, handle->inhibitor);
 	delete handle;
 }
 
@@ -151,6 +146,9 @@ void foreign_request_activate(Listener *listener, void *data) {
 		request_activate);
 	auto *event = static_cast<wlr_foreign_toplevel_handle_v1_activated_event *>(data);
 	(void)event;
+	if (handle->view->minimized) {
+		server_view_set_minimized(handle->view, false);
+	}
 	auto *surface = foreign_view_surface(handle->view);
 	if (surface != nullptr) {
 		focus_surface(handle->view->server, surface);
@@ -239,19 +237,7 @@ void foreign_request_minimize(Listener *listener, void *data) {
 		(KristalForeignToplevelHandle *)nullptr,
 		request_minimize);
 	auto *event = static_cast<wlr_foreign_toplevel_handle_v1_minimized_event *>(data);
-#ifdef KRISTAL_HAVE_XWAYLAND
-	if (handle->view->type == KRISTAL_VIEW_XWAYLAND) {
-		auto *xsurface = wl_container_of(handle->view, (KristalXwaylandSurface *)nullptr, view);
-		if (xsurface->xwayland_surface != nullptr) {
-			wlr_xwayland_surface_set_minimized(xsurface->xwayland_surface, event->minimized);
-		}
-	}
-#endif
-	if (handle->handle != nullptr) {
-		wlr_foreign_toplevel_handle_v1_set_minimized(
-			handle->handle,
-			event->minimized);
-	}
+	server_view_set_minimized(handle->view, event->minimized);
 }
 
 void foreign_toplevel_destroy(Listener *listener, void * /*data*/) {
@@ -281,12 +267,35 @@ void session_lock_surface_destroy(Listener *listener, void * /*data*/) {
 	delete surface;
 }
 
+/* While locked, the desktop is cut out of the scene: the renderer stops
+ * walking it, wlr_scene sends it no frame callbacks and every toplevel is
+ * told it is suspended. Unlocking re-enables the same trees, so views come
+ * back exactly where they were without an arrange. */
+void set_desktop_enabled(KristalServer *server, bool enabled) {
+	for (SceneTree *layer_tree : server->layer_trees) {
+		wlr_scene_node_set_enabled(&layer_tree->node, enabled);
+	}
+	wlr_scene_node_set_enabled(&server->view_tree->node, enabled);
+	KristalView *view = nullptr;
+	wl_list_for_each(view, &server->views, link) {
+		server_view_update_visibility(view);
+	}
+	if (enabled) {
+		server_update_occlusion(server);
+	}
+	server_cgroup_update_weights(server);
+}
+
 void clear_session_lock(KristalServer *server) {
 	if (server == nullptr) {
 		return;
 	}
+	const bool was_locked = server->session_locked;
 	server->session_locked = false;
 	server->session_lock = nullptr;
+	if (was_locked) {
+		set_desktop_enabled(server, true);
+	}
 
 	KristalSessionLockSurface *surface = nullptr;
 	KristalSessionLockSurface *tmp = nullptr;
@@ -314,9 +323,9 @@ void server_new_toplevel_decoration(Listener *listener, void *data) {
 
 	auto *handle = new KristalDecorationHandle{};
 	handle->decoration = decoration;
-	handle->request_mode.notify = decoration_request_mode;
+	handle->request_mode.notify = KRISTAL_PROFILED(decoration_request_mode);
 	wl_signal_add(&decoration->events.request_mode, &handle->request_mode);
-	handle->destroy.notify = decoration_destroy;
+	handle->destroy.notify = KRISTAL_PROFILED(decoration_destroy);
 	wl_signal_add(&decoration->events.destroy, &handle->destroy);
 
 	wlr_xdg_toplevel_decoration_v1_set_mode(
@@ -338,9 +347,9 @@ void server_new_idle_inhibitor(Listener *listener, void *data) {
 	auto *handle = new KristalIdleInhibitorHandle{};
 	handle->server = server;
 	handle->inhibitor = inhibitor;
-	handle->destroy.notify = idle_inhibitor_destroy;
+	handle->destroy.notify = KRISTAL_PROFILED(idle_inhibitor_destroy);
 	wl_signal_add(&inhibitor->events.destroy, &handle->destroy);
-	update_idle_inhibit(server);
+	server_power_update_inhibit(server, nullptr);
 }
 
 void server_output_power_set_mode(Listener *listener, void *data) {
@@ -355,13 +364,7 @@ void server_output_power_set_mode(Listener *listener, void *data) {
 		return;
 	}
 
-	OutputState state{};
-	wlr_output_state_init(&state);
-	wlr_output_state_set_enabled(
-		&state,
-		event->mode == WLR_OUTPUT_POWER_V1_MODE_ON);
-	wlr_output_commit_state(output, &state);
-	wlr_output_state_finish(&state);
+	server_power_request(server, output, event->mode == WLR_OUTPUT_POWER_V1_MODE_ON);
 }
 
 void server_new_text_input(Listener *listener, void *data) {
@@ -371,13 +374,13 @@ void server_new_text_input(Listener *listener, void *data) {
 	auto *handle = new KristalTextInputHandle{};
 	handle->server = server;
 	handle->text_input = text_input;
-	handle->enable.notify = text_input_enable;
+	handle->enable.notify = KRISTAL_PROFILED(text_input_enable);
 	wl_signal_add(&text_input->events.enable, &handle->enable);
-	handle->commit.notify = text_input_commit;
+	handle->commit.notify = KRISTAL_PROFILED(text_input_commit);
 	wl_signal_add(&text_input->events.commit, &handle->commit);
-	handle->disable.notify = text_input_disable;
+	handle->disable.notify = KRISTAL_PROFILED(text_input_disable);
 	wl_signal_add(&text_input->events.disable, &handle->disable);
-	handle->destroy.notify = text_input_destroy;
+	handle->destroy.notify = KRISTAL_PROFILED(text_input_destroy);
 	wl_signal_add(&text_input->events.destroy, &handle->destroy);
 }
 
@@ -424,9 +427,9 @@ void server_new_input_method(Listener *listener, void *data) {
 	auto *input_method = static_cast<InputMethodV2 *>(data);
 	server->input_method = input_method;
 
-	server->input_method_commit.notify = server_input_method_commit;
+	server->input_method_commit.notify = KRISTAL_PROFILED(server_input_method_commit);
 	wl_signal_add(&input_method->events.commit, &server->input_method_commit);
-	server->input_method_destroy.notify = server_input_method_destroy;
+	server->input_method_destroy.notify = KRISTAL_PROFILED(server_input_method_destroy);
 	wl_signal_add(&input_method->events.destroy, &server->input_method_destroy);
 }
 
@@ -460,13 +463,15 @@ void server_new_session_lock(Listener *listener, void *data) {
 	if (server->lock_scene == nullptr) {
 		server->lock_scene = wlr_scene_tree_create(&server->scene->tree);
 		wlr_scene_node_raise_to_top(&server->lock_scene->node);
+		server_hud_raise(server);
 	}
+	set_desktop_enabled(server, false);
 
-	server->new_lock_surface.notify = server_new_lock_surface;
+	server->new_lock_surface.notify = KRISTAL_PROFILED(server_new_lock_surface);
 	wl_signal_add(&lock->events.new_surface, &server->new_lock_surface);
-	server->session_lock_destroy.notify = server_session_lock_destroy;
+	server->session_lock_destroy.notify = KRISTAL_PROFILED(server_session_lock_destroy);
 	wl_signal_add(&lock->events.destroy, &server->session_lock_destroy);
-	server->session_lock_unlock.notify = server_session_lock_unlock;
+	server->session_lock_unlock.notify = KRISTAL_PROFILED(server_session_lock_unlock);
 	wl_signal_add(&lock->events.unlock, &server->session_lock_unlock);
 
 	wlr_session_lock_v1_send_locked(lock);
@@ -495,6 +500,7 @@ void server_new_lock_surface(Listener *listener, void *data) {
 	if (server->lock_scene == nullptr) {
 		server->lock_scene = wlr_scene_tree_create(&server->scene->tree);
 		wlr_scene_node_raise_to_top(&server->lock_scene->node);
+		server_hud_raise(server);
 	}
 
 	auto *surface = new KristalSessionLockSurface{};
@@ -519,7 +525,7 @@ void server_new_lock_surface(Listener *listener, void *data) {
 		output_box.width,
 		output_box.height);
 
-	surface->destroy.notify = session_lock_surface_destroy;
+	surface->destroy.notify = KRISTAL_PROFILED(session_lock_surface_destroy);
 	wl_signal_add(&lock_surface->events.destroy, &surface->destroy);
 	wl_list_insert(&server->lock_surfaces, &surface->link);
 }
@@ -574,17 +580,17 @@ void server_register_foreign_toplevel(KristalView *view, const char *title, cons
 		wlr_foreign_toplevel_handle_v1_set_activated(handle, true);
 	}
 
-	foreign->request_activate.notify = foreign_request_activate;
+	foreign->request_activate.notify = KRISTAL_PROFILED(foreign_request_activate);
 	wl_signal_add(&handle->events.request_activate, &foreign->request_activate);
-	foreign->request_close.notify = foreign_request_close;
+	foreign->request_close.notify = KRISTAL_PROFILED(foreign_request_close);
 	wl_signal_add(&handle->events.request_close, &foreign->request_close);
-	foreign->request_maximize.notify = foreign_request_maximize;
+	foreign->request_maximize.notify = KRISTAL_PROFILED(foreign_request_maximize);
 	wl_signal_add(&handle->events.request_maximize, &foreign->request_maximize);
-	foreign->request_fullscreen.notify = foreign_request_fullscreen;
+	foreign->request_fullscreen.notify = KRISTAL_PROFILED(foreign_request_fullscreen);
 	wl_signal_add(&handle->events.request_fullscreen, &foreign->request_fullscreen);
-	foreign->request_minimize.notify = foreign_request_minimize;
+	foreign->request_minimize.notify = KRISTAL_PROFILED(foreign_request_minimize);
 	wl_signal_add(&handle->events.request_minimize, &foreign->request_minimize);
-	foreign->destroy.notify = foreign_toplevel_destroy;
+	foreign->destroy.notify = KRISTAL_PROFILED(foreign_toplevel_destroy);
 	wl_signal_add(&handle->events.destroy, &foreign->destroy);
 }
 
@@ -37,6 +37,11 @@ void layer_surface_unmap(Listener *listener, void * /*data*/) {
 
 void layer_surface_commit(Listener *listener, void * /*data*/) {
 	KristalLayerSurface *layer = wl_container_of(listener, layer, commit);
+	/* A client may move its surface to another layer at any commit. */
+	SceneTree *layer_tree = layer->server->layer_trees[layer->layer_surface->current.layer];
+	if (layer->scene_layer_surface->tree->node.parent != layer_tree) {
+		wlr_scene_node_reparent(&layer->scene_layer_surface->tree->node, layer_tree);
+	}
 	arrange_layer_surfaces_on_output(layer->server, layer->layer_surface->output);
 }
 
@@ -74,7 +79,7 @@ void server_new_layer_surface(Listener *listener, void *data) {
 	layer->server = server;
 	layer->layer_surface = layer_surface;
 	layer->scene_layer_surface = wlr_scene_layer_surface_v1_create(
-		&server->scene->tree,
+		server->layer_trees[layer_surface->pending.layer],
 		layer_surface);
 	if (layer->scene_layer_surface == nullptr) {
 		delete layer;
@@ -26,7 +26,13 @@ void destroy_borders(KristalToplevel *toplevel) {
 	}
 }
 
-void update_borders(KristalToplevel *toplevel) {
+void set_border_rect(SceneRect *rect, int x, int y, int width, int height, const float color[4]) {
+	wlr_scene_rect_set_size(rect, width, height);
+	wlr_scene_rect_set_color(rect, color);
+	wlr_scene_node_set_position(&rect->node, x, y);
+}
+
+void rebuild_borders(KristalToplevel *toplevel) {
 	if (toplevel == nullptr || toplevel->view.scene_tree == nullptr) {
 		return;
 	}
@@ -48,46 +54,37 @@ void update_borders(KristalToplevel *toplevel) {
 		? server->border_color_focused
 		: server->border_color_unfocused;
 
-	destroy_borders(toplevel);
-
 	const int bw = std::min(server->border_width, std::min(geometry.width, geometry.height));
-	toplevel->border_top = wlr_scene_rect_create(
-		toplevel->view.scene_tree,
-		geometry.width,
-		bw,
-		color);
-	toplevel->border_bottom = wlr_scene_rect_create(
-		toplevel->view.scene_tree,
+	/* Reuse the rects across commits: the setters below are no-ops when
+	 * nothing changed, so a steady client adds no border damage. */
+	if (toplevel->border_top == nullptr) {
+		toplevel->border_top = wlr_scene_rect_create(toplevel->view.scene_tree, 0, 0, color);
+		toplevel->border_bottom = wlr_scene_rect_create(toplevel->view.scene_tree, 0, 0, color);
+		toplevel->border_left = wlr_scene_rect_create(toplevel->view.scene_tree, 0, 0, color);
+		toplevel->border_right = wlr_scene_rect_create(toplevel->view.scene_tree, 0, 0, color);
+	}
+	set_border_rect(toplevel->border_top, geometry.x, geometry.y, geometry.width, bw, color);
+	set_border_rect(
+		toplevel->border_bottom,
+		geometry.x,
+		geometry.y + geometry.height - bw,
 		geometry.width,
 		bw,
 		color);
-	toplevel->border_left = wlr_scene_rect_create(
-		toplevel->view.scene_tree,
-		bw,
-		geometry.height,
-		color);
-	toplevel->border_right = wlr_scene_rect_create(
-		toplevel->view.scene_tree,
+	set_border_rect(toplevel->border_left, geometry.x, geometry.y, bw, geometry.height, color);
+	set_border_rect(
+		toplevel->border_right,
+		geometry.x + geometry.width - bw,
+		geometry.y,
 		bw,
 		geometry.height,
 		color);
+}
 
-	wlr_scene_node_set_position(
-		&toplevel->border_top->node,
-		geometry.x,
-		geometry.y);
-	wlr_scene_node_set_position(
-		&toplevel->border_bottom->node,
-		geometry.x,
-		geometry.y + geometry.height - bw);
-	wlr_scene_node_set_position(
-		&toplevel->border_left->node,
-		geometry.x,
-		geometry.y);
-	wlr_scene_node_set_position(
-		&toplevel->border_right->node,
-		geometry.x + geometry.width - bw,
-		geometry.y);
+void update_borders(KristalToplevel *toplevel) {
+	const uint64_t perf_start = kristal_perf_begin(KRISTAL_PERF_BORDERS);
+	rebuild_borders(toplevel);
+	kristal_perf_end(KRISTAL_PERF_BORDERS, perf_start);
 }
 
 void save_current_geometry(KristalToplevel *toplevel) {
@@ -290,15 +287,16 @@ void apply_fullscreen_state(KristalToplevel *toplevel, bool fullscreen) {
 
 void xdg_toplevel_map(Listener *listener, void * /*data*/) {
 	KristalToplevel *toplevel = wl_container_of(listener, toplevel, map);
+	const uint64_t perf_start = kristal_perf_begin(KRISTAL_PERF_MAP);
 	toplevel->view.mapped = true;
+	toplevel->view.minimized = false;
+	toplevel->view.stashed = false;
 	server_apply_window_rules(
 		&toplevel->view,
 		toplevel->xdg_toplevel->title,
 		toplevel->xdg_toplevel->app_id);
 	wl_list_insert(&toplevel->view.server->views, &toplevel->view.link);
-	wlr_scene_node_set_enabled(
-		&toplevel->view.scene_tree->node,
-		toplevel->view.workspace == toplevel->view.server->current_workspace);
+	server_view_update_visibility(&toplevel->view);
 	update_borders(toplevel);
 
 	if (toplevel->xdg_toplevel->requested.fullscreen) {
@@ -315,6 +313,15 @@ void xdg_toplevel_map(Listener *listener, void * /*data*/) {
 		toplevel->xdg_toplevel->app_id);
 	focus_toplevel(toplevel, toplevel->xdg_toplevel->base->surface);
 	server_arrange_workspace(toplevel->view.server);
+
+	pid_t pid = 0;
+	wl_client_get_credentials(
+		wl_resource_get_client(toplevel->xdg_toplevel->base->surface->resource),
+		&pid,
+		nullptr,
+		nullptr);
+	server_launcher_view_mapped(&toplevel->view, pid);
+	kristal_perf_end(KRISTAL_PERF_MAP, perf_start);
 }
 
 void xdg_toplevel_unmap(Listener *listener, void * /*data*/) {
@@ -326,6 +333,7 @@ void xdg_toplevel_unmap(Listener *listener, void * /*data*/) {
 	destroy_borders(toplevel);
 	wl_list_remove(&toplevel->view.link);
 	server_unregister_foreign_toplevel(&toplevel->view);
+	server_launcher_view_unmapped(&toplevel->view);
 	server_arrange_workspace(toplevel->view.server);
 }
 
@@ -340,6 +348,11 @@ void xdg_toplevel_commit(Listener *listener, void * /*data*/) {
 	}
 }
 
+void xdg_toplevel_configure(Listener *listener, void * /*data*/) {
+	KristalToplevel *toplevel = wl_container_of(listener, toplevel, configure);
+	server_client_configured(toplevel->xdg_toplevel->base->surface);
+}
+
 void xdg_toplevel_destroy(Listener *listener, void * /*data*/) {
 	KristalToplevel *toplevel = wl_container_of(listener, toplevel, destroy);
 
@@ -347,11 +360,13 @@ void xdg_toplevel_destroy(Listener *listener, void * /*data*/) {
 	wl_list_remove(&toplevel->map.link);
 	wl_list_remove(&toplevel->unmap.link);
 	wl_list_remove(&toplevel->commit.link);
+	wl_list_remove(&toplevel->configure.link);
 	wl_list_remove(&toplevel->destroy.link);
 	wl_list_remove(&toplevel->request_move.link);
 	wl_list_remove(&toplevel->request_resize.link);
 	wl_list_remove(&toplevel->request_maximize.link);
 	wl_list_remove(&toplevel->request_fullscreen.link);
+	wl_list_remove(&toplevel->request_minimize.link);
 	wl_list_remove(&toplevel->set_title.link);
 	wl_list_remove(&toplevel->set_app_id.link);
 	if (toplevel->view.mapped) {
@@ -437,6 +452,13 @@ void xdg_toplevel_request_fullscreen(Listener *listener, void * /*data*/) {
 	}
 }
 
+void xdg_toplevel_request_minimize(Listener *listener, void * /*data*/) {
+	KristalToplevel *toplevel = wl_container_of(listener, toplevel, request_minimize);
+	if (toplevel->view.mapped) {
+		server_view_set_minimized(&toplevel->view, true);
+	}
+}
+
 void xdg_popup_commit(Listener *listener, void * /*data*/) {
 	KristalPopup *popup = wl_container_of(listener, popup, commit);
 	if (popup->xdg_popup->base->initial_commit) {
@@ -464,38 +486,43 @@ void server_new_xdg_toplevel(Listener *listener, void *data) {
 	toplevel->view.mapped = false;
 	toplevel->view.force_floating = false;
 	toplevel->view.foreign_toplevel = nullptr;
+	toplevel->view.process = nullptr;
 	toplevel->xdg_toplevel = xdg_toplevel;
 	toplevel->border_top = nullptr;
 	toplevel->border_bottom = nullptr;
 	toplevel->border_left = nullptr;
 	toplevel->border_right = nullptr;
 	toplevel->view.scene_tree =
-		wlr_scene_xdg_surface_create(&toplevel->view.server->scene->tree, xdg_toplevel->base);
+		wlr_scene_xdg_surface_create(toplevel->view.server->view_tree, xdg_toplevel->base);
 	toplevel->view.scene_tree->node.data = &toplevel->view;
 	xdg_toplevel->base->data = toplevel->view.scene_tree;
 	toplevel->placed = false;
 
-	toplevel->map.notify = xdg_toplevel_map;
+	toplevel->map.notify = KRISTAL_PROFILED(xdg_toplevel_map);
 	wl_signal_add(&xdg_toplevel->base->surface->events.map, &toplevel->map);
-	toplevel->unmap.notify = xdg_toplevel_unmap;
+	toplevel->unmap.notify = KRISTAL_PROFILED(xdg_toplevel_unmap);
 	wl_signal_add(&xdg_toplevel->base->surface->events.unmap, &toplevel->unmap);
-	toplevel->commit.notify = xdg_toplevel_commit;
+	toplevel->commit.notify = KRISTAL_PROFILED(xdg_toplevel_commit);
 	wl_signal_add(&xdg_toplevel->base->surface->events.commit, &toplevel->commit);
+	toplevel->configure.notify = KRISTAL_PROFILED(xdg_toplevel_configure);
+	wl_signal_add(&xdg_toplevel->base->events.configure, &toplevel->configure);
 
-	toplevel->destroy.notify = xdg_toplevel_destroy;
+	toplevel->destroy.notify = KRISTAL_PROFILED(xdg_toplevel_destroy);
 	wl_signal_add(&xdg_toplevel->events.destroy, &toplevel->destroy);
 
-	toplevel->request_move.notify = xdg_toplevel_request_move;
+	toplevel->request_move.notify = KRISTAL_PROFILED(xdg_toplevel_request_move);
 	wl_signal_add(&xdg_toplevel->events.request_move, &toplevel->request_move);
-	toplevel->request_resize.notify = xdg_toplevel_request_resize;
+	toplevel->request_resize.notify = KRISTAL_PROFILED(xdg_toplevel_request_resize);
 	wl_signal_add(&xdg_toplevel->events.request_resize, &toplevel->request_resize);
-	toplevel->request_maximize.notify = xdg_toplevel_request_maximize;
+	toplevel->request_maximize.notify = KRISTAL_PROFILED(xdg_toplevel_request_maximize);
 	wl_signal_add(&xdg_toplevel->events.request_maximize, &toplevel->request_maximize);
-	toplevel->request_fullscreen.notify = xdg_toplevel_request_fullscreen;
+	toplevel->request_fullscreen.notify = KRISTAL_PROFILED(xdg_toplevel_request_fullscreen);
 	wl_signal_add(&xdg_toplevel->events.request_fullscreen, &toplevel->request_fullscreen);
-	toplevel->set_title.notify = xdg_toplevel_set_title;
+	toplevel->request_minimize.notify = KRISTAL_PROFILED(xdg_toplevel_request_minimize);
+	wl_signal_add(&xdg_toplevel->events.request_minimize, &toplevel->request_minimize);
+	toplevel->set_title.notify = KRISTAL_PROFILED(xdg_toplevel_set_title);
 	wl_signal_add(&xdg_toplevel->events.set_title, &toplevel->set_title);
-	toplevel->set_app_id.notify = xdg_toplevel_set_app_id;
+	toplevel->set_app_id.notify = KRISTAL_PROFILED(xdg_toplevel_set_app_id);
 	wl_signal_add(&xdg_toplevel->events.set_app_id, &toplevel->set_app_id);
 }
 
@@ -510,13 +537,30 @@ void server_new_xdg_popup(Listener * /*listener*/, void *data) {
 	auto *parent_tree = static_cast<SceneTree *>(parent->data);
 	xdg_popup->base->data = wlr_scene_xdg_surface_create(parent_tree, xdg_popup->base);
 
-	popup->commit.notify = xdg_popup_commit;
+	popup->commit.notify = KRISTAL_PROFILED(xdg_popup_commit);
 	wl_signal_add(&xdg_popup->base->surface->events.commit, &popup->commit);
 
-	popup->destroy.notify = xdg_popup_destroy;
+	popup->destroy.notify = KRISTAL_PROFILED(xdg_popup_destroy);
 	wl_signal_add(&xdg_popup->events.destroy, &popup->destroy);
 }
 
+void server_view_set_suspended(KristalView *view, bool suspended) {
+	/* Nothing on the desktop is on screen while the session is locked. */
+	suspended = suspended || view->server->session_locked;
+	if (view->suspended == suspended) {
+		return;
+	}
+	view->suspended = suspended;
+	/* Weights follow suspension; the occlusion pass applies them once. */
+	view->server->cgroup_weights_dirty = true;
+	server_power_update_inhibit(view->server, nullptr);
+	if (view->type == KRISTAL_VIEW_XDG) {
+		auto *toplevel = wl_container_of(view, (KristalToplevel *)nullptr, view);
+		/* A no-op for clients bound below version 6. */
+		wlr_xdg_toplevel_set_suspended(toplevel->xdg_toplevel, suspended);
+	}
+}
+
 void server_update_view_decorations(KristalView *view) {
 	if (view == nullptr) {
 		return;
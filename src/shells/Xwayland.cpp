@@ -49,6 +49,8 @@ void xwayland_surface_map(Listener *listener, void * /*data*/) {
 		return;
 	}
 	surface->view.mapped = true;
+	surface->view.minimized = false;
+	surface->view.stashed = false;
 	server_apply_window_rules(
 		&surface->view,
 		surface->xwayland_surface->title,
@@ -57,10 +59,8 @@ void xwayland_surface_map(Listener *listener, void * /*data*/) {
 		&surface->view.scene_tree->node,
 		surface->xwayland_surface->x,
 		surface->xwayland_surface->y);
-	wlr_scene_node_set_enabled(
-		&surface->view.scene_tree->node,
-		surface->view.workspace == surface->view.server->current_workspace);
 	wl_list_insert(&surface->view.server->views, &surface->view.link);
+	server_view_update_visibility(&surface->view);
 
 	server_register_foreign_toplevel(
 		&surface->view,
@@ -70,6 +70,7 @@ void xwayland_surface_map(Listener *listener, void * /*data*/) {
 		focus_surface(surface->view.server, surface->xwayland_surface->surface);
 	}
 	server_arrange_workspace(surface->view.server);
+	server_launcher_view_mapped(&surface->view, surface->xwayland_surface->pid);
 }
 
 void xwayland_surface_unmap(Listener *listener, void * /*data*/) {
@@ -80,6 +81,7 @@ void xwayland_surface_unmap(Listener *listener, void * /*data*/) {
 	surface->view.mapped = false;
 	wl_list_remove(&surface->view.link);
 	server_unregister_foreign_toplevel(&surface->view);
+	server_launcher_view_unmapped(&surface->view);
 	if (surface->view.server->grabbed_xwayland == surface) {
 		reset_cursor_mode(surface->view.server);
 	}
@@ -96,7 +98,7 @@ void xwayland_surface_associate(Listener *listener, void * /*data*/) {
 	}
 
 	surface->view.scene_tree = wlr_scene_subsurface_tree_create(
-		&surface->view.server->scene->tree,
+		surface->view.server->view_tree,
 		surface->xwayland_surface->surface);
 	surface->view.scene_tree->node.data = &surface->view;
 
@@ -131,6 +133,7 @@ void xwayland_surface_destroy(Listener *listener, void * /*data*/) {
 	wl_list_remove(&surface->request_resize.link);
 	wl_list_remove(&surface->request_configure.link);
 	wl_list_remove(&surface->request_activate.link);
+	wl_list_remove(&surface->request_minimize.link);
 	wl_list_remove(&surface->map_request.link);
 	wl_list_remove(&surface->set_title.link);
 	if (surface->view.scene_tree != nullptr) {
@@ -181,6 +184,14 @@ void xwayland_surface_request_activate(Listener *listener, void * /*data*/) {
 	}
 }
 
+void xwayland_surface_request_minimize(Listener *listener, void *data) {
+	KristalXwaylandSurface *surface = wl_container_of(listener, surface, request_minimize);
+	auto *event = static_cast<XwaylandMinimizeEvent *>(data);
+	if (surface->view.mapped) {
+		server_view_set_minimized(&surface->view, event->minimize);
+	}
+}
+
 void xwayland_surface_map_request(Listener *listener, void * /*data*/) {
 	KristalXwaylandSurface *surface = wl_container_of(listener, surface, map_request);
 	wlr_xwayland_surface_configure(
@@ -213,6 +224,7 @@ void server_new_xwayland_surface(Listener *listener, void *data) {
 	surface->view.mapped = false;
 	surface->view.force_floating = false;
 	surface->view.foreign_toplevel = nullptr;
+	surface->view.process = nullptr;
 	surface->xwayland_surface = xsurface;
 	xsurface->data = surface;
 
@@ -230,6 +242,8 @@ void server_new_xwayland_surface(Listener *listener, void *data) {
 	wl_signal_add(&xsurface->events.request_resize, &surface->request_resize);
 	surface->request_activate.notify = xwayland_surface_request_activate;
 	wl_signal_add(&xsurface->events.request_activate, &surface->request_activate);
+	surface->request_minimize.notify = xwayland_surface_request_minimize;
+	wl_signal_add(&xsurface->events.request_minimize, &surface->request_minimize);
 	surface->map_request.notify = xwayland_surface_map_request;
 	wl_signal_add(&xsurface->events.map_request, &surface->map_request);
 	surface->set_title.notify = xwayland_surface_set_title;